@@ -39,6 +39,8 @@
 
 // system includes:
 #include <complex>
+#include <memory>
+#include <vector>
 #include <assert.h>
 #include <stdlib.h>
 
@@ -77,6 +79,49 @@ namespace itk_fft
   // 
   typedef itk_complex_image_t::Pointer itk_complex_imageptr_t;
 
+  //----------------------------------------------------------------
+  // next_fast_fft_size
+  // 
+  // Returns the smallest size not less than n of the form
+  // 2^a * 3^b * 5^c. Transforms of such sizes are much faster than
+  // transforms of sizes with large prime factors, and they are the
+  // only sizes supported when FFTW is not available.
+  // 
+  extern unsigned int next_fast_fft_size(const unsigned int n);
+  
+  //----------------------------------------------------------------
+  // prev_fast_fft_size
+  // 
+  // Returns the largest size not greater than n of the form
+  // 2^a * 3^b * 5^c.
+  // 
+  extern unsigned int prev_fast_fft_size(const unsigned int n);
+  
+  //----------------------------------------------------------------
+  // lp_filter_mask_t
+  // 
+  // Low-pass filter response sampled on the bins of a spectrum,
+  // stored in the same order as the spectrum. Masks are immutable
+  // once created, so they may be shared between threads.
+  // 
+  typedef std::shared_ptr<const std::vector<float> > lp_filter_mask_t;
+  
+  //----------------------------------------------------------------
+  // lp_filter_mask
+  // 
+  // Returns the (cached) low-pass filter mask for the spectrum of
+  // a w x h image, see fft_data_t::apply_lp_filter for a description
+  // of the r and s parameters. When half is true the mask covers
+  // the non-redundant (w/2 + 1) x h half spectrum produced by fft_r2c.
+  // This is thread-safe.
+  // 
+  extern lp_filter_mask_t
+  lp_filter_mask(const unsigned int w,
+		 const unsigned int h,
+		 const bool half,
+		 const double r,
+		 const double s = 0);
+  
   //----------------------------------------------------------------
   // fft_data_t
   // 
@@ -116,10 +161,23 @@ namespace itk_fft
     // 0.5 at the cutoff frequency and 0 at twice the cutoff frequency.
     void apply_lp_filter(const double r, const double s = 0);
     
+    // Same as above, for the non-redundant half of the spectrum
+    // of a real image of width w, as produced by fft_r2c:
+    void apply_lp_filter_r2c(const unsigned int w,
+			     const double r,
+			     const double s = 0);
+    
     // accessors:
     inline const itk_complex_image_t * data() const { return image_.get(); }
     inline       itk_complex_image_t * data()       { return image_.get(); }
     
+    // contiguous spectrum storage, x varies fastest:
+    inline const fft_complex_t * buffer() const
+    { return image_->GetBufferPointer(); }
+    
+    inline fft_complex_t * buffer()
+    { return image_->GetBufferPointer(); }
+    
     inline unsigned int nx() const { return nx_; }
     inline unsigned int ny() const { return ny_; }
     
@@ -133,11 +191,11 @@ namespace itk_fft
     
     inline const fft_complex_t & at(const unsigned int & x,
 				    const unsigned int & y) const
-    { return image_->GetPixel({ x, y }); }
+    { return buffer()[x + y * nx_]; }
     
     inline fft_complex_t & at(const unsigned int & x,
 			      const unsigned int & y)
-    { return image_->GetPixel({ x, y }); }
+    { return buffer()[x + y * nx_]; }
     
   protected:
     itk_complex_imageptr_t image_;
@@ -149,6 +207,12 @@ namespace itk_fft
   //----------------------------------------------------------------
   // fft
   // 
+  // Forward transform of a real image. Transform plans and scratch
+  // buffers are cached per thread and per transform size, so
+  // repeated transforms of the same size do not pay for planning
+  // or allocation. Returns false if the transform size is not
+  // supported by the FFT library.
+  // 
   extern bool
   fft(itk_image_t::ConstPointer & in, fft_data_t & out);
   
@@ -158,9 +222,31 @@ namespace itk_fft
   extern bool
   fft(const fft_data_t & in, fft_data_t & out, TransformDirectionEnum sign = TransformDirectionEnum::FORWARD);
   
+  //----------------------------------------------------------------
+  // fft_r2c
+  // 
+  // Forward transform of a real w x h image. The spectrum of a real
+  // image is Hermitian, so only the non-redundant (w/2 + 1) x h half
+  // is computed and stored in out.
+  // 
+  extern bool
+  fft_r2c(itk_image_t::ConstPointer & in, fft_data_t & out);
+  
+  //----------------------------------------------------------------
+  // ifft_c2r
+  // 
+  // Inverse of fft_r2c. The real result is written directly into
+  // the given (preallocated) image, whose size determines the
+  // transform size. The result is not normalized.
+  // 
+  extern bool
+  ifft_c2r(const fft_data_t & in, itk_image_t * out);
+  
   //----------------------------------------------------------------
   // ifft
   // 
+  // Inverse (backward) transform, the result is not normalized:
+  // 
   extern bool
   ifft(const fft_data_t & in, fft_data_t & out);
   
@@ -179,6 +265,27 @@ namespace itk_fft
     return out;
   }
   
+  //----------------------------------------------------------------
+  // normalized_cross_power
+  // 
+  // Girod-Kuo normalized cross power spectrum of two spectra,
+  // with low-pass filtering folded in:
+  // 
+  //   p = in_mask^2 * f1 * conj(f0)
+  //   out = out_mask * p / (|p| + 1e-8)
+  // 
+  // All arrays are contiguous and hold size samples, out may alias
+  // f0 or f1. Uses AVX, SSE2 or NEON when the compiler targets them,
+  // plain scalar code otherwise.
+  // 
+  extern void
+  normalized_cross_power(const fft_complex_t * f0,
+			 const fft_complex_t * f1,
+			 const float * in_mask,
+			 const float * out_mask,
+			 fft_complex_t * out,
+			 const std::size_t size);
+  
   
   // //----------------------------------------------------------------
   // // fn_fft_c_t
@@ -39,6 +39,10 @@
 // system includes:
 #include <math.h>
 #include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <limits.h>
 
 #ifndef WIN32
@@ -146,6 +150,56 @@ public:
   int max_[2];
 };
 
+//----------------------------------------------------------------
+// cluster_stats_t
+//
+// Per-cluster statistics produced by label_clusters
+//
+class cluster_stats_t
+{
+public:
+  cluster_stats_t()
+    : mass_(0.0)
+    , cx_(0.0)
+    , cy_(0.0)
+    , area_(0)
+  {}
+
+  // sum of the pixel values above the background:
+  double mass_;
+
+  // center of mass of the cluster:
+  double cx_;
+  double cy_;
+
+  // number of pixels in the cluster:
+  unsigned int area_;
+
+  // bounding box of the cluster, in unwrapped coordinates
+  // (clusters broken up across the periodic boundary may
+  // extend past the image edges):
+  cluster_bbox_t bbox_;
+};
+
+//----------------------------------------------------------------
+// label_clusters
+//
+// Find the 8-connected clusters of pixels above the background value.
+// The labeling is done in two passes over a flat array union-find
+// forest: the first pass merges neighboring pixels, the second pass
+// accumulates the mass, area, center of mass and bounding box of each
+// cluster. When periodic is true the image is treated as a torus,
+// clusters broken up across the image edges are merged into one and
+// their center of mass is wrapped back into the image.
+//
+// Returns the number of clusters found.
+//
+extern unsigned int
+label_clusters(std::vector<cluster_stats_t> & clusters,
+               const itk_image_t *            image,
+               const double                   background,
+               const bool                     periodic = true);
+
 //----------------------------------------------------------------
 // find_maxima_cm
 //
@@ -167,23 +221,318 @@ find_maxima_cm(std::list<local_max_t> &     max_list,
                const the_text_t &           prefix = DEBUG_PDF_PFX,
                const the_text_t &           suffix = the_text_t(".png"));
 
+//----------------------------------------------------------------
+// find_maxima_top_k
+//
+// A lightweight alternative to find_maxima_cm. The image is scanned
+// once and the highest max_peaks local maxima (strictly greater than
+// their 8-connected neighbors, with periodic wraparound) are kept in
+// a bounded heap. Pixels outside the optional zone mask (zero entries)
+// are skipped. Each peak position is refined to sub-pixel accuracy
+// with a quadratic fit, falling back to the center of mass of the
+// 3x3 neighborhood where the fit is degenerate. Peak values are
+// measured above the mean of the eligible pixels and normalized
+// by the highest value, so they are comparable to the cluster
+// values produced by find_maxima_cm.
+//
+// Returns the number of maxima found.
+//
+extern unsigned int
+find_maxima_top_k(std::list<local_max_t> & max_list,
+                  const itk_image_t *      image,
+                  const unsigned char *    zone = nullptr,
+                  const unsigned int       max_peaks = 16);
+
+//----------------------------------------------------------------
+// peak_detector_t
+//
+// Supported correlation surface peak detectors
+//
+typedef enum
+{
+  // histogram threshold and cluster center of mass, find_maxima_cm:
+  PEAK_DETECTOR_CLUSTERS_E,
+
+  // bounded heap of sub-pixel local maxima, find_maxima_top_k:
+  PEAK_DETECTOR_TOP_K_E
+} peak_detector_t;
+
+//----------------------------------------------------------------
+// fft_padding_t
+//
+// How the correlated images are sized for the FFT
+//
+typedef enum
+{
+  // pad to the larger of the two image sizes:
+  FFT_PADDING_NONE_E,
+
+  // pad to the next 2^a * 3^b * 5^c size:
+  FFT_PADDING_GROW_E,
+
+  // crop to the previous 2^a * 3^b * 5^c size, the cropped
+  // images are apodized to suppress the edge discontinuity:
+  FFT_PADDING_CROP_E
+} fft_padding_t;
+
+//----------------------------------------------------------------
+// calc_fft_padding
+//
+// Returns the size of the correlation surface for two images,
+// which is also the period of the displacements found on it.
+//
+template <typename T>
+typename T::SizeType
+calc_fft_padding(const T * a, const T * b, const fft_padding_t fft_padding)
+{
+  typename T::SizeType sz = calc_padding<T>(a, b);
+
+  const unsigned int d = T::GetImageDimension();
+  for (unsigned int i = 0; i < d; i++)
+  {
+    if (fft_padding == FFT_PADDING_GROW_E)
+    {
+      sz[i] = next_fast_fft_size(sz[i]);
+    }
+    else if (fft_padding == FFT_PADDING_CROP_E)
+    {
+      sz[i] = prev_fast_fft_size(sz[i]);
+    }
+  }
+
+  return sz;
+}
+
+
+//----------------------------------------------------------------
+// spectrum_cache_t
+//
+// A thread-safe cache of padded image spectra. When a tile is
+// matched against each of its neighbors the spectrum of the tile
+// only has to be computed once. The spectra are not filtered,
+// find_correlation applies the low-pass filter while computing
+// the cross power spectrum, so a cached spectrum may be reused
+// with any filter parameters. The cache is bounded
+// by a memory budget, the least recently used spectra are evicted
+// first.
+//
+class spectrum_cache_t
+{
+public:
+  //----------------------------------------------------------------
+  // tile_t
+  //
+  // Identifies the image a spectrum was computed from. The image
+  // modification time guards against a new image reusing the address
+  // of an old one. The tag distinguishes between different spectra
+  // derived from the same image (masked and unmasked, for example).
+  //
+  class tile_t
+  {
+  public:
+    tile_t()
+      : image_(nullptr)
+      , mtime_(0)
+      , tag_(0)
+    {}
+
+    tile_t(const itk::Object * image, const unsigned int tag = 0)
+      : image_(image)
+      , mtime_(image->GetMTime())
+      , tag_(tag)
+    {}
+
+    inline bool
+    valid() const
+    {
+      return image_ != nullptr;
+    }
+
+    const itk::Object *   image_;
+    itk::ModifiedTimeType mtime_;
+    unsigned int          tag_;
+  };
+
+  typedef std::shared_ptr<const fft_data_t> spectrum_ptr_t;
+
+  spectrum_cache_t(const std::size_t max_bytes = std::size_t(256) << 20);
+
+  // lookup the spectrum of a tile padded to nx x ny pixels,
+  // returns nullptr if the spectrum is not cached:
+  spectrum_ptr_t
+  find(const tile_t & tile, const unsigned int nx, const unsigned int ny);
+
+  // add a spectrum to the cache, evict the least recently used
+  // spectra if the memory budget is exceeded:
+  void
+  insert(const tile_t &         tile,
+         const unsigned int     nx,
+         const unsigned int     ny,
+         const spectrum_ptr_t & spectrum);
+
+  void
+  clear();
+
+  // accessors:
+  std::size_t
+  size_in_bytes() const;
+  std::size_t
+  hits() const;
+  std::size_t
+  misses() const;
+
+private:
+  // intentionally disabled:
+  spectrum_cache_t(const spectrum_cache_t &);
+  spectrum_cache_t &
+  operator=(const spectrum_cache_t &);
+
+  //----------------------------------------------------------------
+  // key_t
+  //
+  class key_t
+  {
+  public:
+    bool
+    operator<(const key_t & k) const;
+
+    const itk::Object *   image_;
+    itk::ModifiedTimeType mtime_;
+    unsigned int          tag_;
+    unsigned int          nx_;
+    unsigned int          ny_;
+  };
+
+  static key_t
+  make_key(const tile_t & tile, const unsigned int nx, const unsigned int ny);
+
+  typedef std::list<std::pair<key_t, spectrum_ptr_t>> lru_t;
+
+  mutable std::mutex               mutex_;
+  lru_t                            lru_;
+  std::map<key_t, lru_t::iterator> index_;
+  const std::size_t                max_bytes_;
+  std::size_t                      bytes_;
+  std::size_t                      hits_;
+  std::size_t                      misses_;
+};
+
+
+//----------------------------------------------------------------
+// padded_spectrum
+//
+// Pad the image to the given size, and return the half spectrum
+// of the padded image. The spectrum cache is consulted first,
+// when one is given, and the new spectrum is added to it.
+// Returns nullptr if the transform fails.
+//
+extern spectrum_cache_t::spectrum_ptr_t
+padded_spectrum(const itk_image_t *              image,
+                const itk_image_t::SizeType &    max_sz,
+                spectrum_cache_t *               spectrum_cache,
+                const spectrum_cache_t::tile_t & tile);
+
+//----------------------------------------------------------------
+// padded_spectrum
+//
+// Compute (or lookup) the spectrum of an image, identified in
+// the cache the same way find_correlation identifies its inputs.
+// This is used to compute a batch of same-size spectra back
+// to back, ahead of the find_correlation calls that need them.
+//
+template <class TImage>
+spectrum_cache_t::spectrum_ptr_t
+padded_spectrum(const TImage * image, const itk_image_t::SizeType & max_sz, spectrum_cache_t * spectrum_cache)
+{
+  itk_image_t::Pointer z = cast<TImage, itk_image_t>(image);
+  return padded_spectrum(z, max_sz, spectrum_cache, spectrum_cache_t::tile_t(image));
+}
+
+//----------------------------------------------------------------
+// padded_spectrum
+//
+template <>
+inline spectrum_cache_t::spectrum_ptr_t
+padded_spectrum(const itk_image_t * image, const itk_image_t::SizeType & max_sz, spectrum_cache_t * spectrum_cache)
+{
+  return padded_spectrum(image, max_sz, spectrum_cache, spectrum_cache_t::tile_t(image));
+}
+
+
+//----------------------------------------------------------------
+// overlap_zone_t
+//
+// Marks the displacements of a padded correlation PDF that would
+// produce an overlap within the [overlap_min, overlap_max] range
+// between the fixed and moving images. Zones are immutable once
+// created, so they may be shared between threads.
+//
+class overlap_zone_t
+{
+public:
+  // one byte per PDF pixel, non-zero where a match is possible:
+  std::vector<unsigned char> mask_;
+
+  // number of pixels attributed to the overlap zone:
+  unsigned int pixels_;
+};
+
+typedef std::shared_ptr<const overlap_zone_t> overlap_zone_ptr_t;
+
+//----------------------------------------------------------------
+// overlap_zone
+//
+// Returns the (cached) overlap zone for a fixed image of fi_size
+// pixels matched over a PDF of padded_size pixels. Every pair of
+// tiles in a mosaic usually shares the same geometry, so the zone
+// is computed once and reused. This is thread-safe.
+//
+extern overlap_zone_ptr_t
+overlap_zone(const itk_image_t::SizeType & fi_size,
+             const itk_image_t::SizeType & padded_size,
+             const double                  overlap_min,
+             const double                  overlap_max);
+
 
 //----------------------------------------------------------------
 // find_correlation
 //
+// When a spectrum cache is given the filtered spectra of the
+// fixed and moving images are looked up in the cache before
+// they are computed. By default the images are identified by
+// their own address.
+//
 template <class TImage>
 unsigned int
-find_correlation(std::list<local_max_t> & max_list,
-                 const TImage *           fi,
-                 const TImage *           mi,
-                 double                   lp_filter_r,
-                 double                   lp_filter_s,
-                 const double             min_overlap,
-                 const double             max_overlap)
+find_correlation(std::list<local_max_t> &         max_list,
+                 const TImage *                   fi,
+                 const TImage *                   mi,
+                 double                           lp_filter_r,
+                 double                           lp_filter_s,
+                 const double                     min_overlap,
+                 const double                     max_overlap,
+                 spectrum_cache_t *               spectrum_cache = nullptr,
+                 const spectrum_cache_t::tile_t & fi_tile = spectrum_cache_t::tile_t(),
+                 const spectrum_cache_t::tile_t & mi_tile = spectrum_cache_t::tile_t(),
+                 const peak_detector_t            peak_detector = PEAK_DETECTOR_CLUSTERS_E,
+                 const fft_padding_t              fft_padding = FFT_PADDING_NONE_E)
 {
   itk_image_t::Pointer z0 = cast<TImage, itk_image_t>(fi);
   itk_image_t::Pointer z1 = cast<TImage, itk_image_t>(mi);
-  return find_correlation<itk_image_t>(max_list, z0, z1, lp_filter_r, lp_filter_s, min_overlap, max_overlap);
+
+  // the casted images are temporary, identify them by the originals:
+  return find_correlation<itk_image_t>(max_list,
+                                       z0,
+                                       z1,
+                                       lp_filter_r,
+                                       lp_filter_s,
+                                       min_overlap,
+                                       max_overlap,
+                                       spectrum_cache,
+                                       fi_tile.valid() ? fi_tile : spectrum_cache_t::tile_t(fi),
+                                       mi_tile.valid() ? mi_tile : spectrum_cache_t::tile_t(mi),
+                                       peak_detector,
+                                       fft_padding);
 }
 
 
@@ -199,10 +548,15 @@ find_correlation(std::list<local_max_t> & max_list,
 
                  // low pass filter parameters
                  // (resampled data requires less smoothing):
-                 double       lp_filter_r,
-                 double       lp_filter_s,
-                 const double overlap_min,
-                 const double overlap_max);
+                 double                           lp_filter_r,
+                 double                           lp_filter_s,
+                 const double                     overlap_min,
+                 const double                     overlap_max,
+                 spectrum_cache_t *               spectrum_cache,
+                 const spectrum_cache_t::tile_t & fi_tile,
+                 const spectrum_cache_t::tile_t & mi_tile,
+                 const peak_detector_t            peak_detector,
+                 const fft_padding_t              fft_padding);
 
 
 //----------------------------------------------------------------
@@ -212,15 +566,31 @@ find_correlation(std::list<local_max_t> & max_list,
 //
 template <class TImage>
 unsigned int
-find_correlation(const TImage *           fi,
-                 const TImage *           mi,
-                 std::list<local_max_t> & max_list,
-                 bool                     resampled_data,
-                 const double             overlap_min,
-                 const double             overlap_max)
+find_correlation(const TImage *                   fi,
+                 const TImage *                   mi,
+                 std::list<local_max_t> &         max_list,
+                 bool                             resampled_data,
+                 const double                     overlap_min,
+                 const double                     overlap_max,
+                 spectrum_cache_t *               spectrum_cache = nullptr,
+                 const spectrum_cache_t::tile_t & fi_tile = spectrum_cache_t::tile_t(),
+                 const spectrum_cache_t::tile_t & mi_tile = spectrum_cache_t::tile_t(),
+                 const peak_detector_t            peak_detector = PEAK_DETECTOR_CLUSTERS_E,
+                 const fft_padding_t              fft_padding = FFT_PADDING_NONE_E)
 {
   double lp_filter_r = resampled_data ? 0.9 : 0.5;
-  return find_correlation<TImage>(max_list, fi, mi, lp_filter_r, 0.1, overlap_min, overlap_max);
+  return find_correlation<TImage>(max_list,
+                                  fi,
+                                  mi,
+                                  lp_filter_r,
+                                  0.1,
+                                  overlap_min,
+                                  overlap_max,
+                                  spectrum_cache,
+                                  fi_tile,
+                                  mi_tile,
+                                  peak_detector,
+                                  fft_padding);
 }
 
 
@@ -304,7 +674,13 @@ estimate_displacement(the_log_t &                      log,
                       const double                     overlap_min = 0.0,
                       const double                     overlap_max = 1.0,
                       const mask_t *                   mask_a = nullptr,
-                      const mask_t *                   mask_b = nullptr)
+                      const mask_t *                   mask_b = nullptr,
+                      const fft_padding_t              fft_padding = FFT_PADDING_NONE_E,
+
+                      // optional summed area tables of the masked images,
+                      // shared by the permutations of all the peaks:
+                      const masked_sat_t * sat_a = nullptr,
+                      const masked_sat_t * sat_b = nullptr)
 {
   // FIXME:
 #ifdef DEBUG_PDF
@@ -313,8 +689,11 @@ estimate_displacement(the_log_t &                      log,
 #endif
 
   itk_image_t::SizeType max_sz = calc_padding<TImage>(a, b);
-  const unsigned int &  w = max_sz[0];
-  const unsigned int &  h = max_sz[1];
+
+  // the maxima wrap around with the period of the correlation surface:
+  itk_image_t::SizeType pdf_sz = calc_fft_padding<TImage>(a, b, fft_padding);
+  const unsigned int &  w = pdf_sz[0];
+  const unsigned int &  h = pdf_sz[1];
 
   // evaluate 4 permutations of the maxima:
   // typedef itk::NormalizedCorrelationImageToImageMetric<TImage, TImage>
@@ -341,6 +720,10 @@ estimate_displacement(the_log_t &                      log,
   max_sz_with_spacing[1] = max_sz[1] * sy;
 
 
+  // the permutations that pass the padded overlap test,
+  // evaluated together in one pass over the images:
+  std::vector<vec2d_t>      candidates;
+  std::vector<unsigned int> permutation;
   for (unsigned int i = 0; i < 4; i++)
   {
     double overlap = OverlapPercent(max_sz_with_spacing, t[i]);
@@ -348,6 +731,19 @@ estimate_displacement(the_log_t &                      log,
     if (overlap < overlap_min || overlap > overlap_max)
       continue;
 
+    candidates.push_back(t[i]);
+    permutation.push_back(i);
+  }
+
+  std::vector<double> area_ratios;
+  std::vector<double> metrics;
+  my_metric_candidates<TImage>(
+    area_ratios, metrics, a, b, candidates, mask_a, mask_b, overlap_min, overlap_max, sat_a, sat_b);
+
+  for (unsigned int j = 0; j < candidates.size(); j++)
+  {
+    const unsigned int i = permutation[j];
+
     translate_transform_t::Pointer ti = translate_transform_t::New();
     ti->SetOffset(t[i]);
 
@@ -357,7 +753,7 @@ estimate_displacement(the_log_t &                      log,
     save_rgb<TImage>(fn, a, b, ti, mask_a, mask_b);
 #endif
 
-    const double area_ratio = overlap_ratio<TImage>(a, b, ti);
+    const double area_ratio = area_ratios[j];
     int          old_precision = log.precision();
     log.precision(2);
     log << i << ": " << setw(3) << std::fixed << area_ratio * 100.0 << "% of overlap, ";
@@ -369,8 +765,7 @@ estimate_displacement(the_log_t &                      log,
       continue;
     }
 
-    // double metric = eval_metric<metric_t, interpolator_t>(ti, a, b);
-    double metric = my_metric<TImage>(a, b, ti, mask_a, mask_b, overlap_min, overlap_max);
+    double metric = metrics[j];
     log << std::scientific << metric;
     if (metric < best_metric)
     {
@@ -421,7 +816,17 @@ match_one_pair(the_log_t &    log,
                // ideally this should be one, but radial distortion may
                // generate several valid peaks (up to 4), so it may be
                // necessary to consider more peaks for the unmatched images:
-               const unsigned int max_peaks)
+               const unsigned int max_peaks,
+
+               // optional cache of the tile spectra, shared by all
+               // pairs that involve the same tiles:
+               spectrum_cache_t * spectrum_cache = nullptr,
+
+               // how to size the images for the FFT:
+               const fft_padding_t fft_padding = FFT_PADDING_NONE_E,
+
+               // how to find the peaks of the correlation surface:
+               const peak_detector_t peak_detector = PEAK_DETECTOR_CLUSTERS_E)
 {
 #ifdef DEBUG_PDF
   DEBUG_COUNTER1++;
@@ -446,12 +851,32 @@ match_one_pair(the_log_t &    log,
     typename TImage::Pointer mi_filled = cast<TImage, TImage>(mi);
     fill<TImage>(mi_filled, 0, mi_y, mi_sz[0], mi_sz[1] - mi_y, 0);
 
-    total_peaks =
-      find_correlation<TImage>(fi_filled, mi_filled, peaks, images_were_resampled, overlap_min, overlap_max);
+    // the filled images are temporary, identify them by the originals:
+    total_peaks = find_correlation<TImage>(fi_filled,
+                                           mi_filled,
+                                           peaks,
+                                           images_were_resampled,
+                                           overlap_min,
+                                           overlap_max,
+                                           spectrum_cache,
+                                           spectrum_cache_t::tile_t(fi, 1),
+                                           spectrum_cache_t::tile_t(mi, 1),
+                                           peak_detector,
+                                           fft_padding);
   }
   else
   {
-    total_peaks = find_correlation<TImage>(fi, mi, peaks, images_were_resampled, overlap_min, overlap_max);
+    total_peaks = find_correlation<TImage>(fi,
+                                           mi,
+                                           peaks,
+                                           images_were_resampled,
+                                           overlap_min,
+                                           overlap_max,
+                                           spectrum_cache,
+                                           spectrum_cache_t::tile_t(),
+                                           spectrum_cache_t::tile_t(),
+                                           peak_detector,
+                                           fft_padding);
   }
 
   num_peaks = reject_negligible_maxima(peaks, 3.0);
@@ -466,6 +891,28 @@ match_one_pair(the_log_t &    log,
   // choose the best peak:
   double best_metric = std::numeric_limits<double>::max();
 
+  // the masked image statistics of every candidate overlap
+  // region come from the summed area tables, each table is
+  // only built when the masks allow it to be consulted:
+  bool         use_fi_sat = false;
+  bool         use_mi_sat = false;
+  masked_sat_t fi_sat;
+  masked_sat_t mi_sat;
+  if (!peaks.empty())
+  {
+    masked_sat_usable<TImage>(fi, mi, fi_mask, mi_mask, use_fi_sat, use_mi_sat);
+  }
+
+  if (use_fi_sat)
+  {
+    fi_sat.build<TImage>(fi, fi_mask);
+  }
+
+  if (use_mi_sat)
+  {
+    mi_sat.build<TImage>(mi, mi_mask);
+  }
+
 #ifdef DEBUG_PDF
   DEBUG_COUNTER2 = 0;
 #endif
@@ -475,8 +922,20 @@ match_one_pair(the_log_t &    log,
     const local_max_t & lm = *j;
 
     translate_transform_t::Pointer tmp = translate_transform_t::New();
-    double                         metric = estimate_displacement<TImage>(
-      log, fi, mi, lm, tmp, offset_min, offset_max, overlap_min, overlap_max, fi_mask, mi_mask);
+    double                         metric = estimate_displacement<TImage>(log,
+                                                  fi,
+                                                  mi,
+                                                  lm,
+                                                  tmp,
+                                                  offset_min,
+                                                  offset_max,
+                                                  overlap_min,
+                                                  overlap_max,
+                                                  fi_mask,
+                                                  mi_mask,
+                                                  fft_padding,
+                                                  use_fi_sat ? &fi_sat : nullptr,
+                                                  use_mi_sat ? &mi_sat : nullptr);
     if (metric < best_metric)
     {
       best_metric = metric;
@@ -521,7 +980,16 @@ match_one_pair(the_log_t &    log,
                // ideally this should be one, but radial distortion may
                // generate several valid peaks (up to 4), so it may be
                // necessary to consider more peaks for the unmatched images:
-               const unsigned int max_peaks)
+               const unsigned int max_peaks,
+
+               // optional cache of the tile spectra:
+               spectrum_cache_t * spectrum_cache = nullptr,
+
+               // how to size the images for the FFT:
+               const fft_padding_t fft_padding = FFT_PADDING_NONE_E,
+
+               // how to find the peaks of the correlation surface:
+               const peak_detector_t peak_detector = PEAK_DETECTOR_CLUSTERS_E)
 {
   unsigned int           peak_list_size = 0;
   std::list<local_max_t> peak_list;
@@ -539,7 +1007,10 @@ match_one_pair(the_log_t &    log,
                                            ti,
                                            peak_list,
                                            peak_list_size,
-                                           max_peaks);
+                                           max_peaks,
+                                           spectrum_cache,
+                                           fft_padding,
+                                           peak_detector);
 
   // this info will be used when trying to match the unmatched images:
   if (peak_list_size != 0 && peak_list_size <= max_peaks &&
@@ -569,7 +1040,10 @@ match_one_pair(the_log_t &                      log,
                const double                     overlap_max,
                image_t::PointType               offset_min,
                image_t::PointType               offset_max,
-               translate_transform_t::Pointer & ti)
+               translate_transform_t::Pointer & ti,
+               spectrum_cache_t *               spectrum_cache = nullptr,
+               const fft_padding_t              fft_padding = FFT_PADDING_NONE_E,
+               const peak_detector_t            peak_detector = PEAK_DETECTOR_CLUSTERS_E)
 {
   std::list<local_max_t> peaks;
   unsigned int           num_peaks = 0;
@@ -587,7 +1061,10 @@ match_one_pair(the_log_t &                      log,
                                        ti,
                                        peaks,
                                        num_peaks,
-                                       UINT_MAX);
+                                       UINT_MAX,
+                                       spectrum_cache,
+                                       fft_padding,
+                                       peak_detector);
 }
 
 
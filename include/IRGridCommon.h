@@ -43,6 +43,7 @@
 #include <stdlib.h>
 #include <algorithm>
 #include <functional>
+#include <map>
 #include <time.h>
 
 // ITK includes:
@@ -168,18 +169,26 @@ estimate_displacement(the_log_t & log,
   }
 #endif
 
-  std::vector<double> metricArray;
-  metricArray.reserve(num_perms);
+  // evaluate the permutations together in one pass over the images:
+  std::vector<vec2d_t> candidates(num_perms);
+  for (unsigned int i = 0; i < num_perms; i++)
+  {
+    candidates[i] = t[i] - offset;
+  }
 
-  std::vector<translate_transform_t::Pointer> transformArray;
-  transformArray.reserve(num_perms);
+  std::vector<double> area_ratios;
+  std::vector<double> metrics;
+  my_metric_candidates<TImage>(area_ratios, metrics, a, b, candidates, mask_a, mask_b, overlap_min, overlap_max);
 
-  for (int i = 0; i < (int)num_perms; i++)
-  {
-    translate_transform_t::Pointer ti = translate_transform_t::New();
-    ti->SetOffset(t[i] - offset);
+  // the permutations within the overlap limits:
+  std::vector<double>       metricArray;
+  std::vector<unsigned int> permutationArray;
+  metricArray.reserve(num_perms);
+  permutationArray.reserve(num_perms);
 
-    double area_ratio = overlap_ratio<TImage>(a, b, ti);
+  for (unsigned int i = 0; i < num_perms; i++)
+  {
+    double area_ratio = area_ratios[i];
     log << i << ": " << setw(3) << int(area_ratio * 100.0) << "% of overlap, ";
 
     if (area_ratio < overlap_min || area_ratio > overlap_max)
@@ -188,28 +197,14 @@ estimate_displacement(the_log_t & log,
       continue;
     }
 
-#if 0
-    typedef itk::LinearInterpolateImageFunction<TImage, double> interpolator_t;
-    // typedef itk::MeanSquaresImageToImageMetric<TImage, TImage> metric_t;
-    typedef itk::NormalizedCorrelationImageToImageMetric<TImage, TImage>
-      metric_t;
-    double metric = eval_metric<metric_t, interpolator_t>(ti,
-							  a,
-							  b,
-							  mask_a,
-							  mask_b);
-#else
-    double metric = my_metric<TImage>(area_ratio, a, b, ti, mask_a, mask_b, overlap_min, overlap_max);
-    metricArray.push_back(metric);
-#endif
-
-    transformArray.push_back(ti);
+    metricArray.push_back(metrics[i]);
+    permutationArray.push_back(i);
   }
 
-  for (int i = 0; i < (int)metricArray.size(); i++)
+  for (unsigned int j = 0; j < metricArray.size(); j++)
   {
-    double                         metric = metricArray[i];
-    translate_transform_t::Pointer ti = transformArray[i];
+    const unsigned int i = permutationArray[j];
+    double             metric = metricArray[j];
 
     log << metric;
     if (metric < best_metric)
@@ -220,6 +215,8 @@ estimate_displacement(the_log_t & log,
 
 #ifdef DEBUG_ESTIMATE_DISPLACEMENT
       // FIXME:
+      translate_transform_t::Pointer ti = translate_transform_t::New();
+      ti->SetOffset(candidates[i]);
       save_rgb<TImage>(fn_save + suffix + the_text_t::number(i + 1) + "-perm.png", a, b, ti, mask_a, mask_b);
 #endif
     }
@@ -230,7 +227,7 @@ estimate_displacement(the_log_t & log,
   }
 
   metricArray.clear();
-  transformArray.clear();
+  permutationArray.clear();
 
   best_transform->SetOffset(best_offset);
 }
@@ -377,13 +374,16 @@ match_one_pair(the_log_t &                      log,
                const double & lp_filter_s,
 
                const unsigned int max_peaks,
-               const bool &       consider_zero_displacement)
+               const bool &       consider_zero_displacement,
+
+               // optional cache of the neighborhood spectra:
+               spectrum_cache_t * spectrum_cache = nullptr)
 {
   best_transform = nullptr;
 
   std::list<local_max_t> max_list;
   unsigned int           total_peaks =
-    find_correlation<TImage>(max_list, fi, mi, lp_filter_r, lp_filter_s, overlap_min, overlap_max);
+    find_correlation<TImage>(max_list, fi, mi, lp_filter_r, lp_filter_s, overlap_min, overlap_max, spectrum_cache);
 
   unsigned int num_peaks = reject_negligible_maxima(max_list, 2.0);
   log << num_peaks << '/' << total_peaks << " eligible peaks, ";
@@ -471,7 +471,10 @@ refine_one_point_fft(the_log_t & log,
                      const TImage * img_0,
                      const mask_t * msk_0,
                      const TImage * img_1,
-                     const mask_t * msk_1)
+                     const mask_t * msk_1,
+
+                     // optional cache of the neighborhood spectra:
+                     spectrum_cache_t * spectrum_cache = nullptr)
 {
   // feed the two neighborhoods into the FFT translation estimator:
   translate_transform_t::Pointer translate;
@@ -501,7 +504,8 @@ refine_one_point_fft(the_log_t & log,
                                          0.5,   // low pass filter r
                                          0.1,   // low pass filter s
                                          10,    // number of peaks
-                                         true); // consider the no-displacement case
+                                         true,  // consider the no-displacement case
+                                         spectrum_cache);
 
 #ifdef DEBUG_REFINE_ONE_POINT
   static const the_text_t fn_save("/tmp/refine_one_point_fft-");
@@ -978,6 +982,143 @@ tiles_intersect( // the large images and their masks:
   return in[0] && in[1];
 }
 
+//----------------------------------------------------------------
+// extract_large_neighborhood
+//
+// Extract a neighborhood twice the given size, centered at the
+// given mosaic space point, from the fixed tile:
+//
+template <typename TImage>
+void
+extract_large_neighborhood(const TImage * tile_0,
+                           const mask_t * mask_0,
+
+                           // transform from mosaic space to tile space:
+                           const base_transform_t * forward_0,
+
+                           // mosaic space neighborhood center:
+                           const pnt2d_t & center,
+
+                           // small neighborhood size and pixel spacing:
+                           const typename TImage::SizeType &    sz,
+                           const typename TImage::SpacingType & sp,
+
+                           // the extracted larger neighborhood:
+                           TImage * img_0_large,
+                           mask_t * msk_0_large)
+{
+  typedef itk::LinearInterpolateImageFunction<TImage, double> interpolator_t;
+  typename interpolator_t::Pointer                            interpolator = interpolator_t::New();
+  interpolator->SetInputImage(tile_0);
+
+  // temporaries:
+  pnt2d_t                    mosaic_pt;
+  pnt2d_t                    tile_pt;
+  typename TImage::IndexType index;
+
+  pnt2d_t origin_large(center);
+  origin_large[0] -= sz[0] * sp[0];
+  origin_large[1] -= sz[1] * sp[1];
+
+  for (unsigned int y = 0; y < sz[1] * 2; y++)
+  {
+    mosaic_pt[1] = origin_large[1] + double(y) * sp[1];
+    index[1] = y;
+    for (unsigned int x = 0; x < sz[0] * 2; x++)
+    {
+      mosaic_pt[0] = origin_large[0] + double(x) * sp[0];
+      index[0] = x;
+
+      // fixed image:
+      tile_pt = forward_0->TransformPoint(mosaic_pt);
+      if (interpolator->IsInsideBuffer(tile_pt) && pixel_in_mask(mask_0, tile_pt))
+      {
+        double p = interpolator->Evaluate(tile_pt);
+        img_0_large->SetPixel(index, (unsigned char)(std::min(255.0, p)));
+        msk_0_large->SetPixel(index, 1);
+      }
+      else
+      {
+        img_0_large->SetPixel(index, 0);
+        msk_0_large->SetPixel(index, 0);
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------
+// neighborhood_cache_t
+//
+// The neighborhoods of one tile resampled through its transform,
+// keyed by neighborhood index (mesh vertex index, typically), so
+// that several matches of the same neighborhood share one costly
+// resampling. The cached neighborhoods are only valid while the
+// tile transform and the neighborhood size stay the same.
+// The cache is not thread safe.
+//
+template <typename TImage>
+class neighborhood_cache_t
+{
+public:
+  typedef typename TImage::PixelType pixel_t;
+  typedef typename mask_t::PixelType mask_pixel_t;
+
+  // copy a cached neighborhood into the given images,
+  // return false if the neighborhood is not cached:
+  bool
+  find(const std::size_t key, TImage * img, mask_t * msk, unsigned int & area) const
+  {
+    typename std::map<std::size_t, entry_t>::const_iterator found = entries_.find(key);
+    if (found == entries_.end())
+    {
+      return false;
+    }
+
+    const entry_t & entry = found->second;
+    std::copy(entry.img_.begin(), entry.img_.end(), img->GetBufferPointer());
+    std::copy(entry.msk_.begin(), entry.msk_.end(), msk->GetBufferPointer());
+    area = entry.area_;
+    return true;
+  }
+
+  // store a copy of the given neighborhood:
+  void
+  insert(const std::size_t key, const TImage * img, const mask_t * msk, const unsigned int area)
+  {
+    const std::size_t num_pixels = img->GetBufferedRegion().GetNumberOfPixels();
+
+    entry_t & entry = entries_[key];
+    entry.img_.assign(img->GetBufferPointer(), img->GetBufferPointer() + num_pixels);
+    entry.msk_.assign(msk->GetBufferPointer(), msk->GetBufferPointer() + num_pixels);
+    entry.area_ = area;
+  }
+
+  inline void
+  clear()
+  {
+    entries_.clear();
+  }
+
+  inline std::size_t
+  size() const
+  {
+    return entries_.size();
+  }
+
+private:
+  class entry_t
+  {
+  public:
+    std::vector<pixel_t>      img_;
+    std::vector<mask_pixel_t> msk_;
+
+    // number of pixels within the tile and its mask:
+    unsigned int area_;
+  };
+
+  std::map<std::size_t, entry_t> entries_;
+};
+
 //----------------------------------------------------------------
 // refine_one_point_helper
 //
@@ -1009,7 +1150,12 @@ refine_one_point_helper( // the large images and their masks:
   TImage * img_0,
   mask_t * msk_0,
   TImage * img_1,
-  mask_t * msk_1)
+  mask_t * msk_1,
+
+  // optional cache of the moving tile neighborhoods,
+  // and the key of this neighborhood in the cache:
+  neighborhood_cache_t<TImage> * cache_1 = nullptr,
+  const std::size_t              key_1 = 0)
 {
   pnt2d_t origin = center;
   origin[0] -= (double(sz[0]) * sp[0]) / 2;
@@ -1035,6 +1181,9 @@ refine_one_point_helper( // the large images and their masks:
   // keep count of pixel in the neighborhood:
   unsigned int area[] = { 0, 0 };
 
+  // the moving tile neighborhood may have been resampled already:
+  const bool cached_1 = (cache_1 != nullptr) && cache_1->find(key_1, img_1, msk_1, area[1]);
+
   // extract a neighborhood of the given point from both tiles:
   for (unsigned int y = 0; y < sz[1]; y++)
   {
@@ -1060,6 +1209,11 @@ refine_one_point_helper( // the large images and their masks:
         msk_0->SetPixel(index, 0);
       }
 
+      if (cached_1)
+      {
+        continue;
+      }
+
       // moving image:
       tile_pt = forward_1->TransformPoint(mosaic_pt);
       if (interpolator[1]->IsInsideBuffer(tile_pt) && pixel_in_mask(mask_1, tile_pt))
@@ -1077,6 +1231,11 @@ refine_one_point_helper( // the large images and their masks:
     }
   }
 
+  if (cache_1 != nullptr && !cached_1)
+  {
+    cache_1->insert(key_1, img_1, msk_1, area[1]);
+  }
+
   // skip points which don't have enough neighborhood information:
   double max_area = double(sz[0] * sz[1]);
   double a[] = { double(area[0]) / max_area, double(area[1]) / max_area };
@@ -1088,35 +1247,7 @@ refine_one_point_helper( // the large images and their masks:
 
   if (img_0_large != nullptr)
   {
-    // extract the larger neighborhood from the fixed tile:
-    pnt2d_t origin_large(center);
-    origin_large[0] -= sz[0] * sp[0];
-    origin_large[1] -= sz[1] * sp[1];
-
-    for (unsigned int y = 0; y < sz[1] * 2; y++)
-    {
-      mosaic_pt[1] = origin_large[1] + double(y) * sp[1];
-      index[1] = y;
-      for (unsigned int x = 0; x < sz[0] * 2; x++)
-      {
-        mosaic_pt[0] = origin_large[0] + double(x) * sp[0];
-        index[0] = x;
-
-        // fixed image:
-        tile_pt = forward_0->TransformPoint(mosaic_pt);
-        if (interpolator[0]->IsInsideBuffer(tile_pt) && pixel_in_mask(mask_0, tile_pt))
-        {
-          double p = interpolator[0]->Evaluate(tile_pt);
-          img_0_large->SetPixel(index, (unsigned char)(std::min(255.0, p)));
-          msk_0_large->SetPixel(index, 1);
-        }
-        else
-        {
-          img_0_large->SetPixel(index, 0);
-          msk_0_large->SetPixel(index, 0);
-        }
-      }
-    }
+    extract_large_neighborhood<TImage>(tile_0, mask_0, forward_0, center, sz, sp, img_0_large, msk_0_large);
   }
 
   return true;
@@ -1297,6 +1428,454 @@ refine_one_point_fft(the_log_t & log,
 }
 
 
+//----------------------------------------------------------------
+// neighborhood_batch_t
+//
+// Fixed and moving image neighborhoods (and their masks) of a batch
+// of points, all of the same size. The pixels of all neighborhoods
+// are stored in one contiguous buffer, the images are views into it.
+//
+template <typename TImage>
+class neighborhood_batch_t
+{
+public:
+  typedef typename TImage::PixelType pixel_t;
+  typedef typename mask_t::PixelType mask_pixel_t;
+
+  neighborhood_batch_t(const std::size_t                    num_points,
+                       const typename TImage::SizeType &    sz,
+                       const typename TImage::SpacingType & sp)
+    : num_pixels_(sz[0] * sz[1])
+    , pixels_(2 * num_points * num_pixels_)
+    , masks_(2 * num_points * num_pixels_)
+    , img_(2 * num_points)
+    , msk_(2 * num_points)
+  {
+    for (std::size_t i = 0; i < img_.size(); i++)
+    {
+      img_[i] = TImage::New();
+      img_[i]->SetRegions(sz);
+      img_[i]->SetSpacing(sp);
+      img_[i]->GetPixelContainer()->SetImportPointer(&pixels_[i * num_pixels_], num_pixels_, false);
+
+      msk_[i] = mask_t::New();
+      msk_[i]->SetRegions(sz);
+      msk_[i]->SetSpacing(sp);
+      msk_[i]->GetPixelContainer()->SetImportPointer(&masks_[i * num_pixels_], num_pixels_, false);
+    }
+  }
+
+  // which: 0 - fixed image neighborhood, 1 - moving image neighborhood
+  inline TImage *
+  image(const std::size_t point, const unsigned int which) const
+  {
+    return img_[2 * point + which].GetPointer();
+  }
+
+  inline mask_t *
+  mask(const std::size_t point, const unsigned int which) const
+  {
+    return msk_[2 * point + which].GetPointer();
+  }
+
+private:
+  // intentionally disabled:
+  neighborhood_batch_t(const neighborhood_batch_t &);
+  neighborhood_batch_t &
+  operator=(const neighborhood_batch_t &);
+
+  std::size_t                           num_pixels_;
+  std::vector<pixel_t>                  pixels_;
+  std::vector<mask_pixel_t>             masks_;
+  std::vector<typename TImage::Pointer> img_;
+  std::vector<mask_t::Pointer>          msk_;
+};
+
+//----------------------------------------------------------------
+// refine_points_fft
+//
+// Batched version of refine_one_point_fft for all the points
+// (mesh vertices, usually) of a pair of tiles. The neighborhoods of
+// a batch of points are extracted first, then their spectra are
+// computed back to back (they are all the same size, so they share
+// one FFT plan), and then each point is matched using the cached
+// spectra.
+//
+// When forward_0 or forward_1 is nullptr the tiles are assumed
+// to be already warped into mosaic space.
+//
+// Returns the number of points with a valid shift.
+//
+template <typename TImage>
+unsigned int
+refine_points_fft(the_log_t & log,
+
+                  // per-point shift and validity flag:
+                  std::vector<vec2d_t> &       shift,
+                  std::vector<unsigned char> & valid,
+
+                  // the large images and their masks:
+                  const TImage * tile_0,
+                  const mask_t * mask_0,
+                  const TImage * tile_1,
+                  const mask_t * mask_1,
+
+                  // transforms from mosaic space to tile space:
+                  const base_transform_t * forward_0,
+                  const base_transform_t * forward_1,
+
+                  // mosaic space neighborhood centers:
+                  const std::vector<pnt2d_t> & center,
+
+                  // minimum acceptable neighborhood overlap ratio:
+                  const double & min_overlap,
+
+                  // neighborhood size and pixel spacing:
+                  const typename TImage::SizeType &    sz,
+                  const typename TImage::SpacingType & sp,
+
+                  // maximum number of neighborhoods extracted at once:
+                  const unsigned int max_batch_size = 64,
+
+                  // optional cache of the tile_1 neighborhoods resampled
+                  // through forward_1, keyed by point index:
+                  neighborhood_cache_t<TImage> * moving_cache = nullptr)
+{
+  const std::size_t num_points = center.size();
+  shift.assign(num_points, vec2d(0, 0));
+  valid.assign(num_points, 0);
+
+  if (num_points == 0)
+  {
+    return 0;
+  }
+
+  const bool tiles_already_warped = (forward_0 == nullptr || forward_1 == nullptr);
+
+  // the points are processed in batches to bound the memory footprint:
+  const std::size_t            batch_size = std::min(num_points, std::size_t(std::max(1u, max_batch_size)));
+  neighborhood_batch_t<TImage> batch(batch_size, sz, sp);
+  std::vector<unsigned char>   extracted(batch_size, 0);
+
+  // the cache is large enough to hold the spectra of the whole batch:
+  const std::size_t spectrum_bytes = sizeof(fft_complex_t) * (sz[0] / 2 + 1) * sz[1];
+  spectrum_cache_t  spectra(2 * batch_size * spectrum_bytes);
+
+  // the larger fixed image neighborhood is only needed
+  // when the tiles have not been warped yet:
+  typename TImage::Pointer img_large;
+  mask_t::Pointer          msk_large;
+  pnt2d_t                  origin_large;
+
+  if (!tiles_already_warped)
+  {
+    typename TImage::SizeType sz_large(sz);
+    sz_large[0] *= 2;
+    sz_large[1] *= 2;
+    img_large = make_image<TImage>(sp, sz_large);
+    msk_large = make_image<mask_t>(sp, sz_large);
+
+    origin_large[0] = sz[0] * sp[0] / 2;
+    origin_large[1] = sz[1] * sp[1] / 2;
+  }
+
+  unsigned int num_valid = 0;
+  for (std::size_t offset = 0; offset < num_points; offset += batch_size)
+  {
+    const std::size_t num_batched = std::min(batch_size, num_points - offset);
+
+    // the neighborhood images are reused from batch to batch,
+    // so the spectra of the previous batch must be discarded:
+    spectra.clear();
+
+    // extract the neighborhoods of all points in the batch:
+    for (std::size_t j = 0; j < num_batched; j++)
+    {
+      const pnt2d_t & pt = center[offset + j];
+      if (tiles_already_warped)
+      {
+        pnt2d_t origin;
+        extracted[j] = refine_one_point_helper<TImage>(tile_0,
+                                                       mask_0,
+                                                       tile_1,
+                                                       mask_1,
+                                                       pt,
+                                                       origin,
+                                                       min_overlap,
+                                                       batch.image(j, 0),
+                                                       batch.mask(j, 0),
+                                                       batch.image(j, 1),
+                                                       batch.mask(j, 1));
+      }
+      else
+      {
+        extracted[j] = refine_one_point_helper<TImage>(tile_0,
+                                                       mask_0,
+                                                       tile_1,
+                                                       mask_1,
+                                                       forward_0,
+                                                       forward_1,
+                                                       pt,
+                                                       min_overlap,
+                                                       sz,
+                                                       sp,
+                                                       nullptr,
+                                                       nullptr,
+                                                       batch.image(j, 0),
+                                                       batch.mask(j, 0),
+                                                       batch.image(j, 1),
+                                                       batch.mask(j, 1),
+                                                       moving_cache,
+                                                       offset + j);
+      }
+    }
+
+    // compute the spectra of all extracted neighborhoods back to back:
+    for (std::size_t j = 0; j < num_batched; j++)
+    {
+      if (!extracted[j])
+        continue;
+
+      padded_spectrum<TImage>(batch.image(j, 0), sz, &spectra);
+      padded_spectrum<TImage>(batch.image(j, 1), sz, &spectra);
+    }
+
+    // match the neighborhoods:
+    for (std::size_t j = 0; j < num_batched; j++)
+    {
+      if (!extracted[j])
+        continue;
+
+      const std::size_t i = offset + j;
+      bool              ok = false;
+      if (tiles_already_warped)
+      {
+        ok = refine_one_point_fft<TImage>(log,
+                                          shift[i],
+                                          pnt2d(0, 0),
+                                          tile_0,
+                                          mask_0,
+                                          batch.image(j, 0),
+                                          batch.mask(j, 0),
+                                          batch.image(j, 1),
+                                          batch.mask(j, 1),
+                                          &spectra);
+      }
+      else
+      {
+        extract_large_neighborhood<TImage>(
+          tile_0, mask_0, forward_0, center[i], sz, sp, img_large.GetPointer(), msk_large.GetPointer());
+
+        ok = refine_one_point_fft<TImage>(log,
+                                          shift[i],
+                                          origin_large,
+                                          img_large.GetPointer(),
+                                          msk_large.GetPointer(),
+                                          batch.image(j, 0),
+                                          batch.mask(j, 0),
+                                          batch.image(j, 1),
+                                          batch.mask(j, 1),
+                                          &spectra);
+      }
+
+      if (ok)
+      {
+        valid[i] = 1;
+        num_valid++;
+      }
+    }
+  }
+
+  return num_valid;
+}
+
+
+//----------------------------------------------------------------
+// ncc_translation_t
+//
+// A translation-only normalized cross correlation optimizer for small
+// neighborhoods. The neighborhoods are copied into a workspace whose
+// buffers are reused, so once the workspace has grown to the largest
+// neighborhood no memory is allocated. The metric is the negative
+// normalized cross correlation of the fixed pixels and the bilinearly
+// interpolated moving pixels, the translation maps from the fixed to
+// the moving image space. Larger misalignments are captured by first
+// optimizing over 2x2 box-downsampled copies of the neighborhoods:
+//
+class ncc_translation_t
+{
+public:
+  // copy the fixed/moving image pixels within a given region,
+  // along with the mask (a null mask selects every pixel):
+  template <typename TImage>
+  void
+  set_fixed(const TImage * image, const mask_t * mask, const typename TImage::RegionType & region)
+  {
+    load<TImage>(fixed_, image, mask, region);
+  }
+
+  template <typename TImage>
+  void
+  set_fixed(const TImage * image, const mask_t * mask)
+  {
+    load<TImage>(fixed_, image, mask, image->GetLargestPossibleRegion());
+  }
+
+  template <typename TImage>
+  void
+  set_moving(const TImage * image, const mask_t * mask, const typename TImage::RegionType & region)
+  {
+    load<TImage>(moving_, image, mask, region);
+  }
+
+  template <typename TImage>
+  void
+  set_moving(const TImage * image, const mask_t * mask)
+  {
+    load<TImage>(moving_, image, mask, image->GetLargestPossibleRegion());
+  }
+
+  // evaluate the metric and its derivative with respect to the
+  // translation, returns std::numeric_limits<double>::max() if the
+  // metric is undefined (not enough overlap, or no contrast):
+  double
+  eval(const vec2d_t & t, vec2d_t & dmdt) const;
+
+  // minimize the metric by regular step gradient descent, starting
+  // at the given translation; only improving steps are taken, so the
+  // translation is left unchanged if the metric can not be improved.
+  // With several pyramid levels the descent runs coarse to fine, each
+  // level halving the resolution of the next finer one, while the
+  // neighborhoods are large enough. Returns the metric at the final
+  // translation, evaluated at full resolution:
+  double
+  optimize(vec2d_t &          t,
+           const unsigned int iterations,
+           const double       min_step,
+           const double       max_step,
+           const unsigned int pyramid_levels = 1,
+           const unsigned int pick_up_pace_steps = 5);
+
+private:
+  //----------------------------------------------------------------
+  // buffer_t
+  //
+  class buffer_t
+  {
+  public:
+    buffer_t()
+      : w_(0)
+      , h_(0)
+      , x0_(0.0)
+      , y0_(0.0)
+      , sx_(1.0)
+      , sy_(1.0)
+    {}
+
+    // buffer size, position of the first pixel and pixel spacing:
+    unsigned int w_;
+    unsigned int h_;
+    double       x0_;
+    double       y0_;
+    double       sx_;
+    double       sy_;
+
+    // pixels and mask, row major:
+    std::vector<float>         data_;
+    std::vector<unsigned char> mask_;
+  };
+
+  template <typename TImage>
+  static void
+  load(buffer_t & buffer, const TImage * image, const mask_t * mask, const typename TImage::RegionType & region)
+  {
+    typename TImage::RegionType roi = region;
+    if (!roi.Crop(image->GetLargestPossibleRegion()))
+    {
+      roi.SetSize(typename TImage::SizeType());
+    }
+
+    const typename TImage::IndexType & origin = roi.GetIndex();
+    typename TImage::PointType         point;
+    image->TransformIndexToPhysicalPoint(origin, point);
+
+    const typename TImage::SpacingType & sp = image->GetSpacing();
+    buffer.w_ = roi.GetSize()[0];
+    buffer.h_ = roi.GetSize()[1];
+    buffer.x0_ = point[0];
+    buffer.y0_ = point[1];
+    buffer.sx_ = sp[0];
+    buffer.sy_ = sp[1];
+    buffer.data_.resize(buffer.w_ * buffer.h_);
+    buffer.mask_.resize(buffer.w_ * buffer.h_);
+
+    // the mask may have a different resolution than the image:
+    const bool same_size =
+      mask && mask->GetLargestPossibleRegion().GetSize() == image->GetLargestPossibleRegion().GetSize();
+
+    typename TImage::IndexType index;
+    unsigned int               i = 0;
+    for (unsigned int y = 0; y < buffer.h_; y++)
+    {
+      index[1] = origin[1] + y;
+      for (unsigned int x = 0; x < buffer.w_; x++, i++)
+      {
+        index[0] = origin[0] + x;
+        buffer.data_[i] = float(image->GetPixel(index));
+
+        if (!mask)
+        {
+          buffer.mask_[i] = 1;
+        }
+        else if (same_size)
+        {
+          buffer.mask_[i] = mask->GetPixel(index) != 0;
+        }
+        else
+        {
+          image->TransformIndexToPhysicalPoint(index, point);
+          buffer.mask_[i] = pixel_in_mask(mask, point);
+        }
+      }
+    }
+  }
+
+  // 2x2 box filter, a coarse pixel is masked out
+  // unless all four of its fine pixels are selected:
+  static void
+  downsample(const buffer_t & fine, buffer_t & coarse);
+
+  // the metric and the gradient descent over one pyramid level:
+  static double
+  eval(const buffer_t & f, const buffer_t & m, const vec2d_t & t, vec2d_t & dmdt);
+
+  static double
+  descend(const buffer_t &   f,
+          const buffer_t &   m,
+          vec2d_t &          t,
+          const unsigned int iterations,
+          const double       min_step,
+          const double       first_step,
+          const double       max_step,
+          const unsigned int pick_up_pace_steps);
+
+  buffer_t fixed_;
+  buffer_t moving_;
+
+  // the coarse pyramid levels, finest first:
+  std::vector<buffer_t> fixed_pyramid_;
+  std::vector<buffer_t> moving_pyramid_;
+};
+
+//----------------------------------------------------------------
+// ncc_translation_workspace
+//
+// A workspace private to the calling thread:
+//
+extern ncc_translation_t &
+ncc_translation_workspace();
+
+
 //----------------------------------------------------------------
 // refine_one_pair
 //
@@ -1447,22 +2026,44 @@ refine_one_point_nofft(the_log_t & log,
                        const TImage * img_1,
                        const mask_t * msk_1)
 {
-  // feed the two neighborhoods into the optimizer translation estimator:
-  translate_transform_t::Pointer translate = translate_transform_t::New();
-  vec2d_t                        offset = vec2d(origin[0], origin[1]);
-  translate->SetOffset(-offset);
-
-  double metric = refine_one_pair<translate_transform_t, TImage>(translate,
-                                                                 tile_0,
-                                                                 mask_0,
-                                                                 img_1,
-                                                                 msk_1,
-                                                                 3,     // number of pyramid levels
-                                                                 100,   // number of iterations
-                                                                 1e-8,  // min step
-                                                                 1e+4); // max step
-
-  shift = -(translate->GetOffset() + offset);
+  vec2d_t offset = vec2d(origin[0], origin[1]);
+
+  // only the fixed tile pixels within one neighborhood size
+  // of the moving neighborhood can overlap it:
+  const typename TImage::SpacingType & sp = img_1->GetSpacing();
+  const typename TImage::SizeType &    sz = img_1->GetLargestPossibleRegion().GetSize();
+
+  pnt2d_t corner[] = { origin, origin };
+  for (unsigned int j = 0; j < 2; j++)
+  {
+    corner[0][j] -= double(sz[j]) * sp[j];
+    corner[1][j] += 2.0 * double(sz[j]) * sp[j];
+  }
+
+  typename TImage::IndexType corner_index[2];
+  tile_0->TransformPhysicalPointToIndex(corner[0], corner_index[0]);
+  tile_0->TransformPhysicalPointToIndex(corner[1], corner_index[1]);
+
+  typename TImage::SizeType roi_size;
+  for (unsigned int j = 0; j < 2; j++)
+  {
+    roi_size[j] = std::max<long>(0, corner_index[1][j] - corner_index[0][j] + 1);
+  }
+  typename TImage::RegionType roi(corner_index[0], roi_size);
+
+  // feed the two neighborhoods into the translation optimizer:
+  ncc_translation_t & ncc = ncc_translation_workspace();
+  ncc.set_fixed<TImage>(tile_0, mask_0, roi);
+  ncc.set_moving<TImage>(img_1, msk_1);
+
+  vec2d_t      t = -offset;
+  const double metric = ncc.optimize(t,
+                                     100,  // number of iterations
+                                     1e-8, // min step
+                                     1e+4, // max step
+                                     3);   // pyramid levels
+
+  shift = -(t + offset);
   log << "shift: " << shift << endl;
 
 #ifdef DEBUG_REFINE_ONE_POINT
@@ -1485,7 +2086,11 @@ refine_one_point_nofft(the_log_t & log,
   }
 
 #ifdef DEBUG_REFINE_ONE_POINT
-  save_composite(fn_save + suffix + "-b.png", tile_0, img_1, translate.GetPointer(), true);
+  {
+    translate_transform_t::Pointer translate = translate_transform_t::New();
+    translate->SetOffset(t);
+    save_composite(fn_save + suffix + "-b.png", tile_0, img_1, translate.GetPointer(), true);
+  }
 #endif // DEBUG_REFINE_ONE_POINT
 
   return true;
@@ -1528,19 +2133,17 @@ refine_one_point_nofft(vec2d_t &       shift,
     return false;
   }
 
-  // feed the two neighborhoods into the optimizer translation estimator:
-  translate_transform_t::Pointer translate = translate_transform_t::New();
-  translate->SetIdentity();
+  // feed the two neighborhoods into the translation optimizer:
+  ncc_translation_t & ncc = ncc_translation_workspace();
+  ncc.set_fixed<TImage>(img_0, msk_0);
+  ncc.set_moving<TImage>(img_1, msk_1);
 
-  double metric = refine_one_pair<translate_transform_t, TImage>(translate,
-                                                                 img_0,
-                                                                 msk_0,
-                                                                 img_1,
-                                                                 msk_1,
-                                                                 3,     // number of pyramid levels
-                                                                 100,   // number of iterations
-                                                                 1e-8,  // min step
-                                                                 1e+4); // max step
+  vec2d_t      t = vec2d(0, 0);
+  const double metric = ncc.optimize(t,
+                                     100,  // number of iterations
+                                     1e-8, // min step
+                                     1e+4, // max step
+                                     3);   // pyramid levels
 
 #ifdef DEBUG_REFINE_ONE_POINT
   static const the_text_t fn_save("/tmp/refine_one_point_nofft-");
@@ -1559,10 +2162,15 @@ refine_one_point_nofft(vec2d_t &       shift,
   }
 
 #ifdef DEBUG_REFINE_ONE_POINT
-  save_composite(fn_save + suffix + "-b.png", img_0.GetPointer(), img_1.GetPointer(), translate.GetPointer(), true);
+  {
+    translate_transform_t::Pointer translate = translate_transform_t::New();
+    translate->SetOffset(t);
+    save_composite(
+      fn_save + suffix + "-b.png", img_0.GetPointer(), img_1.GetPointer(), translate.GetPointer(), true);
+  }
 #endif // DEBUG_REFINE_ONE_POINT
 
-  shift = -translate->GetOffset();
+  shift = -t;
   return true;
 }
 
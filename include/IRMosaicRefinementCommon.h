@@ -34,10 +34,10 @@
 #include <IRGridCommon.h>
 #include <itkImageMosaicVarianceMetric.h>
 #include <itkRegularStepGradientDescentOptimizer2.h>
-#include <IRAABBox.h>
 #include <IRThreadPool.h>
 
 #include "itkImageDuplicator.h"
+#include "itkTimeProbe.h"
 
 // system includes:
 #include <math.h>
@@ -66,6 +66,65 @@ regularize_displacements( // computed displacement vectors of the moving image
   const unsigned int & median_radius);
 
 
+//----------------------------------------------------------------
+// tile_pair_t
+//
+// An unordered pair of overlapping tiles. The neighborhoods are
+// sampled at the mesh vertices of the first tile, the second
+// tile reuses the same matches with the opposite sign:
+//
+class tile_pair_t
+{
+public:
+  // the sampled tile and its neighbor:
+  unsigned int tile_[2];
+
+  // index of the other tile in the neighbor list of each tile,
+  // ~0 if the tile mesh is not refined:
+  unsigned int slot_[2];
+};
+
+//----------------------------------------------------------------
+// find_tile_pairs
+//
+// collapse the (symmetric) neighbor lists into a list of
+// unordered pairs, so that each overlap is matched only once:
+//
+extern void
+find_tile_pairs(const std::vector<the_dynamic_array_t<unsigned int>> & neighbors, std::vector<tile_pair_t> & pairs);
+
+//----------------------------------------------------------------
+// find_active_tile_pairs
+//
+// select the pairs with at least one active tile, the active
+// tile of the pair is sampled, the inactive tile is not updated:
+//
+extern void
+find_active_tile_pairs(const std::vector<tile_pair_t> & pairs,
+                       const std::vector<bool> &        active,
+                       std::vector<tile_pair_t> &       active_pairs);
+
+//----------------------------------------------------------------
+// scatter_pair_displacements
+//
+// scatter the opposite of the displacements measured at the
+// mosaic space sample points onto the neighbor tile mesh, via the
+// barycentric coordinates of the samples within the neighbor mesh
+// triangles. The vertex weight is the accumulated barycentric
+// weight clamped to 1 -- vertices supported by less than
+// min_weight are left for regularize_displacements to fill in:
+//
+extern void
+scatter_pair_displacements(const the_grid_transform_t &       gt,
+                           const std::vector<pnt2d_t> &       center,
+                           const std::vector<vec2d_t> &       shift,
+                           const std::vector<unsigned char> & valid,
+                           const image_t::Pointer &           dx,
+                           const image_t::Pointer &           dy,
+                           const image_t::Pointer &           db,
+                           const double                       min_weight = 0.25);
+
+
 //----------------------------------------------------------------
 // refine_mosaic
 //
@@ -78,7 +137,24 @@ refine_mosaic(the_log_t & log,
               std::vector<typename TMask::ConstPointer> & mask,
               std::vector<base_transform_t::Pointer> &    transform,
 
-              unsigned int iterations_per_level)
+              unsigned int iterations_per_level,
+
+              // optimize on a stratified random subset of this many
+              // overlap pixels, 0 to use every pixel; the metric before and
+              // after each optimization is always evaluated on every pixel:
+              const unsigned int num_samples = 0,
+
+              // draw new samples for every optimizer iteration,
+              // otherwise keep the same samples for each pyramid level:
+              const bool resample_per_iteration = true,
+
+              const unsigned int sample_seed = 0,
+
+              // gradients and interpolators of the pyramid tiles, calculated
+              // as needed; pass the same cache to reuse them when refining
+              // the same pyramid again:
+              typename itk::ImageMosaicVarianceMetric<TImage, itk::LinearInterpolateImageFunction<TImage, double>>::
+                image_cache_ptr_t image_cache = nullptr)
 {
   typedef itk::LinearInterpolateImageFunction<TImage, double> interpolator_t;
 
@@ -98,6 +174,11 @@ refine_mosaic(the_log_t & log,
   typedef itk::ImageMosaicVarianceMetric<TImage, interpolator_t> mosaic_metric_t;
 
   typename mosaic_metric_t::Pointer mosaic_metric = mosaic_metric_t::New();
+  if (image_cache)
+  {
+    mosaic_metric->image_cache_ = image_cache;
+  }
+
   mosaic_metric->image_.resize(num_images);
   mosaic_metric->mask_.resize(num_images);
   mosaic_metric->transform_.resize(num_images);
@@ -116,6 +197,10 @@ refine_mosaic(the_log_t & log,
   mosaic_metric->setup_param_map(param_shared, param_active);
   mosaic_metric->Initialize();
 
+  mosaic_metric->num_samples_ = num_samples;
+  mosaic_metric->sample_seed_ = sample_seed;
+  mosaic_metric->resample_per_iteration_ = resample_per_iteration;
+
   // setup the optimizer scales:
   typename mosaic_metric_t::params_t parameter_scales = mosaic_metric->GetTransformParameters();
   parameter_scales.Fill(1.0);
@@ -126,9 +211,14 @@ refine_mosaic(the_log_t & log,
     {
       mosaic_metric->image_[i] = pyramid[level][i];
     }
+    mosaic_metric->update_image_cache();
+    mosaic_metric->reset_samples();
+
+    log << "level " << level << ": " << mosaic_metric->image_cache_->size() << " cached gradient images, "
+        << mosaic_metric->image_cache_->size_in_bytes() / (1 << 20) << " MB" << endl;
 
     typename mosaic_metric_t::measure_t metric_before =
-      mosaic_metric->GetValue(mosaic_metric->GetTransformParameters());
+      mosaic_metric->GetFullResolutionValue(mosaic_metric->GetTransformParameters());
 
     // run several iterations of the optimizer:
     for (unsigned int k = 0; k < 3; k++)
@@ -170,7 +260,8 @@ refine_mosaic(the_log_t & log,
       }
 
       mosaic_metric->SetTransformParameters(optimizer->GetBestParams());
-      metric_after = optimizer->GetBestValue();
+      metric_after = (num_samples == 0) ? optimizer->GetBestValue()
+                                        : mosaic_metric->GetFullResolutionValue(optimizer->GetBestParams());
 
       typename mosaic_metric_t::params_t params_after = mosaic_metric->GetTransformParameters();
 
@@ -262,10 +353,6 @@ calc_displacements(the_log_t & log,
   sz[0] = neighborhood;
   sz[1] = neighborhood;
 
-  typename TImage::Pointer img[] = { make_image<TImage>(sp, sz), make_image<TImage>(sp, sz) };
-
-  typename TMask::Pointer msk[] = { make_image<TMask>(sp, sz), make_image<TMask>(sp, sz) };
-
   // for each interpolation point, do a local neighborhood fft matching,
   // and use the resulting displacement vector to adjust the mesh:
   image_t::Pointer dx = make_image<image_t>(mesh_cols, mesh_rows, 1.0, 0.0);
@@ -274,99 +361,184 @@ calc_displacements(the_log_t & log,
 
   image_t::Pointer db = make_image<image_t>(mesh_cols, mesh_rows, 1.0, 0.0);
 
-  typename TImage::Pointer img_large;
-  typename TMask::Pointer  msk_large;
-
-  if (!tiles_already_warped)
+  // find the mosaic space coordinates of the vertices:
+  std::vector<pnt2d_t> center(mesh_size);
+  for (unsigned int i = 0; i < mesh_size; i++)
   {
-    typename TImage::SizeType sz_large(sz);
-    sz_large[0] *= 2;
-    sz_large[1] *= 2;
-    img_large = make_image<TImage>(sp, sz_large);
-    msk_large = make_image<TMask>(sp, sz_large);
+    gt.transform_inv(gt.grid_.mesh_[i].uv_, center[i]);
   }
 
+  // feed the neighborhoods of all vertices into the FFT translation estimator:
+  std::vector<vec2d_t>       shift;
+  std::vector<unsigned char> valid;
+
   log << "- - - - - - - - - - - - - - - - - - - - - - - - - - - - - -" << endl;
-#pragma omp parallel for
-  for (int i = 0; i < (int)mesh_size; i++)
+  refine_points_fft<TImage>(log,
+                            shift,
+                            valid,
+                            tile_0,
+                            mask_0,
+                            tile_1,
+                            mask_1,
+                            tiles_already_warped ? nullptr : forward_0,
+                            tiles_already_warped ? nullptr : forward_1,
+                            center,
+                            min_overlap,
+                            sz,
+                            sp);
+
+  for (unsigned int i = 0; i < mesh_size; i++)
   {
-    // shortcut:
-    const vertex_t & vertex = gt.grid_.mesh_[i];
-
-    // find the mosaic space coordinates of this vertex:
-    pnt2d_t center;
-    gt.transform_inv(vertex.uv_, center);
+    if (!valid[i])
+    {
+      continue;
+    }
 
-    // extract a neighborhood of the vertex from both tiles:
     image_t::IndexType index;
     index[0] = i % mesh_cols;
     index[1] = i / mesh_cols;
-    dx->SetPixel(index, 0);
-    dy->SetPixel(index, 0);
-    db->SetPixel(index, 0);
 
-    // feed the two neighborhoods into the FFT translation estimator:
-    vec2d_t shift(vec2d(0, 0));
-    bool    ok = tiles_already_warped ?
+    log << i << ". shift: " << shift[i] << endl;
+    dx->SetPixel(index, shift[i][0]);
+    dy->SetPixel(index, shift[i][1]);
+    db->SetPixel(index, 1);
+  }
 
-                                      refine_one_point_fft(log,
-                                                        shift,
+  // regularize the displacement vectors here:
+  regularize_displacements(xy_shift, mass, dx, dy, db, median_radius);
+}
 
-                                                        tile_0,
-                                                        mask_0,
 
-                                                        tile_1,
-                                                        mask_1,
+//----------------------------------------------------------------
+// calc_pair_displacements
+//
+// Match a pair of overlapping tiles once, at the mosaic space
+// coordinates of the mesh vertices of the sampled tile, and use
+// the result for both tiles -- the displacement of the neighbor
+// is the opposite of the displacement of the sampled tile, and
+// it is scattered onto the neighbor mesh via the barycentric
+// coordinates of the samples within the neighbor mesh triangles.
+//
+// The neighbor displacement images may be null when the neighbor
+// mesh is not refined (the first tile is kept fixed, for example).
+//
+// When the tiles are not warped into mosaic space the neighborhoods
+// are resampled through the transforms, the optional cache keeps
+// the resampled sampled-tile neighborhoods for the next neighbor.
+//
+// Returns the number of samples with a valid displacement.
+//
+template <typename TImage, typename TMask>
+unsigned int
+calc_pair_displacements( // a flag indicating whether the tiles
+                         // have already been transformed into mosaic space:
+  bool tiles_already_warped,
 
-                                                        center,
-                                                        min_overlap,
+  // sampled:
+  const TImage *             tile_0,
+  const TMask *              mask_0,
+  const itk::GridTransform * forward_0,
 
-                                                        img[0].GetPointer(),
-                                                        msk[0].GetPointer(),
+  // neighbor:
+  const TImage *             tile_1,
+  const TMask *              mask_1,
+  const itk::GridTransform * forward_1,
 
-                                                        img[1].GetPointer(),
-                                                        msk[1].GetPointer())
-                                      :
+  // neighborhood size:
+  const unsigned int & neighborhood,
 
-                                      refine_one_point_fft(log,
-                                                        shift,
+  // minimum acceptable neighborhood overlap ratio:
+  const double & min_overlap,
 
-                                                        tile_0,
-                                                        mask_0,
+  // sampled tile mesh node displacements and weights:
+  const image_t::Pointer & dx_0,
+  const image_t::Pointer & dy_0,
+  const image_t::Pointer & db_0,
 
-                                                        tile_1,
-                                                        mask_1,
+  // neighbor tile mesh node displacements and weights:
+  const image_t::Pointer & dx_1,
+  const image_t::Pointer & dy_1,
+  const image_t::Pointer & db_1,
 
-                                                        forward_0,
-                                                        forward_1,
+  // sampled tile neighborhoods resampled through forward_0:
+  neighborhood_cache_t<TImage> * cache_0 = nullptr)
+{
+  // make sure both tiles have the same pixel spacing:
+  typename TImage::SpacingType sp = tile_0->GetSpacing();
+  if (sp != tile_1->GetSpacing())
+    return 0;
 
-                                                        center,
-                                                        min_overlap,
+  // setup the local neighborhood:
+  typename TImage::SizeType sz;
+  sz[0] = neighborhood;
+  sz[1] = neighborhood;
 
-                                                        sz,
-                                                        sp,
+  // shortcuts:
+  const the_grid_transform_t & gt_0 = forward_0->transform_;
+  const unsigned int           mesh_cols_0 = gt_0.cols_ + 1;
+  const unsigned int           mesh_size_0 = gt_0.grid_.mesh_.size();
 
-                                                        img_large.GetPointer(),
-                                                        msk_large.GetPointer(),
+  // the sampled mesh vertices in mosaic space:
+  std::vector<pnt2d_t> center(mesh_size_0);
+  for (unsigned int i = 0; i < mesh_size_0; i++)
+  {
+    gt_0.transform_inv(gt_0.grid_.mesh_[i].uv_, center[i]);
+  }
 
-                                                        img[0].GetPointer(),
-                                                        msk[0].GetPointer(),
+  std::vector<vec2d_t>       shift;
+  std::vector<unsigned char> valid;
 
-                                                        img[1].GetPointer(),
-                                                        msk[1].GetPointer());
-    if (!ok)
+  // match the neighborhoods of all the samples:
+  const unsigned int num_valid = refine_points_fft<TImage>(*null_log(),
+                                                           shift,
+                                                           valid,
+
+                                                           // fixed:
+                                                           tile_1,
+                                                           mask_1,
+
+                                                           // moving:
+                                                           tile_0,
+                                                           mask_0,
+
+                                                           tiles_already_warped ? nullptr : forward_1,
+                                                           tiles_already_warped ? nullptr : forward_0,
+
+                                                           center,
+                                                           min_overlap,
+                                                           sz,
+                                                           sp,
+                                                           64,
+                                                           cache_0);
+
+  dx_0->FillBuffer(0);
+  dy_0->FillBuffer(0);
+  db_0->FillBuffer(0);
+
+  for (unsigned int i = 0; i < mesh_size_0; i++)
+  {
+    if (!valid[i])
     {
       continue;
     }
 
-    log << i << ". shift: " << shift << endl;
-    dx->SetPixel(index, shift[0]);
-    dy->SetPixel(index, shift[1]);
-    db->SetPixel(index, 1);
+    image_t::IndexType index;
+    index[0] = i % mesh_cols_0;
+    index[1] = i / mesh_cols_0;
+    dx_0->SetPixel(index, shift[i][0]);
+    dy_0->SetPixel(index, shift[i][1]);
+    db_0->SetPixel(index, 1);
   }
 
-  // regularize the displacement vectors here:
-  regularize_displacements(xy_shift, mass, dx, dy, db, median_radius);
+  if (dx_1.GetPointer() == nullptr)
+  {
+    return num_valid;
+  }
+
+  // scatter the opposite displacements onto the neighbor mesh:
+  scatter_pair_displacements(forward_1->transform_, center, shift, valid, dx_1, dy_1, db_1);
+
+  return num_valid;
 }
 
 
@@ -454,84 +626,34 @@ public:
   {
     WRAP(the_terminator_t terminator("calc_displacements_t"));
 
-    typename TImage::Pointer img[] = { make_image<TImage>(sp_, sz_), make_image<TImage>(sp_, sz_) };
-
-    typename TMask::Pointer msk[] = { make_image<TMask>(sp_, sz_), make_image<TMask>(sp_, sz_) };
-
-    typename TImage::Pointer img_large;
-    typename TMask::Pointer  msk_large;
-
-    if (!tiles_already_warped_)
-    {
-      typename TImage::SizeType sz_large(sz_);
-      sz_large[0] *= 2;
-      sz_large[1] *= 2;
-      img_large = make_image<TImage>(sp_, sz_large);
-      msk_large = make_image<TMask>(sp_, sz_large);
-    }
+    // feed the neighborhoods of all nodes into the FFT translation estimator:
+    std::vector<vec2d_t>       shift;
+    std::vector<unsigned char> valid;
+
+    refine_points_fft<TImage>(*null_log(),
+                              shift,
+                              valid,
+                              tile_0_,
+                              mask_0_,
+                              tile_1_,
+                              mask_1_,
+                              // if the tiles are already warped we don't
+                              // need the transforms:
+                              tiles_already_warped_ ? nullptr : forward_0_,
+                              tiles_already_warped_ ? nullptr : forward_1_,
+                              center_,
+                              min_overlap_,
+                              sz_,
+                              sp_);
 
     std::size_t num_nodes = center_.size();
     for (std::size_t i = 0; i < num_nodes; i++)
     {
-      // shortcuts:
-      const image_t::IndexType & index = index_[i];
-      const pnt2d_t &            center = center_[i];
-
-      // feed the two neighborhoods into the FFT translation estimator:
-      vec2d_t shift(vec2d(0, 0));
-
-      bool ok = tiles_already_warped_ ?
-                                      // if the tiles are already warped we don't
-                                      // need the transforms
-                  refine_one_point_fft(*null_log(),
-                                       shift,
-
-                                       tile_0_,
-                                       mask_0_,
-
-                                       tile_1_,
-                                       mask_1_,
-
-                                       center,
-                                       min_overlap_,
-
-                                       img[0].GetPointer(),
-                                       msk[0].GetPointer(),
-
-                                       img[1].GetPointer(),
-                                       msk[1].GetPointer())
-                                      :
-
-                                      refine_one_point_fft(*null_log(),
-                                                           shift,
-
-                                                           tile_0_,
-                                                           mask_0_,
-
-                                                           tile_1_,
-                                                           mask_1_,
-
-                                                           forward_0_,
-                                                           forward_1_,
-
-                                                           center,
-                                                           min_overlap_,
-
-                                                           sz_,
-                                                           sp_,
-
-                                                           img_large.GetPointer(),
-                                                           msk_large.GetPointer(),
-
-                                                           img[0].GetPointer(),
-                                                           msk[0].GetPointer(),
-
-                                                           img[1].GetPointer(),
-                                                           msk[1].GetPointer());
-      if (ok)
+      if (valid[i])
       {
-        dx_->SetPixel(index, shift[0]);
-        dy_->SetPixel(index, shift[1]);
+        const image_t::IndexType & index = index_[i];
+        dx_->SetPixel(index, shift[i][0]);
+        dy_->SetPixel(index, shift[i][1]);
         db_->SetPixel(index, 1);
       }
     }
@@ -633,22 +755,24 @@ calc_displacements_mt(unsigned int num_threads,
 
   the_thread_pool_t thread_pool(num_threads);
   thread_pool.set_idle_sleep_duration(50); // 50 usec
+  thread_pool.set_work_stealing(true);
 
-  // split nodes between threads:
-  std::vector<std::list<image_t::IndexType>> node_index_list(num_threads);
-  std::vector<std::list<pnt2d_t>>            node_center_list(num_threads);
+  // split nodes into several chunks per thread, so that threads
+  // that finish early can steal the chunks of the slower threads:
+  const unsigned int num_chunks = std::max(1u, std::min(mesh_size, num_threads * 8));
+  std::vector<std::list<image_t::IndexType>> node_index_list(num_chunks);
+  std::vector<std::list<pnt2d_t>>            node_center_list(num_chunks);
 
-#pragma omp parallel for
-  for (int i = 0; i < mesh_size; i++)
+  for (unsigned int i = 0; i < mesh_size; i++)
   {
     // shortcuts:
     const vertex_t &   vertex = gt.grid_.mesh_[i];
-    const unsigned int which_thread = i % num_threads;
+    const unsigned int which_chunk = i % num_chunks;
 
     // find the mosaic space coordinates of this vertex:
     pnt2d_t center;
     gt.transform_inv(vertex.uv_, center);
-    node_center_list[which_thread].push_back(center);
+    node_center_list[which_chunk].push_back(center);
 
     // extract a neighborhood of the vertex from both tiles:
     image_t::IndexType index;
@@ -658,12 +782,17 @@ calc_displacements_mt(unsigned int num_threads,
     dy->SetPixel(index, 0);
     db->SetPixel(index, 0);
 
-    node_index_list[which_thread].push_back(index);
+    node_index_list[which_chunk].push_back(index);
   }
 
-  // setup a transaction for each thread:
-  for (unsigned int i = 0; i < num_threads; i++)
+  // setup a transaction for each chunk:
+  for (unsigned int i = 0; i < num_chunks; i++)
   {
+    if (node_index_list[i].empty())
+    {
+      continue;
+    }
+
     calc_displacements_t<TImage, TMask> * t = new calc_displacements_t<TImage, TMask>(tiles_already_warped,
 
                                                                                       tile_0,
@@ -808,22 +937,6 @@ public:
     sz[0] = neighborhood_;
     sz[1] = neighborhood_;
 
-    typename TImage::Pointer img[] = { make_image<TImage>(sp, sz), make_image<TImage>(sp, sz) };
-
-    typename TMask::Pointer msk[] = { make_image<TMask>(sp, sz), make_image<TMask>(sp, sz) };
-
-    typename TImage::Pointer img_large;
-    typename TMask::Pointer  msk_large;
-
-    if (!tiles_already_warped_)
-    {
-      typename TImage::SizeType sz_large(sz);
-      sz_large[0] *= 2;
-      sz_large[1] *= 2;
-      img_large = make_image<TImage>(sp, sz_large);
-      msk_large = make_image<TMask>(sp, sz_large);
-    }
-
     for (unsigned int tile_index = start; tile_index < num_tiles; tile_index++)
     {
       // shortcuts:
@@ -856,83 +969,65 @@ public:
         const TMask *            neighbor_mask = warped_mask_[neighbor_index];
         const base_transform_t * neighbor_xform = transform_[neighbor_index];
 
-        for (unsigned int mesh_index = thread_offset_; mesh_index < mesh_size; mesh_index += thread_stride_)
+        // find the mosaic space coordinates of the vertices
+        // handled by this thread:
+        std::vector<unsigned int> mesh_index;
+        std::vector<pnt2d_t>      center;
+        for (unsigned int i = thread_offset_; i < mesh_size; i += thread_stride_)
         {
           // shortcut:
-          const vertex_t & vertex = gt.grid_.mesh_[mesh_index];
+          const vertex_t & vertex = gt.grid_.mesh_[i];
 
-          // find the mosaic space coordinates of this vertex:
-          pnt2d_t center;
-          gt.transform_inv(vertex.uv_, center);
+          pnt2d_t pt;
+          gt.transform_inv(vertex.uv_, pt);
+          mesh_index.push_back(i);
+          center.push_back(pt);
 
-          // extract a neighborhood of the vertex from both tiles:
           image_t::IndexType index;
-          index[0] = mesh_index % mesh_cols;
-          index[1] = mesh_index / mesh_cols;
+          index[0] = i % mesh_cols;
+          index[1] = i / mesh_cols;
           dx->SetPixel(index, 0);
           dy->SetPixel(index, 0);
           db->SetPixel(index, 0);
+        }
 
-          // feed the two neighborhoods into the FFT translation estimator:
-          vec2d_t shift(vec2d(0, 0));
-          bool    ok = tiles_already_warped_ ?
-
-                                             refine_one_point_fft(*null_log(),
-                                                               shift,
-
-                                                               // fixed:
-                                                               neighbor_tile,
-                                                               neighbor_mask,
-
-                                                               // moving:
-                                                               tile,
-                                                               mask,
-
-                                                               center,
-                                                               minimum_overlap_,
-
-                                                               img[0].GetPointer(),
-                                                               msk[0].GetPointer(),
-
-                                                               img[1].GetPointer(),
-                                                               msk[1].GetPointer())
-                                             :
-
-                                             refine_one_point_fft(*null_log(),
-                                                               shift,
-
-                                                               // fixed:
-                                                               neighbor_tile,
-                                                               neighbor_mask,
+        // feed the neighborhoods of all vertices into the FFT translation estimator:
+        std::vector<vec2d_t>       shift;
+        std::vector<unsigned char> valid;
 
-                                                               // moving:
-                                                               tile,
-                                                               mask,
+        refine_points_fft<TImage>(*null_log(),
+                                  shift,
+                                  valid,
 
-                                                               neighbor_xform,
-                                                               transform,
+                                  // fixed:
+                                  neighbor_tile,
+                                  neighbor_mask,
 
-                                                               center,
-                                                               minimum_overlap_,
+                                  // moving:
+                                  tile,
+                                  mask,
 
-                                                               sz,
-                                                               sp,
+                                  tiles_already_warped_ ? nullptr : neighbor_xform,
+                                  tiles_already_warped_ ? nullptr : transform,
 
-                                                               img_large.GetPointer(),
-                                                               msk_large.GetPointer(),
+                                  center,
+                                  minimum_overlap_,
 
-                                                               img[0].GetPointer(),
-                                                               msk[0].GetPointer(),
+                                  sz,
+                                  sp);
 
-                                                               img[1].GetPointer(),
-                                                               msk[1].GetPointer());
-          if (!ok)
+        for (std::size_t i = 0; i < mesh_index.size(); i++)
+        {
+          if (!valid[i])
           {
             continue;
           }
 
-          dx->SetPixel(index, shift[0]);
-          dy->SetPixel(index, shift[1]);
+          image_t::IndexType index;
+          index[0] = mesh_index[i] % mesh_cols;
+          index[1] = mesh_index[i] / mesh_cols;
+          dx->SetPixel(index, shift[i][0]);
+          dy->SetPixel(index, shift[i][1]);
           db->SetPixel(index, 1);
         }
       }
@@ -965,13 +1060,15 @@ public:
                      bool                                       keep_first_tile_fixed,
                      unsigned int                               median_filter_radius,
                      std::vector<itk::GridTransform::Pointer> & transform,
-                     std::vector<intermediate_result_t> &       results)
+                     std::vector<intermediate_result_t> &       results,
+                     std::vector<std::vector<vec2d_t>> *        shift = nullptr)
     : log_(log)
     , tile_index_(tile_index)
     , keep_first_tile_fixed_(keep_first_tile_fixed)
     , median_filter_radius_(median_filter_radius)
     , transform_(transform)
     , results_(results)
+    , shift_(shift)
   {}
 
   // virtual:
@@ -1026,6 +1123,11 @@ public:
 
     gt.grid_.update(&(shift[0]));
     transform->setup(gt);
+
+    if (shift_ != nullptr)
+    {
+      (*shift_)[tile_index_] = shift;
+    }
   }
 
   the_log_t &                                log_;
@@ -1034,6 +1136,137 @@ public:
   const unsigned int                         median_filter_radius_;
   std::vector<itk::GridTransform::Pointer> & transform_;
   std::vector<intermediate_result_t> &       results_;
+
+  // optional, the mesh vertex displacements of each tile:
+  std::vector<std::vector<vec2d_t>> * shift_;
+};
+
+
+//----------------------------------------------------------------
+// refine_tile_pair
+//
+// calculate the intermediate mesh refinement results
+// of both tiles of an overlapping pair:
+//
+template <typename TImage, typename TMask>
+void
+refine_tile_pair(const tile_pair_t &                                pair,
+                 const std::vector<itk::GridTransform::Pointer> &   transform,
+                 const std::vector<typename TImage::ConstPointer> & tile,
+                 const std::vector<typename TMask::ConstPointer> &  mask,
+                 const bool &                                       tiles_already_warped,
+                 const unsigned int &                               neighborhood_size,
+                 const double &                                     minimum_overlap,
+                 std::vector<intermediate_result_t> &               results,
+                 neighborhood_cache_t<TImage> *                     cache = nullptr)
+{
+  // shortcuts:
+  const unsigned int      i = pair.tile_[0];
+  const unsigned int      j = pair.tile_[1];
+  intermediate_result_t & result_i = results[i];
+
+  // the neighbor may not need refinement:
+  image_t::Pointer dx_j;
+  image_t::Pointer dy_j;
+  image_t::Pointer db_j;
+  if (pair.slot_[1] != (unsigned int)(~0))
+  {
+    intermediate_result_t & result_j = results[j];
+    dx_j = result_j.dx_[pair.slot_[1]];
+    dy_j = result_j.dy_[pair.slot_[1]];
+    db_j = result_j.db_[pair.slot_[1]];
+  }
+
+  calc_pair_displacements<TImage, TMask>(tiles_already_warped,
+
+                                         // sampled:
+                                         tile[i],
+                                         mask[i],
+                                         transform[i].GetPointer(),
+
+                                         // neighbor:
+                                         tile[j],
+                                         mask[j],
+                                         transform[j].GetPointer(),
+
+                                         neighborhood_size,
+                                         minimum_overlap,
+
+                                         result_i.dx_[pair.slot_[0]],
+                                         result_i.dy_[pair.slot_[0]],
+                                         result_i.db_[pair.slot_[0]],
+
+                                         dx_j,
+                                         dy_j,
+                                         db_j,
+
+                                         tiles_already_warped ? nullptr : cache);
+}
+
+
+//----------------------------------------------------------------
+// refine_tile_pair_t
+//
+// refine all the pairs sampled on the same tile, the pairs
+// share the resampled neighborhoods of the sampled tile:
+//
+template <typename TImage, typename TMask>
+class refine_tile_pair_t : public the_transaction_t
+{
+public:
+  refine_tile_pair_t(the_log_t &                                        log,
+                     const std::vector<tile_pair_t> &                   pairs,
+                     const std::vector<itk::GridTransform::Pointer> &   transform,
+                     const std::vector<typename TImage::ConstPointer> & tile,
+                     const std::vector<typename TMask::ConstPointer> &  mask,
+                     const bool &                                       tiles_already_warped,
+                     const unsigned int &                               neighborhood_size,
+                     const double &                                     minimum_overlap,
+                     std::vector<intermediate_result_t> &               results)
+    : log_(log)
+    , pairs_(pairs)
+    , transform_(transform)
+    , tile_(tile)
+    , mask_(mask)
+    , tiles_already_warped_(tiles_already_warped)
+    , neighborhood_(neighborhood_size)
+    , minimum_overlap_(minimum_overlap)
+    , results_(results)
+  {}
+
+  // virtual:
+  void
+  execute(the_thread_interface_t * thread)
+  {
+    WRAP(the_terminator_t terminator("refine_tile_pair_t"));
+
+    neighborhood_cache_t<TImage> cache;
+    for (std::size_t k = 0; k < pairs_.size(); k++)
+    {
+      WRAP(terminator.terminate_on_request());
+
+      log_ << "matching " << pairs_[k].tile_[0] << ":" << pairs_[k].tile_[1] << endl;
+      refine_tile_pair<TImage, TMask>(pairs_[k],
+                                      transform_,
+                                      tile_,
+                                      mask_,
+                                      tiles_already_warped_,
+                                      neighborhood_,
+                                      minimum_overlap_,
+                                      results_,
+                                      &cache);
+    }
+  }
+
+  the_log_t &                                        log_;
+  const std::vector<tile_pair_t>                     pairs_;
+  const std::vector<itk::GridTransform::Pointer> &   transform_;
+  const std::vector<typename TImage::ConstPointer> & tile_;
+  const std::vector<typename TMask::ConstPointer> &  mask_;
+  const bool                                         tiles_already_warped_;
+  const unsigned int                                 neighborhood_;
+  const double                                       minimum_overlap_; // neighborhood overlap
+  std::vector<intermediate_result_t> &               results_;
 };
 
 
@@ -1080,48 +1313,20 @@ refine_mosaic(the_log_t &                                         log,
 
   unsigned int start = keep_first_tile_fixed ? 1 : 0;
 
-  // find overlapping neighbors for each tile:
-  std::vector<the_dynamic_array_t<unsigned int>> neighbors(num_tiles);
-  for (unsigned int i = start; i < num_tiles; i++)
+  // find overlapping neighbors for each tile, a fixed tile
+  // is never refined so it needs no neighbors of its own:
+  std::vector<the_dynamic_array_t<unsigned int>> neighbors;
+  calc_overlap_graph(mosaic_min, mosaic_max, neighbors);
+  for (unsigned int i = 0; i < start; i++)
   {
-    the_aa_bbox_t ibox;
-    ibox << p3x1_t(mosaic_min[i][0], mosaic_min[i][1], 0) << p3x1_t(mosaic_max[i][0], mosaic_max[i][1], 0);
-
-    for (unsigned int j = 0; j < num_tiles; j++)
-    {
-      if (i == j)
-        continue;
-
-      the_aa_bbox_t jbox;
-      jbox << p3x1_t(mosaic_min[j][0], mosaic_min[j][1], 0) << p3x1_t(mosaic_max[j][0], mosaic_max[j][1], 0);
-
-      if (!ibox.intersects(jbox))
-        continue;
-
-      neighbors[i].push_back(j);
-    }
+    neighbors[i].clear();
   }
 
-  typedef itk::ImageDuplicator<image_t> image_duplicator_t;
-  typedef itk::ImageDuplicator<mask_t>  mask_duplicator_t;
-
-  std::vector<typename image_t::Pointer> warped_tile(num_tiles);
-  std::vector<typename mask_t::Pointer>  warped_mask(num_tiles);
-
-  if (keep_first_tile_fixed)
-  {
-    typename image_duplicator_t::Pointer image_duplicator = image_duplicator_t::New();
-    typename mask_duplicator_t::Pointer  mask_duplicator = mask_duplicator_t::New();
-
-    image_duplicator->SetInputImage(tile[0]);
-    mask_duplicator->SetInputImage(mask[0]);
-
-    image_duplicator->Update();
-    mask_duplicator->Update();
-
-    warped_tile[0] = image_duplicator->GetOutput();
-    warped_mask[0] = mask_duplicator->GetOutput();
-  }
+  // the tiles the neighborhoods are extracted from -- warped into
+  // mosaic space on every pass, or the original tiles when the
+  // neighborhoods are resampled through the transforms on demand:
+  std::vector<typename image_t::ConstPointer> source_tile(tile.begin(), tile.end());
+  std::vector<typename mask_t::ConstPointer>  source_mask(mask.begin(), mask.end());
 
   for (unsigned int pass = 0; pass < num_passes; pass++)
   {
@@ -1133,16 +1338,42 @@ refine_mosaic(the_log_t &                                         log,
       for (unsigned int i = start; i < num_tiles; i++)
       {
         log << setw(4) << i << ". warping image tile" << endl;
-        warped_tile[i] = warp<image_t>((typename image_t::ConstPointer)tile[i], transform[i].GetPointer());
+        source_tile[i] = warp<image_t>((typename image_t::ConstPointer)tile[i], transform[i].GetPointer()).GetPointer();
 
         if (mask[i].GetPointer() != nullptr)
         {
           log << "      warping image tile mask" << endl;
-          warped_mask[i] = warp<mask_t>((typename mask_t::ConstPointer)mask[i], transform[i].GetPointer());
+          source_mask[i] = warp<mask_t>((typename mask_t::ConstPointer)mask[i], transform[i].GetPointer()).GetPointer();
         }
       }
     }
 
+    // setup intermediate mesh refinement result structures:
+    std::vector<intermediate_result_t> results(num_tiles);
+    for (unsigned int i = start; i < num_tiles; i++)
+    {
+      const the_grid_transform_t & gt = transform[i]->transform_;
+      results[i] = intermediate_result_t(neighbors[i].size(), gt.rows_ + 1, gt.cols_ + 1);
+    }
+
+    // match each overlapping pair of tiles once, the pairs sampled
+    // on the same tile share its resampled neighborhoods:
+    std::vector<tile_pair_t> pairs;
+    find_tile_pairs(neighbors, pairs);
+
+    neighborhood_cache_t<image_t> cache;
+    for (unsigned int k = 0; k < pairs.size(); k++)
+    {
+      if (k > 0 && pairs[k].tile_[0] != pairs[k - 1].tile_[0])
+      {
+        cache.clear();
+      }
+
+      log << "matching " << pairs[k].tile_[0] << ":" << pairs[k].tile_[1] << endl;
+      refine_tile_pair<image_t, mask_t>(
+        pairs[k], transform, source_tile, source_mask, prewarp_tiles, neighborhood, minimum_overlap, results, &cache);
+    }
+
     std::vector<std::vector<vec2d_t>> shift(num_tiles);
     for (unsigned int i = start; i < num_tiles; i++)
     {
@@ -1154,29 +1385,9 @@ refine_mosaic(the_log_t &                                         log,
 
       for (unsigned int k = 0; k < neighbors[i].size(); k++)
       {
-        unsigned int j = neighbors[i][k];
-        log << "matching " << i << ":" << j << endl;
-
-        calc_displacements<image_t, mask_t>(*null_log(),
-                                            shift_i[k],
-                                            mass,
-
-                                            // tiles-already-warped flag:
-                                            prewarp_tiles,
-
-                                            // fixed:
-                                            warped_tile[j],
-                                            warped_mask[j],
-                                            transform[j].GetPointer(),
-
-                                            // moving:
-                                            warped_tile[i],
-                                            warped_mask[i],
-                                            transform[i].GetPointer(),
-
-                                            neighborhood,
-                                            minimum_overlap,
-                                            median_radius);
+        shift_i[k].assign(mesh_size, vec2d(0, 0));
+        regularize_displacements(
+          shift_i[k], mass, results[i].dx_[k], results[i].dy_[k], results[i].db_[k], median_radius);
       }
 
       // blend the displacement vectors:
@@ -1388,9 +1599,14 @@ refine_mosaic_mt(the_log_t &                                         log, // tex
                  const unsigned int &                                num_passes,
                  const bool &                                        keep_first_tile_fixed, // FIXME: stos only?
                  const double &                                      displacement_threshold,
-                 unsigned int                                        num_threads) // max concurrent threads
+                 unsigned int                                        num_threads, // max concurrent threads
+
+                 // after each pass freeze the tiles that moved less than
+                 // the displacement threshold, unless a neighbor moved,
+                 // and re-warp and re-match only the remaining tiles:
+                 const bool & active_set = false)
 {
-  if (num_threads == 1)
+  if (num_threads == 1 && !active_set)
   {
     refine_mosaic<image_t, mask_t>(log,
                                    transform,
@@ -1442,26 +1658,13 @@ refine_mosaic_mt(the_log_t &                                         log, // tex
 
   unsigned int start = keep_first_tile_fixed ? 1 : 0;
 
-  // find overlapping neighbors for each tile:
-  std::vector<the_dynamic_array_t<unsigned int>> neighbors(num_tiles);
-  for (unsigned int i = start; i < num_tiles; i++)
+  // find overlapping neighbors for each tile, a fixed tile
+  // is never refined so it needs no neighbors of its own:
+  std::vector<the_dynamic_array_t<unsigned int>> neighbors;
+  calc_overlap_graph(mosaic_min, mosaic_max, neighbors);
+  for (unsigned int i = 0; i < start; i++)
   {
-    the_aa_bbox_t ibox;
-    ibox << p3x1_t(mosaic_min[i][0], mosaic_min[i][1], 0) << p3x1_t(mosaic_max[i][0], mosaic_max[i][1], 0);
-
-    for (unsigned int j = 0; j < num_tiles; j++)
-    {
-      if (i == j)
-        continue;
-
-      the_aa_bbox_t jbox;
-      jbox << p3x1_t(mosaic_min[j][0], mosaic_min[j][1], 0) << p3x1_t(mosaic_max[j][0], mosaic_max[j][1], 0);
-
-      if (!ibox.intersects(jbox))
-        continue;
-
-      neighbors[i].push_back(j);
-    }
+    neighbors[i].clear();
   }
 
   std::vector<typename image_t::Pointer> warped_tile(num_tiles);
@@ -1469,31 +1672,28 @@ refine_mosaic_mt(the_log_t &                                         log, // tex
 
   double last_average = std::numeric_limits<double>::max();
 
-  typedef itk::ImageDuplicator<image_t> image_duplicator_t;
-  typedef itk::ImageDuplicator<mask_t>  mask_duplicator_t;
+  // the tiles the neighborhoods are extracted from -- warped into
+  // mosaic space on every pass, or the original tiles when the
+  // neighborhoods are resampled through the transforms on demand,
+  // which avoids warping (and storing) the whole tiles:
+  std::vector<typename image_t::ConstPointer> source_tile(tile.begin(), tile.end());
+  std::vector<typename mask_t::ConstPointer>  source_mask(mask.begin(), mask.end());
 
-  // Initialize "warped" tiles.
-  // If warping is actually requested do it on each pass
-  for (int i = 0; i < num_tiles; i++)
-  {
-    typename image_duplicator_t::Pointer image_duplicator = image_duplicator_t::New();
-    typename mask_duplicator_t::Pointer  mask_duplicator = mask_duplicator_t::New();
+  the_thread_pool_t thread_pool(num_threads);
+  thread_pool.set_idle_sleep_duration(50); // 50 usec
+  thread_pool.set_work_stealing(true);
 
-    image_duplicator->SetInputImage(tile[i]);
-    image_duplicator->Update();
-    warped_tile[i] = image_duplicator->GetOutput();
+  // all overlapping pairs of tiles:
+  std::vector<tile_pair_t> all_pairs;
+  find_tile_pairs(neighbors, all_pairs);
 
-    if (mask[i].GetPointer() != nullptr)
-    {
-      mask_duplicator->SetInputImage(mask[i]);
-      mask_duplicator->Update();
-      warped_mask[i] = mask_duplicator->GetOutput();
-    }
+  // the tiles refined in the current pass:
+  std::vector<bool> active(num_tiles, false);
+  for (unsigned int i = start; i < num_tiles; i++)
+  {
+    active[i] = true;
   }
 
-  the_thread_pool_t thread_pool(num_threads);
-  thread_pool.set_idle_sleep_duration(50); // 50 usec
-
   for (unsigned int pass = 0; pass < num_passes; pass++)
   {
     double major_percent = 0.15 + 0.8 * ((double)pass / (double)num_passes);
@@ -1502,6 +1702,21 @@ refine_mosaic_mt(the_log_t &                                         log, // tex
 
     log << "--------------------------- pass " << pass << " ---------------------------" << endl;
 
+    unsigned int num_active = 0;
+    for (unsigned int i = start; i < num_tiles; i++)
+    {
+      num_active += active[i] ? 1 : 0;
+    }
+
+    log << "active tiles: " << num_active << " of " << num_tiles - start << endl;
+    if (num_active == 0)
+    {
+      break;
+    }
+
+    itk::TimeProbe pass_timer;
+    pass_timer.Start();
+
     if (prewarp_tiles)
     {
       // warp the tiles -- split into a set of transactions and executed:
@@ -1509,6 +1724,12 @@ refine_mosaic_mt(the_log_t &                                         log, // tex
       std::list<the_transaction_t *> schedule;
       for (unsigned int i = start; i < num_tiles; i++)
       {
+        if (!active[i])
+        {
+          // the transform did not change, neither did the warped tile:
+          continue;
+        }
+
         warp_tile_transaction_t<image_t, mask_t> * t = new warp_tile_transaction_t<image_t, mask_t>(
           log, i, transform[i], tile[i], mask[i], warped_tile, warped_mask);
         schedule.push_back(t);
@@ -1519,120 +1740,105 @@ refine_mosaic_mt(the_log_t &                                         log, // tex
       suspend_itk_multithreading_t suspend_itk_mt;
       thread_pool.start();
       thread_pool.wait();
+
+      for (unsigned int i = start; i < num_tiles; i++)
+      {
+        if (active[i])
+        {
+          source_tile[i] = warped_tile[i].GetPointer();
+          source_mask[i] = warped_mask[i].GetPointer();
+        }
+      }
     }
 
     set_minor_progress(0.2, next_major);
 
-#if 1
-    // calculating displacements:
+    // mesh vertex displacements of each tile:
     std::vector<std::vector<vec2d_t>> shift(num_tiles);
 
-    // this is the original coarse-scale parallelization:
-    unsigned int num_tiles_distributed = (num_tiles - start) - (num_tiles - start) % num_threads;
+#if 1
+    // setup intermediate mesh refinement result structures:
+    std::vector<intermediate_result_t> results(num_tiles);
+    for (unsigned int i = start; i < num_tiles; i++)
+    {
+      if (!active[i])
+      {
+        continue;
+      }
+
+      const the_grid_transform_t & gt = transform[i]->transform_;
+      results[i] = intermediate_result_t(neighbors[i].size(), gt.rows_ + 1, gt.cols_ + 1);
+    }
 
-    unsigned int num_tiles_remaining = (num_tiles - start) - num_tiles_distributed;
+    // calculating displacements, one transaction per sampled tile
+    // for all of its overlapping pairs (they share the resampled
+    // neighborhoods of the sampled tile), idle threads pick up (or steal)
+    // the remaining tiles, so the tile count need not be a multiple
+    // of the thread count:
+    std::vector<tile_pair_t> pairs;
+    find_active_tile_pairs(all_pairs, active, pairs);
+    log << "matching " << pairs.size() << " overlapping tile pairs" << endl;
+
+    std::vector<std::vector<tile_pair_t>> sampled(num_tiles);
+    for (unsigned int k = 0; k < pairs.size(); k++)
+    {
+      sampled[pairs[k].tile_[0]].push_back(pairs[k]);
+    }
 
     std::list<the_transaction_t *> schedule;
-    for (unsigned int i = 0; i < num_tiles_distributed; i++)
+    for (unsigned int i = 0; i < num_tiles; i++)
     {
-      unsigned int index = start + i;
+      if (sampled[i].empty())
+      {
+        continue;
+      }
 
-      typedef refine_one_tile_t<image_t, mask_t> tile_transaction_t;
+      typedef refine_tile_pair_t<image_t, mask_t> pair_transaction_t;
 
-      tile_transaction_t * t = new tile_transaction_t(log,
-                                                      index,
+      pair_transaction_t * t = new pair_transaction_t(log,
+                                                      sampled[i],
                                                       transform,
-                                                      warped_tile,
-                                                      warped_mask,
-                                                      neighbors,
+                                                      source_tile,
+                                                      source_mask,
                                                       prewarp_tiles,
                                                       neighborhood_size,
                                                       minimum_overlap,
-                                                      median_radius,
-                                                      keep_first_tile_fixed,
-                                                      shift);
+                                                      results);
       schedule.push_back(t);
     }
 
+    // the pairs sampled on a tile with many neighbors cost more
+    // than the rest, the idle threads steal the pending groups:
     thread_pool.push_back(schedule);
-    // thread_pool.pre_distribute_work();
+    thread_pool.pre_distribute_work();
     suspend_itk_multithreading_t suspend_itk_mt;
     thread_pool.start();
     thread_pool.wait();
 
     set_minor_progress(0.9, next_major);
 
-    // this is the broken fine-scale parallelization:
-    for (unsigned int i = 0; i < num_tiles_remaining; i++)
-    {
-      unsigned int index = start + num_tiles_distributed + i;
-
-      the_grid_transform_t & gt = transform[index]->transform_;
-      unsigned int           mesh_size = gt.grid_.mesh_.size();
-
-      std::vector<std::vector<vec2d_t>> shift_i(neighbors[index].size());
-      std::vector<double>               mass(mesh_size, 0);
-
-      for (unsigned int k = 0; k < neighbors[index].size(); k++)
-      {
-        unsigned int j = neighbors[index][k];
-        log << "matching " << index << ":" << j << endl;
-
-        calc_displacements<image_t, mask_t>(*null_log(),
-                                            shift_i[k],
-                                            mass,
-
-                                            // tiles-already-warped flag:
-                                            prewarp_tiles,
-
-                                            // fixed:
-                                            (typename image_t::ConstPointer)warped_tile[j],
-                                            (typename mask_t::ConstPointer)warped_mask[j],
-                                            (base_transform_t::ConstPointer)transform[j].GetPointer(),
-
-                                            // moving:
-                                            (typename image_t::ConstPointer)warped_tile[index],
-                                            (typename mask_t::ConstPointer)warped_mask[index],
-                                            (itk::GridTransform::ConstPointer)transform[index].GetPointer(),
-
-                                            neighborhood_size,
-                                            minimum_overlap,
-                                            median_radius);
-      }
-
-      // blend the displacement vectors:
-      shift[index].assign(mesh_size, vec2d(0, 0));
-
-      for (unsigned int j = 0; j < shift_i.size(); j++)
-      {
-        for (unsigned int k = 0; k < mesh_size; k++)
-        {
-          shift[index][k] += shift_i[j][k];
-        }
-      }
-
-      if (!keep_first_tile_fixed)
-      {
-        // normalize:
-        for (unsigned int k = 0; k < mesh_size; k++)
-        {
-          double scale = 1 / (1 + mass[k]);
-          shift[index][k] *= scale;
-        }
-      }
-    }
-
     // once all displacement calculations are
     // finished the transform grids can be updated and we
     // can move on to the next pass:
-
     for (unsigned int i = start; i < num_tiles; i++)
     {
-      the_grid_transform_t & gt = transform[i]->transform_;
-      gt.grid_.update(&(shift[i][0]));
-      transform[i]->setup(gt);
+      if (!active[i])
+      {
+        // the frozen tiles did not move:
+        shift[i].assign(transform[i]->transform_.grid_.mesh_.size(), vec2d(0, 0));
+        continue;
+      }
+
+      update_tile_mesh_t * t =
+        new update_tile_mesh_t(log, i, keep_first_tile_fixed, median_radius, transform, results, &shift);
+      schedule.push_back(t);
     }
 
+    thread_pool.push_back(schedule);
+    thread_pool.pre_distribute_work();
+    thread_pool.start();
+    thread_pool.wait();
+
 #else
     // this is the "improved" fine scale parallelization:
 
@@ -1677,7 +1883,8 @@ refine_mosaic_mt(the_log_t &                                         log, // tex
 
     for (unsigned int i = start; i < num_tiles; i++)
     {
-      update_tile_mesh_t * t = new update_tile_mesh_t(log, i, keep_first_tile_fixed, median_radius, transform, results);
+      update_tile_mesh_t * t =
+        new update_tile_mesh_t(log, i, keep_first_tile_fixed, median_radius, transform, results, &shift);
       schedule.push_back(t);
     }
 
@@ -1703,6 +1910,32 @@ refine_mosaic_mt(the_log_t &                                         log, // tex
     avg /= count;
     cout << pass << "  Average Displacement: " << avg << "   Max Displacement: " << worst << endl;
 
+    pass_timer.Stop();
+    log << "pass " << pass << ": " << num_active << " active tiles, " << pass_timer.GetTotal() << " sec" << endl;
+
+    if (active_set)
+    {
+      // find the tiles that moved:
+      std::vector<bool> moved(num_tiles, false);
+      for (unsigned int i = start; i < num_tiles; i++)
+      {
+        for (unsigned int k = 0; k < shift[i].size() && !moved[i]; k++)
+        {
+          moved[i] = (std::abs(shift[i][k][0]) >= threshold || std::abs(shift[i][k][1]) >= threshold);
+        }
+      }
+
+      // keep refining the tiles that moved, and their neighbors:
+      for (unsigned int i = start; i < num_tiles; i++)
+      {
+        active[i] = moved[i];
+        for (unsigned int k = 0; k < neighbors[i].size() && !active[i]; k++)
+        {
+          active[i] = moved[neighbors[i][k]];
+        }
+      }
+    }
+
     // If there's an exact cutoff...
     if (count > 0)
     {
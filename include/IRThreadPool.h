@@ -128,6 +128,11 @@ public:
   // split the work among the threads:
   void pre_distribute_work();
   
+  // when enabled, a thread that runs out of pre-distributed work
+  // steals half of the pending transactions of the busiest thread,
+  // instead of terminating:
+  void set_work_stealing(bool enable);
+  
   // check whether the thread pool has any work left:
   bool has_work() const;
   
@@ -195,6 +200,7 @@ protected:
   void no_lock_push_front(the_transaction_t * transaction, bool multithreaded);
   void no_lock_push_back(the_transaction_t * transaction, bool multithreaded);
   void no_lock_push_back(std::list<the_transaction_t *> & schedule, bool mt);
+  bool no_lock_steal_work(unsigned int id);
   
   // thread synchronization control:
   the_mutex_interface_t * mutex_;
@@ -211,6 +217,9 @@ protected:
   
   // scheduled transactions:
   std::list<the_transaction_t *> transactions_;
+  
+  // idle threads steal work from busy threads:
+  bool work_stealing_;
 };
 
 
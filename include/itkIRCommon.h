@@ -92,6 +92,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <iostream>
 #include <iomanip>
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
 #include <vector>
 #include <list>
 #include <limits>
@@ -429,6 +431,105 @@ update_bbox(pnt2d_t & MIN, pnt2d_t & MAX, const pnt2d_t & pt)
     MAX[1] = pt[1];
 }
 
+//----------------------------------------------------------------
+// tile_bins_t
+//
+// A coarse uniform grid over the mosaic space tile bounding boxes.
+// Each bin lists, in increasing order, the tiles whose bounding
+// boxes overlap it, so a mosaic point or box only has to be tested
+// against the bounding boxes of the tiles listed in its bins.
+// Tiles with empty bounding boxes are not binned:
+//
+class tile_bins_t
+{
+public:
+  tile_bins_t();
+
+  void
+  setup(const std::vector<pnt2d_t> & min, const std::vector<pnt2d_t> & max);
+
+  // the tiles whose bounding boxes may contain a given mosaic point,
+  // returns the number of tiles:
+  inline unsigned int
+  lookup(const pnt2d_t & point, const unsigned int *& tiles) const
+  {
+    if (tiles_.empty())
+      return 0;
+
+    const unsigned int bin = col(point[0]) + row(point[1]) * cols_;
+    tiles = &(tiles_[0]) + first_[bin];
+    return first_[bin + 1] - first_[bin];
+  }
+
+  // find the tiles whose bounding boxes intersect a given
+  // mosaic space box (touching counts), in increasing order:
+  void
+  find(const pnt2d_t & min, const pnt2d_t & max, std::vector<unsigned int> & tiles) const;
+
+private:
+  inline unsigned int
+  col(const double x) const
+  {
+    const double c = std::floor((x - origin_[0]) / bin_sz_[0]);
+    return (unsigned int)(std::max(0.0, std::min(double(cols_ - 1), c)));
+  }
+
+  inline unsigned int
+  row(const double y) const
+  {
+    const double r = std::floor((y - origin_[1]) / bin_sz_[1]);
+    return (unsigned int)(std::max(0.0, std::min(double(rows_ - 1), r)));
+  }
+
+  // grid geometry:
+  pnt2d_t      origin_;
+  double       bin_sz_[2];
+  unsigned int cols_;
+  unsigned int rows_;
+
+  // tiles of bin i are tiles_[first_[i]] ... tiles_[first_[i + 1] - 1]:
+  std::vector<unsigned int> first_;
+  std::vector<unsigned int> tiles_;
+
+  // the binned bounding boxes:
+  std::vector<pnt2d_t> min_;
+  std::vector<pnt2d_t> max_;
+};
+
+//----------------------------------------------------------------
+// calc_overlap_graph
+//
+// Find the tiles whose mosaic space bounding boxes intersect,
+// neighbors[i] lists the tiles overlapping tile i in increasing order.
+// The tiles are binned first, so this scales with the number of
+// overlaps rather than the number of tile pairs:
+//
+template <typename list_t>
+void
+calc_overlap_graph(const std::vector<pnt2d_t> & min,
+                   const std::vector<pnt2d_t> & max,
+                   std::vector<list_t> &        neighbors)
+{
+  const unsigned int num_tiles = min.size();
+  neighbors.resize(num_tiles);
+
+  tile_bins_t bins;
+  bins.setup(min, max);
+
+  std::vector<unsigned int> found;
+  for (unsigned int i = 0; i < num_tiles; i++)
+  {
+    neighbors[i].clear();
+    bins.find(min[i], max[i], found);
+
+    for (unsigned int k = 0; k < found.size(); k++)
+    {
+      if (found[k] != i)
+        neighbors[i].push_back(found[k]);
+    }
+  }
+}
+
 
 //----------------------------------------------------------------
 // suspend_itk_multithreading_t
@@ -1360,20 +1461,25 @@ public:
 
   //----------------
   // Allocates and returns a pointer to a vector of indicies that can participate in this column, sorted by the minX.
+  // When given, only the candidate tiles (in increasing order) are considered.
   // James A
   //----------------
   template <class pnt_t>
   static std::vector<unsigned int>
-  GetSortedTilesImagesForColumn(const pnt_t point,
+  GetSortedTilesImagesForColumn(const pnt_t & point,
                                 // mosaic space tile bounding boxes:
-                                const std::vector<pnt_t> MIN,
-                                const std::vector<pnt_t> MAX)
+                                const std::vector<pnt_t> &        MIN,
+                                const std::vector<pnt_t> &        MAX,
+                                const std::vector<unsigned int> * candidates = nullptr)
   {
+    const unsigned int num_candidates = candidates ? candidates->size() : MIN.size();
+
     std::vector<unsigned int> PotentialTiles;
-    PotentialTiles.reserve(MIN.size());
+    PotentialTiles.reserve(num_candidates);
 
-    for (unsigned int iK = 0; iK < MIN.size(); iK++)
+    for (unsigned int iC = 0; iC < num_candidates; iC++)
     {
+      const unsigned int iK = candidates ? (*candidates)[iC] : iC;
       if (!(MIN[iK][1] > point[1] || MAX[iK][1] < point[1]))
       {
         if (PotentialTiles.size() == 0)
@@ -2491,6 +2597,267 @@ my_metric(double & area,
   return result;
 }
 
+//----------------------------------------------------------------
+// my_metric_translate
+//
+// Translation-only version of my_metric. The fixed and moving images
+// must share pixel spacing, so the translation is a constant pixel
+// offset: the overlapping region is computed analytically, and the
+// pixels are read directly from the image buffers. With integer
+// (or nearest neighbor, when interpolate is false) offsets no
+// interpolation is done at all, sub-pixel offsets are sampled with
+// a bilinear stencil whose weights are the same for every pixel.
+// Falls back to my_metric_mt when the spacing differs.
+//
+template <typename TImage>
+double
+my_metric_translate(double & area,
+
+                    const TImage * fi,
+                    const TImage * mi,
+
+                    // fixed to moving image translation:
+                    const vec2d_t & offset,
+
+                    const mask_t * fi_mask,
+                    const mask_t * mi_mask,
+
+                    // sample the moving image with a bilinear stencil,
+                    // otherwise use the nearest pixel:
+                    const bool interpolate = false)
+{
+  typedef typename TImage::PixelType pixel_t;
+
+  area = 0.0;
+
+  const typename TImage::SpacingType fi_sp = fi->GetSpacing();
+  const typename TImage::SpacingType mi_sp = mi->GetSpacing();
+  if (fi_sp != mi_sp)
+  {
+    translate_transform_t::Pointer fi_to_mi = translate_transform_t::New();
+    fi_to_mi->SetOffset(offset);
+
+    if (interpolate)
+    {
+      typedef itk::LinearInterpolateImageFunction<TImage, double> interpolator_t;
+      typename interpolator_t::Pointer                            mi_interpolator = interpolator_t::New();
+      mi_interpolator->SetInputImage(mi);
+      return my_metric_mt<TImage, interpolator_t>(
+        area, fi, mi, fi_to_mi.GetPointer(), fi_mask, mi_mask, mi_interpolator);
+    }
+
+    typedef itk::NearestNeighborInterpolateImageFunction<TImage, double> interpolator_t;
+    typename interpolator_t::Pointer                                     mi_interpolator = interpolator_t::New();
+    mi_interpolator->SetInputImage(mi);
+    return my_metric_mt<TImage, interpolator_t>(
+      area, fi, mi, fi_to_mi.GetPointer(), fi_mask, mi_mask, mi_interpolator);
+  }
+
+  const typename TImage::PointType fi_origin = fi->GetOrigin();
+  const typename TImage::PointType mi_origin = mi->GetOrigin();
+  const typename TImage::SizeType  fi_sz = fi->GetLargestPossibleRegion().GetSize();
+  const typename TImage::SizeType  mi_sz = mi->GetLargestPossibleRegion().GetSize();
+
+  const int fw = int(fi_sz[0]);
+  const int fh = int(fi_sz[1]);
+  const int mw = int(mi_sz[0]);
+  const int mh = int(mi_sz[1]);
+
+  // moving image continuous index of fixed image pixel (x, y) is (x + dx, y + dy):
+  const double d[] = { (fi_origin[0] + offset[0] - mi_origin[0]) / fi_sp[0],
+                       (fi_origin[1] + offset[1] - mi_origin[1]) / fi_sp[1] };
+
+  // integer part of the offset and the bilinear weights:
+  int    k[2];
+  double t[2];
+  for (unsigned int i = 0; i < 2; i++)
+  {
+    const double r = floor(d[i] + 0.5);
+    if (!interpolate || fabs(d[i] - r) < 1e-6)
+    {
+      k[i] = int(r);
+      t[i] = 0.0;
+    }
+    else
+    {
+      k[i] = int(floor(d[i]));
+      t[i] = d[i] - double(k[i]);
+    }
+  }
+
+  // the bilinear stencil reaches one pixel further:
+  const int ex = (t[0] > 0.0) ? 1 : 0;
+  const int ey = (t[1] > 0.0) ? 1 : 0;
+
+  // the fixed image pixels that map inside the moving image:
+  const int x0 = std::max(0, -k[0]);
+  const int x1 = std::min(fw, mw - ex - k[0]);
+  const int y0 = std::max(0, -k[1]);
+  const int y1 = std::min(fh, mh - ey - k[1]);
+  if (x1 <= x0 || y1 <= y0)
+  {
+    return std::numeric_limits<double>::max();
+  }
+
+  // mask lookups, the fixed image mask may be at a higher resolution:
+  mask_t::SizeType      fi_mask_sz = fi_sz;
+  unsigned int          fi_mask_scale = 1;
+  const unsigned char * fi_mask_data = nullptr;
+  if (fi_mask)
+  {
+    fi_mask_sz = fi_mask->GetLargestPossibleRegion().GetSize();
+    fi_mask_scale = fi_mask_sz[0] / fi_sz[0];
+    fi_mask_data = fi_mask->GetBufferPointer();
+  }
+
+  // the moving image mask is read directly when it shares
+  // the moving image geometry, otherwise it is sampled:
+  const bool mi_mask_direct = mi_mask && mi_mask->GetLargestPossibleRegion().GetSize() == mi_sz &&
+                              mi_mask->GetSpacing() == mi_sp && mi_mask->GetOrigin() == mi_origin;
+  const unsigned char * mi_mask_data = mi_mask_direct ? mi_mask->GetBufferPointer() : nullptr;
+
+  // the moving image pixel nearest to the sampling point decides the mask:
+  const int kx = int(floor(d[0] + 0.5));
+  const int ky = int(floor(d[1] + 0.5));
+
+  // my_metric skips moving image points where both coordinates are
+  // not positive, preserve that here:
+  std::vector<unsigned char> skip_x(fw, 0);
+  for (int x = x0; x < x1; x++)
+  {
+    skip_x[x] = (fi_origin[0] + double(x) * fi_sp[0] + offset[0]) <= std::numeric_limits<double>::min();
+  }
+
+  const pixel_t * fi_data = fi->GetBufferPointer();
+  const pixel_t * mi_data = mi->GetBufferPointer();
+
+  const double w00 = (1.0 - t[0]) * (1.0 - t[1]);
+  const double w10 = t[0] * (1.0 - t[1]);
+  const double w01 = (1.0 - t[0]) * t[1];
+  const double w11 = t[0] * t[1];
+
+  // counters:
+  double            ab = 0.0;
+  double            aa = 0.0;
+  double            bb = 0.0;
+  double            sa = 0.0;
+  double            sb = 0.0;
+  unsigned long int pixels = 0;
+
+  pnt2d_t uv;
+  for (int y = y0; y < y1; y++)
+  {
+    const bool skip_y = (fi_origin[1] + double(y) * fi_sp[1] + offset[1]) <= std::numeric_limits<double>::min();
+
+    const int       v = y + k[1];
+    const pixel_t * fi_row = fi_data + std::size_t(y) * fw;
+    const pixel_t * mi_row0 = mi_data + std::size_t(v) * mw + k[0];
+    const pixel_t * mi_row1 = mi_row0 + ey * mw;
+
+    const unsigned int fi_mask_y = y * fi_mask_scale;
+    const unsigned int mi_mask_y = y + ky;
+
+    for (int x = x0; x < x1; x++)
+    {
+      if (skip_y && skip_x[x])
+      {
+        continue;
+      }
+
+      if (fi_mask)
+      {
+        const unsigned int fi_mask_x = x * fi_mask_scale;
+        if (fi_mask_x >= fi_mask_sz[0] || fi_mask_y >= fi_mask_sz[1] ||
+            !fi_mask_data[fi_mask_x + fi_mask_y * fi_mask_sz[0]])
+        {
+          continue;
+        }
+      }
+
+      if (mi_mask_direct)
+      {
+        if (!mi_mask_data[(x + kx) + mi_mask_y * mw])
+        {
+          continue;
+        }
+      }
+      else if (mi_mask)
+      {
+        uv[0] = fi_origin[0] + double(x) * fi_sp[0] + offset[0];
+        uv[1] = fi_origin[1] + double(y) * fi_sp[1] + offset[1];
+        if (!pixel_in_mask<mask_t>(mi_mask, uv))
+        {
+          continue;
+        }
+      }
+
+      const double A = fi_row[x];
+      const double B = (ex | ey) ? (w00 * mi_row0[x] + w10 * mi_row0[x + ex] + w01 * mi_row1[x] +
+                                    w11 * mi_row1[x + ex])
+                                 : double(mi_row0[x]);
+
+      ab += A * B;
+      aa += A * A;
+      bb += B * B;
+      sa += A;
+      sb += B;
+      pixels++;
+    }
+  }
+
+  area = calc_area(fi_sp, pixels);
+  if (area == 0)
+  {
+    return std::numeric_limits<double>::max();
+  }
+
+  aa = aa - ((sa * sa) / double(pixels));
+  bb = bb - ((sb * sb) / double(pixels));
+  ab = ab - ((sa * sb) / double(pixels));
+
+  return -ab / sqrt(aa * bb);
+}
+
+//----------------------------------------------------------------
+// my_metric
+//
+// Translation-only version, see my_metric_translate. Like the general
+// version it samples the moving image at the nearest pixel.
+//
+template <class TImage>
+double
+my_metric(double &                      overlap,
+          const TImage *                fi,
+          const TImage *                mi,
+          const translate_transform_t * fi_to_mi,
+          const mask_t *                fi_mask = nullptr,
+          const mask_t *                mi_mask = nullptr,
+          const double                  min_overlap = 0.05,
+          const double                  max_overlap = 1.0)
+{
+  overlap = 0;
+
+  double overlap_area = 0;
+  return my_metric_translate<TImage>(overlap_area, fi, mi, fi_to_mi->GetOffset(), fi_mask, mi_mask);
+}
+
+//----------------------------------------------------------------
+// my_metric
+//
+template <typename TImage>
+double
+my_metric(const TImage *                fi,
+          const TImage *                mi,
+          const translate_transform_t * fi_to_mi,
+          const mask_t *                fi_mask = nullptr,
+          const mask_t *                mi_mask = nullptr,
+          const double                  min_overlap = 0.0,
+          const double                  max_overlap = 1.0)
+{
+  double overlap = 0.0;
+  return my_metric<TImage>(overlap, fi, mi, fi_to_mi, fi_mask, mi_mask, min_overlap, max_overlap);
+}
+
 //----------------------------------------------------------------
 // my_metric
 //
@@ -3051,6 +3418,14 @@ make_mosaic_st(
   pixel_t pixel_max = pixel_t(std::numeric_limits<pixel_t>::max());
   pixel_t pixel_min = integer_pixel ? pixel_t(std::numeric_limits<pixel_t>::min()) : -pixel_max;
 
+  // bin the tiles, so that each row is only tested
+  // against the tiles that may overlap it:
+  tile_bins_t bins;
+  bins.setup(MIN, MAX);
+
+  const double              x_max = std::numeric_limits<double>::max();
+  std::vector<unsigned int> RowTiles;
+
   ix_t ix = origin;
   for (ix[1] = origin[1]; ix[1] < y_end; ++ix[1])
   {
@@ -3068,8 +3443,9 @@ make_mosaic_st(
 
     point_t pointColumn;
     mosaic->TransformIndexToPhysicalPoint(ix, pointColumn);
+    bins.find(pnt2d(-x_max, pointColumn[1]), pnt2d(x_max, pointColumn[1]), RowTiles);
     std::vector<unsigned int> PotentialTiles =
-      AssembleUtil::GetSortedTilesImagesForColumn<point_t>(pointColumn, MIN, MAX);
+      AssembleUtil::GetSortedTilesImagesForColumn<point_t>(pointColumn, MIN, MAX, &RowTiles);
     if (PotentialTiles.size() <= 0)
     {
       continue;
@@ -6182,6 +6558,569 @@ overlap_ratio(const T * fi, const T * mi, const base_transform_t * fi_to_mi)
   return area_ratio;
 }
 
+//----------------------------------------------------------------
+// masked_sat_t
+//
+// Summed area tables of the mask, the masked intensity and the
+// squared masked intensity of an image, for O(1) pixel counts,
+// means and variances over any rectangle of pixels. Intensities
+// are stored relative to the masked image mean and the rows are
+// summed with Kahan compensation, so that the variance of large
+// rectangles does not suffer from catastrophic cancellation.
+//
+// The mask is looked up the same way my_metric looks up the fixed
+// image mask, it may be at a higher resolution than the image.
+//
+class masked_sat_t
+{
+public:
+  masked_sat_t()
+    : w_(0)
+    , h_(0)
+    , mean_(0.0)
+  {}
+
+  template <typename TImage>
+  void
+  build(const TImage * image, const mask_t * mask = nullptr)
+  {
+    typedef typename TImage::PixelType pixel_t;
+
+    const typename TImage::SizeType sz = image->GetLargestPossibleRegion().GetSize();
+    w_ = sz[0];
+    h_ = sz[1];
+
+    const std::size_t stride = w_ + 1;
+    n_.assign(stride * (h_ + 1), 0.0);
+    s_.assign(stride * (h_ + 1), 0.0);
+    ss_.assign(stride * (h_ + 1), 0.0);
+
+    mask_t::SizeType      mask_sz = sz;
+    unsigned int          mask_scale = 1;
+    const unsigned char * mask_data = nullptr;
+    if (mask)
+    {
+      mask_sz = mask->GetLargestPossibleRegion().GetSize();
+      mask_scale = mask_sz[0] / sz[0];
+      mask_data = mask->GetBufferPointer();
+    }
+
+    // the masked pixels of a row:
+    std::vector<unsigned char> row_mask(w_, 1);
+
+    const pixel_t * data = image->GetBufferPointer();
+
+    double            total = 0.0;
+    unsigned long int pixels = 0;
+    for (unsigned int pass = 0; pass < 2; pass++)
+    {
+      for (unsigned int y = 0; y < h_; y++)
+      {
+        const pixel_t * row = data + std::size_t(y) * w_;
+
+        if (mask)
+        {
+          const unsigned int mask_y = y * mask_scale;
+          for (unsigned int x = 0; x < w_; x++)
+          {
+            const unsigned int mask_x = x * mask_scale;
+            row_mask[x] = mask_x < mask_sz[0] && mask_y < mask_sz[1] && mask_data[mask_x + mask_y * mask_sz[0]];
+          }
+        }
+
+        if (pass == 0)
+        {
+          for (unsigned int x = 0; x < w_; x++)
+          {
+            if (row_mask[x])
+            {
+              total += double(row[x]);
+              pixels++;
+            }
+          }
+          continue;
+        }
+
+        // Kahan compensated row sums:
+        double rn = 0.0;
+        double rs = 0.0;
+        double rss = 0.0;
+        double cs = 0.0;
+        double css = 0.0;
+
+        const double * n_above = &n_[std::size_t(y) * stride];
+        const double * s_above = &s_[std::size_t(y) * stride];
+        const double * ss_above = &ss_[std::size_t(y) * stride];
+        double *       n_here = &n_[std::size_t(y + 1) * stride];
+        double *       s_here = &s_[std::size_t(y + 1) * stride];
+        double *       ss_here = &ss_[std::size_t(y + 1) * stride];
+
+        for (unsigned int x = 0; x < w_; x++)
+        {
+          if (row_mask[x])
+          {
+            const double v = double(row[x]) - mean_;
+            rn += 1.0;
+
+            const double ys = v - cs;
+            const double ts = rs + ys;
+            cs = (ts - rs) - ys;
+            rs = ts;
+
+            const double yss = v * v - css;
+            const double tss = rss + yss;
+            css = (tss - rss) - yss;
+            rss = tss;
+          }
+
+          n_here[x + 1] = n_above[x + 1] + rn;
+          s_here[x + 1] = s_above[x + 1] + rs;
+          ss_here[x + 1] = ss_above[x + 1] + rss;
+        }
+      }
+
+      if (pass == 0)
+      {
+        mean_ = pixels ? total / double(pixels) : 0.0;
+      }
+    }
+  }
+
+  // number of masked pixels in [x0, x1) x [y0, y1):
+  inline double
+  pixels(const int x0, const int y0, const int x1, const int y1) const
+  {
+    return rect(n_, x0, y0, x1, y1);
+  }
+
+  // sum of the masked intensities in [x0, x1) x [y0, y1):
+  inline double
+  sum(const int x0, const int y0, const int x1, const int y1) const
+  {
+    return rect(s_, x0, y0, x1, y1) + mean_ * rect(n_, x0, y0, x1, y1);
+  }
+
+  // sum of squared deviations of the masked intensities
+  // from their mean in [x0, x1) x [y0, y1):
+  inline double
+  ssd(const int x0, const int y0, const int x1, const int y1) const
+  {
+    const double n = rect(n_, x0, y0, x1, y1);
+    if (n == 0.0)
+    {
+      return 0.0;
+    }
+
+    const double s = rect(s_, x0, y0, x1, y1);
+    return rect(ss_, x0, y0, x1, y1) - (s * s) / n;
+  }
+
+  // table dimensions are (w_ + 1) x (h_ + 1):
+  unsigned int w_;
+  unsigned int h_;
+
+  // masked image mean:
+  double mean_;
+
+  // summed area tables:
+  std::vector<double> n_;
+  std::vector<double> s_;
+  std::vector<double> ss_;
+
+private:
+  inline double
+  rect(const std::vector<double> & t, const int x0, const int y0, const int x1, const int y1) const
+  {
+    const std::size_t stride = w_ + 1;
+    return (t[std::size_t(y1) * stride + x1] - t[std::size_t(y0) * stride + x1] - t[std::size_t(y1) * stride + x0] +
+            t[std::size_t(y0) * stride + x0]);
+  }
+};
+
+//----------------------------------------------------------------
+// masked_sat_usable
+//
+// Find which summed area tables my_metric_candidates can consult
+// for a given pair of images and masks, each table takes 24 bytes
+// per pixel and should only be built when it will be used:
+//
+template <typename TImage>
+void
+masked_sat_usable(const TImage * fi,
+                  const TImage * mi,
+                  const mask_t * fi_mask,
+                  const mask_t * mi_mask,
+                  bool &         use_fi_sat,
+                  bool &         use_mi_sat)
+{
+  use_fi_sat = false;
+  use_mi_sat = false;
+  if (fi->GetSpacing() != mi->GetSpacing())
+  {
+    return;
+  }
+
+  // the moving image mask must be read directly:
+  const bool mi_mask_direct =
+    mi_mask && mi_mask->GetLargestPossibleRegion().GetSize() == mi->GetLargestPossibleRegion().GetSize() &&
+    mi_mask->GetSpacing() == mi->GetSpacing() && mi_mask->GetOrigin() == mi->GetOrigin();
+
+  // the tables only apply when the other image is not masked:
+  use_fi_sat = !mi_mask;
+  use_mi_sat = !fi_mask && (!mi_mask || mi_mask_direct);
+}
+
+//----------------------------------------------------------------
+// my_metric_candidates
+//
+// Evaluate several candidate fixed to moving image translations
+// at once, typically the permutations of a correlation peak.
+// For each candidate this returns the ratio of the overlap region
+// area to the area of the smaller image (see overlap_ratio) and
+// the my_metric value, or std::numeric_limits<double>::max() when
+// the overlap ratio is outside the given limits.
+//
+// The moving image is sampled at the nearest pixel, like my_metric.
+// All candidates are evaluated in one pass over the fixed image,
+// so each fixed image row and its mask are read once and shared
+// by every candidate whose overlap region includes that row.
+// Falls back to my_metric_translate when the spacing differs.
+//
+// Optional summed area tables of the masked images (built with
+// the same masks) provide the pixel count, mean and variance of
+// one image over a candidate overlap region when the other image
+// is not masked. Candidates over which either image is flat are
+// rejected without a pass, and when neither image is masked only
+// the cross term is accumulated.
+//
+template <typename TImage>
+void
+my_metric_candidates(std::vector<double> & overlap,
+                     std::vector<double> & metric,
+
+                     const TImage * fi,
+                     const TImage * mi,
+
+                     // fixed to moving image translations:
+                     const std::vector<vec2d_t> & offsets,
+
+                     const mask_t * fi_mask = nullptr,
+                     const mask_t * mi_mask = nullptr,
+                     const double   min_overlap = 0.0,
+                     const double   max_overlap = 1.0,
+
+                     // optional summed area tables of the masked images:
+                     const masked_sat_t * fi_sat = nullptr,
+                     const masked_sat_t * mi_sat = nullptr)
+{
+  typedef typename TImage::PixelType pixel_t;
+
+  const std::size_t num_candidates = offsets.size();
+  overlap.assign(num_candidates, 0.0);
+  metric.assign(num_candidates, std::numeric_limits<double>::max());
+
+  // the candidates within the overlap limits:
+  std::vector<std::size_t>       active;
+  translate_transform_t::Pointer fi_to_mi = translate_transform_t::New();
+  for (std::size_t i = 0; i < num_candidates; i++)
+  {
+    fi_to_mi->SetOffset(offsets[i]);
+    overlap[i] = overlap_ratio<TImage>(fi, mi, fi_to_mi.GetPointer());
+    if (overlap[i] < min_overlap || overlap[i] > max_overlap)
+    {
+      continue;
+    }
+
+    active.push_back(i);
+  }
+
+  if (active.empty())
+  {
+    return;
+  }
+
+  const typename TImage::SpacingType fi_sp = fi->GetSpacing();
+  const typename TImage::SpacingType mi_sp = mi->GetSpacing();
+  if (fi_sp != mi_sp)
+  {
+    for (std::size_t j = 0; j < active.size(); j++)
+    {
+      const std::size_t i = active[j];
+      double            area = 0.0;
+      metric[i] = my_metric_translate<TImage>(area, fi, mi, offsets[i], fi_mask, mi_mask);
+    }
+    return;
+  }
+
+  const typename TImage::PointType fi_origin = fi->GetOrigin();
+  const typename TImage::PointType mi_origin = mi->GetOrigin();
+  const typename TImage::SizeType  fi_sz = fi->GetLargestPossibleRegion().GetSize();
+  const typename TImage::SizeType  mi_sz = mi->GetLargestPossibleRegion().GetSize();
+
+  const int fw = int(fi_sz[0]);
+  const int fh = int(fi_sz[1]);
+  const int mw = int(mi_sz[0]);
+  const int mh = int(mi_sz[1]);
+
+  // traversal state and counters of a candidate:
+  struct candidate_t
+  {
+    std::size_t index_;
+
+    // nearest pixel offset into the moving image:
+    int k_[2];
+
+    // the fixed image pixels that map inside the moving image:
+    int x0_;
+    int x1_;
+    int y0_;
+    int y1_;
+
+    // my_metric skips moving image points where both coordinates
+    // are not positive, these are the fixed image pixels x < xs_, y < ys_:
+    int xs_;
+    int ys_;
+
+    // the masked image statistics come from the summed area tables,
+    // only the cross term is accumulated:
+    bool cross_only_;
+
+    double            ab_;
+    double            aa_;
+    double            bb_;
+    double            sa_;
+    double            sb_;
+    unsigned long int pixels_;
+  };
+
+  // the moving image mask is read directly when it shares
+  // the moving image geometry, otherwise it is sampled:
+  const bool mi_mask_direct = mi_mask && mi_mask->GetLargestPossibleRegion().GetSize() == mi_sz &&
+                              mi_mask->GetSpacing() == mi_sp && mi_mask->GetOrigin() == mi_origin;
+  const unsigned char * mi_mask_data = mi_mask_direct ? mi_mask->GetBufferPointer() : nullptr;
+
+  // the tables only apply when the other image is not masked:
+  bool use_fi_sat = false;
+  bool use_mi_sat = false;
+  masked_sat_usable<TImage>(fi, mi, fi_mask, mi_mask, use_fi_sat, use_mi_sat);
+  use_fi_sat = use_fi_sat && fi_sat;
+  use_mi_sat = use_mi_sat && mi_sat;
+
+  std::vector<candidate_t> candidates;
+  candidates.reserve(active.size());
+
+  int x_begin = fw;
+  int x_end = 0;
+  int y_begin = fh;
+  int y_end = 0;
+
+  for (std::size_t j = 0; j < active.size(); j++)
+  {
+    const vec2d_t & offset = offsets[active[j]];
+
+    candidate_t c;
+    c.index_ = active[j];
+    c.k_[0] = int(floor((fi_origin[0] + offset[0] - mi_origin[0]) / fi_sp[0] + 0.5));
+    c.k_[1] = int(floor((fi_origin[1] + offset[1] - mi_origin[1]) / fi_sp[1] + 0.5));
+
+    c.x0_ = std::max(0, -c.k_[0]);
+    c.x1_ = std::min(fw, mw - c.k_[0]);
+    c.y0_ = std::max(0, -c.k_[1]);
+    c.y1_ = std::min(fh, mh - c.k_[1]);
+    if (c.x1_ <= c.x0_ || c.y1_ <= c.y0_)
+    {
+      continue;
+    }
+
+    c.xs_ = c.x0_;
+    while (c.xs_ < c.x1_ &&
+           (fi_origin[0] + double(c.xs_) * fi_sp[0] + offset[0]) <= std::numeric_limits<double>::min())
+    {
+      c.xs_++;
+    }
+
+    c.ys_ = c.y0_;
+    while (c.ys_ < c.y1_ &&
+           (fi_origin[1] + double(c.ys_) * fi_sp[1] + offset[1]) <= std::numeric_limits<double>::min())
+    {
+      c.ys_++;
+    }
+
+    c.cross_only_ = false;
+    c.ab_ = 0.0;
+    c.aa_ = 0.0;
+    c.bb_ = 0.0;
+    c.sa_ = 0.0;
+    c.sb_ = 0.0;
+    c.pixels_ = 0;
+
+    // the tables can not account for the skipped pixels:
+    if (c.xs_ == c.x0_ && c.ys_ == c.y0_)
+    {
+      if (use_fi_sat && fi_sat->ssd(c.x0_, c.y0_, c.x1_, c.y1_) <= 0.0)
+      {
+        continue;
+      }
+
+      const int u0 = c.x0_ + c.k_[0];
+      const int v0 = c.y0_ + c.k_[1];
+      const int u1 = c.x1_ + c.k_[0];
+      const int v1 = c.y1_ + c.k_[1];
+      if (use_mi_sat && mi_sat->ssd(u0, v0, u1, v1) <= 0.0)
+      {
+        continue;
+      }
+
+      if (use_fi_sat && use_mi_sat)
+      {
+        // neither image is masked:
+        c.cross_only_ = true;
+        c.pixels_ = (unsigned long int)(fi_sat->pixels(c.x0_, c.y0_, c.x1_, c.y1_));
+        c.sa_ = fi_sat->sum(c.x0_, c.y0_, c.x1_, c.y1_);
+        c.aa_ = fi_sat->ssd(c.x0_, c.y0_, c.x1_, c.y1_);
+        c.sb_ = mi_sat->sum(u0, v0, u1, v1);
+        c.bb_ = mi_sat->ssd(u0, v0, u1, v1);
+      }
+    }
+
+    candidates.push_back(c);
+
+    x_begin = std::min(x_begin, c.x0_);
+    x_end = std::max(x_end, c.x1_);
+    y_begin = std::min(y_begin, c.y0_);
+    y_end = std::max(y_end, c.y1_);
+  }
+
+  // mask lookups, the fixed image mask may be at a higher resolution:
+  mask_t::SizeType      fi_mask_sz = fi_sz;
+  unsigned int          fi_mask_scale = 1;
+  const unsigned char * fi_mask_data = nullptr;
+  if (fi_mask)
+  {
+    fi_mask_sz = fi_mask->GetLargestPossibleRegion().GetSize();
+    fi_mask_scale = fi_mask_sz[0] / fi_sz[0];
+    fi_mask_data = fi_mask->GetBufferPointer();
+  }
+
+  const pixel_t * fi_data = fi->GetBufferPointer();
+  const pixel_t * mi_data = mi->GetBufferPointer();
+
+  // fixed image mask of the current row, shared by all candidates:
+  std::vector<unsigned char> fi_row_mask(fw, 1);
+
+  pnt2d_t uv;
+  for (int y = y_begin; y < y_end; y++)
+  {
+    const pixel_t * fi_row = fi_data + std::size_t(y) * fw;
+
+    if (fi_mask)
+    {
+      const unsigned int fi_mask_y = y * fi_mask_scale;
+      for (int x = x_begin; x < x_end; x++)
+      {
+        const unsigned int fi_mask_x = x * fi_mask_scale;
+        fi_row_mask[x] = fi_mask_x < fi_mask_sz[0] && fi_mask_y < fi_mask_sz[1] &&
+                         fi_mask_data[fi_mask_x + fi_mask_y * fi_mask_sz[0]];
+      }
+    }
+
+    for (std::size_t j = 0; j < candidates.size(); j++)
+    {
+      candidate_t & c = candidates[j];
+      if (y < c.y0_ || y >= c.y1_)
+      {
+        continue;
+      }
+
+      const int       v = y + c.k_[1];
+      const pixel_t * mi_row = mi_data + std::size_t(v) * mw + c.k_[0];
+
+      if (c.cross_only_)
+      {
+        double ab = 0.0;
+        for (int x = c.x0_; x < c.x1_; x++)
+        {
+          ab += double(fi_row[x]) * double(mi_row[x]);
+        }
+
+        c.ab_ += ab;
+        continue;
+      }
+
+      const vec2d_t & offset = offsets[c.index_];
+      const bool      skip_y = y < c.ys_;
+
+      const unsigned char * mi_mask_row = mi_mask_direct ? mi_mask_data + std::size_t(v) * mw + c.k_[0] : nullptr;
+
+      double            ab = 0.0;
+      double            aa = 0.0;
+      double            bb = 0.0;
+      double            sa = 0.0;
+      double            sb = 0.0;
+      unsigned long int pixels = 0;
+
+      for (int x = c.x0_; x < c.x1_; x++)
+      {
+        if ((skip_y && x < c.xs_) || !fi_row_mask[x])
+        {
+          continue;
+        }
+
+        if (mi_mask_row)
+        {
+          if (!mi_mask_row[x])
+          {
+            continue;
+          }
+        }
+        else if (mi_mask)
+        {
+          uv[0] = fi_origin[0] + double(x) * fi_sp[0] + offset[0];
+          uv[1] = fi_origin[1] + double(y) * fi_sp[1] + offset[1];
+          if (!pixel_in_mask<mask_t>(mi_mask, uv))
+          {
+            continue;
+          }
+        }
+
+        const double A = fi_row[x];
+        const double B = mi_row[x];
+
+        ab += A * B;
+        aa += A * A;
+        bb += B * B;
+        sa += A;
+        sb += B;
+        pixels++;
+      }
+
+      c.ab_ += ab;
+      c.aa_ += aa;
+      c.bb_ += bb;
+      c.sa_ += sa;
+      c.sb_ += sb;
+      c.pixels_ += pixels;
+    }
+  }
+
+  for (std::size_t j = 0; j < candidates.size(); j++)
+  {
+    const candidate_t & c = candidates[j];
+    if (calc_area(fi_sp, c.pixels_) == 0)
+    {
+      continue;
+    }
+
+    // the tables hold the centered sums of squares already:
+    const double n = double(c.pixels_);
+    const double aa = c.cross_only_ ? c.aa_ : c.aa_ - ((c.sa_ * c.sa_) / n);
+    const double bb = c.cross_only_ ? c.bb_ : c.bb_ - ((c.sb_ * c.sb_) / n);
+    const double ab = c.ab_ - ((c.sa_ * c.sb_) / n);
+
+    metric[c.index_] = -ab / sqrt(aa * bb);
+  }
+}
+
 //----------------------------------------------------------------
 // find_inverse
 //
@@ -35,9 +35,22 @@
 #include <itkInterpolateImageFunction.h>
 #include <itkSingleValuedCostFunction.h>
 #include <itkGradientRecursiveGaussianImageFilter.h>
+#include <itkMersenneTwisterRandomVariateGenerator.h>
 
 // local includes:
 #include "itkIRCommon.h"
+#include "itkLegendrePolynomialTransform.h"
+
+// system includes:
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
 
 /** .
     This class computes the mean pixel variance across several images
@@ -81,6 +94,7 @@ public:
   typedef TInterpolator              interpolator_t;
   typedef TImage                     image_t;
   typedef typename TImage::PixelType pixel_t;
+  typedef typename TImage::IndexType index_t;
 
   /** Constant for the image dimension */
   itkStaticConstMacro(ImageDimension, unsigned int, TImage::ImageDimension);
@@ -172,6 +186,14 @@ public:
   virtual void
   Initialize();
 
+  /** Setup the interpolators and gradients of the current images.
+      Only the images missing from the image cache (or modified since
+      they were cached) are processed, in parallel. Call this after
+      replacing the images, for example when switching pyramid levels.
+  */
+  void
+  update_image_cache();
+
   /** virtual: Get the value for single valued optimizers. */
   measure_t
   GetValue(const params_t & parameters) const
@@ -192,7 +214,34 @@ public:
 
   /** virtual: Get value and derivatives for multiple valued optimizers. */
   void
-  GetValueAndDerivative(const params_t & parameters, measure_t & value, derivative_t & derivative) const;
+  GetValueAndDerivative(const params_t & parameters, measure_t & value, derivative_t & derivative) const
+  {
+    evaluate(parameters, value, derivative, true);
+  }
+
+  /** Get the value over every pixel of the region of interest,
+      regardless of the sub-sampling settings. */
+  measure_t
+  GetFullResolutionValue(const params_t & parameters) const
+  {
+    measure_t    measure;
+    derivative_t derivative;
+    evaluate(parameters, measure, derivative, false);
+    return measure;
+  }
+
+  /** Evaluate the metric and its derivative, either over every pixel
+      of the region of interest or at the stochastic samples. */
+  void
+  evaluate(const params_t & parameters, measure_t & value, derivative_t & derivative, const bool subsample) const;
+
+  /** Discard the current samples, new samples will be drawn for
+      the next evaluation (for example, at the next pyramid level). */
+  void
+  reset_samples() const
+  {
+    sample_t_.clear();
+  }
 
   //----------------------------------------------------------------
   // image_data_t
@@ -208,6 +257,8 @@ public:
       , P_(measure_t(0))
       , dPdx_(measure_t(0))
       , dPdy_(measure_t(0))
+      , J_(nullptr)
+      , dPdp_(nullptr)
     {}
 
     // image id:
@@ -224,8 +275,591 @@ public:
 
     // a pointer to the Jacobian of the transform:
     const jacobian_t * J_;
+
+    // a pointer to the partial derivatives with respect to each of
+    // the transform parameters, J[0][j] * dPdx + J[1][j] * dPdy:
+    const measure_t * dPdp_;
   };
 
+  //----------------------------------------------------------------
+  // jacobian_table_t
+  //
+  // The Jacobian of a Legendre polynomial transform with respect to
+  // its parameters is made up of the products Pj(A) * Qk(B), where A
+  // depends only on the mosaic column and B only on the mosaic row.
+  // The polynomials are tabulated for the columns and rows covered
+  // by a tile, so that the derivatives with respect to the transform
+  // parameters can be evaluated without calling the transform:
+  //
+  class jacobian_table_t
+  {
+  public:
+    jacobian_table_t()
+      : degree_(0)
+      , uc_(0.0)
+      , vc_(0.0)
+      , xmax_(0.0)
+      , ymax_(0.0)
+      , x0_(0)
+      , y0_(0)
+      , cols_(0)
+      , rows_(0)
+    {}
+
+    // tabulate the polynomials for mosaic columns [i0[0], i1[0]) and
+    // rows [i0[1], i1[1]), returns false if the transform is not
+    // a Legendre polynomial transform:
+    bool
+    setup(const transform_t * t, const image_t * mosaic, const index_t & i0, const index_t & i1)
+    {
+      cols_ = 0;
+      rows_ = 0;
+      if (!(setup_legendre<1>(t) || setup_legendre<2>(t) || setup_legendre<3>(t) || setup_legendre<4>(t) ||
+            setup_legendre<5>(t)))
+      {
+        return false;
+      }
+
+      x0_ = i0[0];
+      y0_ = i0[1];
+      cols_ = (unsigned int)(std::max<long>(0, i1[0] - i0[0]));
+      rows_ = (unsigned int)(std::max<long>(0, i1[1] - i0[1]));
+
+      const unsigned int stride = degree_ + 1;
+      P_.resize(cols_ * stride);
+      Q_.resize(rows_ * stride);
+
+      index_t index = i0;
+      pnt2d_t point;
+      for (unsigned int x = 0; x < cols_; x++)
+      {
+        index[0] = x0_ + long(x);
+        mosaic->TransformIndexToPhysicalPoint(index, point);
+
+        const double A = (point[0] - uc_) / xmax_;
+        for (unsigned int j = 0; j <= degree_; j++)
+        {
+          P_[x * stride + j] = Legendre::P[j](A);
+        }
+      }
+
+      index = i0;
+      for (unsigned int y = 0; y < rows_; y++)
+      {
+        index[1] = y0_ + long(y);
+        mosaic->TransformIndexToPhysicalPoint(index, point);
+
+        const double B = (point[1] - vc_) / ymax_;
+        for (unsigned int k = 0; k <= degree_; k++)
+        {
+          Q_[y * stride + k] = Legendre::P[k](B);
+        }
+      }
+
+      return true;
+    }
+
+    // evaluate the derivatives with respect to the transform parameters
+    // at a given mosaic pixel, given the image gradient; returns false
+    // if the pixel is not covered by the table:
+    inline bool
+    eval(const index_t & index, const measure_t dPdx, const measure_t dPdy, measure_t * dPdp) const
+    {
+      const long x = index[0] - x0_;
+      const long y = index[1] - y0_;
+      if (x < 0 || y < 0 || x >= long(cols_) || y >= long(rows_))
+        return false;
+
+      const unsigned int stride = degree_ + 1;
+      const double *     P = &(P_[x * stride]);
+      const double *     Q = &(Q_[y * stride]);
+      const unsigned int n = j_.size();
+      for (unsigned int i = 0; i < n; i++)
+      {
+        const double PjQk = P[j_[i]] * Q[k_[i]];
+        dPdp[i] = xmax_ * PjQk * dPdx;
+        dPdp[n + i] = ymax_ * PjQk * dPdy;
+      }
+
+      return true;
+    }
+
+  private:
+    template <unsigned int N>
+    bool
+    setup_legendre(const transform_t * t)
+    {
+      typedef LegendrePolynomialTransform<typename transform_t::ScalarType, N> legendre_t;
+
+      const legendre_t * legendre = dynamic_cast<const legendre_t *>(t);
+      if (!legendre)
+        return false;
+
+      degree_ = N;
+      uc_ = legendre->GetUc();
+      vc_ = legendre->GetVc();
+      xmax_ = legendre->GetXmax();
+      ymax_ = legendre->GetYmax();
+
+      // polynomial degrees (j, k) of the a_jk coefficients,
+      // in parameter vector order:
+      j_.resize(legendre_t::CoefficientsPerDimension);
+      k_.resize(legendre_t::CoefficientsPerDimension);
+      for (unsigned int i = 0; i <= N; i++)
+      {
+        for (unsigned int j = 0; j <= i; j++)
+        {
+          const unsigned int k = i - j;
+          j_[legendre_t::index_a(j, k)] = j;
+          k_[legendre_t::index_a(j, k)] = k;
+        }
+      }
+
+      return true;
+    }
+
+    // transform degree and fixed parameters:
+    unsigned int degree_;
+    double       uc_;
+    double       vc_;
+    double       xmax_;
+    double       ymax_;
+
+    // polynomial degrees of each coefficient:
+    std::vector<unsigned int> j_;
+    std::vector<unsigned int> k_;
+
+    // tabulated columns and rows:
+    long         x0_;
+    long         y0_;
+    unsigned int cols_;
+    unsigned int rows_;
+
+    // Pj(A) of column x is P_[x * (degree_ + 1) + j],
+    // Qk(B) of row y is Q_[y * (degree_ + 1) + k]:
+    std::vector<double> P_;
+    std::vector<double> Q_;
+  };
+
+  //----------------------------------------------------------------
+  // overlap_spans_t
+  //
+  // Spans of mosaic rows where two or more tile bounding boxes overlap,
+  // the only places where the metric is not trivially zero. The spans
+  // are computed from the bounding boxes padded by a tolerance (and a
+  // pixel), so they remain valid -- a superset of the overlap -- until
+  // one of the bounding boxes moves by more than the tolerance:
+  //
+  class overlap_spans_t
+  {
+  public:
+    overlap_spans_t()
+      : tolerance_(0.0)
+      , y0_(0.0)
+      , dy_(1.0)
+      , rows_(0)
+    {}
+
+    // check whether the spans still cover the overlap
+    // of the given bounding boxes:
+    bool
+    valid(const std::vector<pnt2d_t> & min, const std::vector<pnt2d_t> & max) const
+    {
+      if (min.size() != min_.size() || max.size() != max_.size())
+        return false;
+
+      for (unsigned int k = 0; k < min.size(); k++)
+      {
+        for (unsigned int j = 0; j < 2; j++)
+        {
+          if (std::fabs(min[k][j] - min_[k][j]) > tolerance_ || std::fabs(max[k][j] - max_[k][j]) > tolerance_)
+            return false;
+        }
+      }
+
+      return true;
+    }
+
+    void
+    setup(const std::vector<pnt2d_t> & min,
+          const std::vector<pnt2d_t> & max,
+          const double                 pixel_spacing,
+          const double                 tolerance)
+    {
+      const unsigned int num_tiles = min.size();
+      min_ = min;
+      max_ = max;
+      tolerance_ = tolerance;
+
+      rows_ = 0;
+      first_.assign(1, 0);
+      spans_.clear();
+      if (num_tiles == 0)
+        return;
+
+      // padded bounding boxes:
+      const double                                 pad = tolerance + pixel_spacing;
+      std::vector<pnt2d_t>                         lo(num_tiles);
+      std::vector<pnt2d_t>                         hi(num_tiles);
+      std::vector<std::pair<double, unsigned int>> by_top(num_tiles);
+
+      double y1 = -std::numeric_limits<double>::max();
+      y0_ = std::numeric_limits<double>::max();
+      for (unsigned int k = 0; k < num_tiles; k++)
+      {
+        lo[k] = pnt2d(min[k][0] - pad, min[k][1] - pad);
+        hi[k] = pnt2d(max[k][0] + pad, max[k][1] + pad);
+        by_top[k] = std::pair<double, unsigned int>(lo[k][1], k);
+        y0_ = std::min(y0_, lo[k][1]);
+        y1 = std::max(y1, hi[k][1]);
+      }
+      std::sort(by_top.begin(), by_top.end());
+
+      dy_ = pixel_spacing;
+      rows_ = (unsigned int)(std::ceil((y1 - y0_) / dy_)) + 1;
+      first_.assign(rows_ + 1, 0);
+
+      // sweep the rows, keep track of the boxes that cross the row:
+      std::list<unsigned int>             active;
+      std::vector<std::pair<double, int>> events;
+      unsigned int                        next = 0;
+      for (unsigned int r = 0; r < rows_; r++)
+      {
+        const double y = y0_ + double(r) * dy_;
+        for (; next < num_tiles && by_top[next].first <= y; next++)
+        {
+          active.push_back(by_top[next].second);
+        }
+
+        events.clear();
+        for (std::list<unsigned int>::iterator i = active.begin(); i != active.end();)
+        {
+          const unsigned int k = *i;
+          if (hi[k][1] < y)
+          {
+            i = active.erase(i);
+            continue;
+          }
+
+          // box starts are sorted ahead of box ends at the same x:
+          events.push_back(std::pair<double, int>(lo[k][0], -1));
+          events.push_back(std::pair<double, int>(hi[k][0], 1));
+          ++i;
+        }
+        std::sort(events.begin(), events.end());
+
+        int    depth = 0;
+        double start = 0.0;
+        for (unsigned int i = 0; i < events.size(); i++)
+        {
+          const int prev = depth;
+          depth -= events[i].second;
+          if (prev < 2 && depth >= 2)
+          {
+            start = events[i].first;
+          }
+          else if (prev >= 2 && depth < 2)
+          {
+            spans_.push_back(pnt2d(start, events[i].first));
+          }
+        }
+
+        first_[r + 1] = spans_.size();
+      }
+    }
+
+    // the spans [x0, x1] of the row nearest to a given mosaic y
+    // coordinate, returns the number of spans:
+    inline unsigned int
+    lookup(const double y, const pnt2d_t *& spans) const
+    {
+      const double r = std::floor((y - y0_) / dy_ + 0.5);
+      if (r < 0.0 || r >= double(rows_))
+        return 0;
+
+      const unsigned int row = (unsigned int)r;
+      spans = spans_.empty() ? nullptr : &(spans_[0]) + first_[row];
+      return first_[row + 1] - first_[row];
+    }
+
+  private:
+    // the bounding boxes the spans were computed for:
+    std::vector<pnt2d_t> min_;
+    std::vector<pnt2d_t> max_;
+    double               tolerance_;
+
+    // rows are spaced dy_ apart, starting at y0_:
+    double       y0_;
+    double       dy_;
+    unsigned int rows_;
+
+    // spans of row i are spans_[first_[i]] ... spans_[first_[i + 1] - 1]:
+    std::vector<unsigned int> first_;
+    std::vector<pnt2d_t>      spans_;
+  };
+
+  //----------------------------------------------------------------
+  // image_cache_t
+  //
+  // Interpolators and gradients of the mosaic tile images, keyed by
+  // the image and its modification time. A cache may outlive the
+  // metric and be shared by several metrics, so that the gradients of
+  // every level of an image pyramid are calculated only once:
+  //
+  class image_cache_t
+  {
+  public:
+    //----------------------------------------------------------------
+    // entry_t
+    //
+    class entry_t
+    {
+    public:
+      entry_t()
+        : mtime_(0)
+      {}
+
+      // the image is retained, so that its address can not be reused
+      // by a different image while it is cached:
+      typename image_t::ConstPointer          image_;
+      ModifiedTimeType                        mtime_;
+      typename interpolator_t::Pointer        interpolator_;
+      typename gradient_image_t::ConstPointer gradient_;
+    };
+
+    // lookup the entry of an image, returns nullptr if the image
+    // is not cached or has been modified since it was cached:
+    const entry_t *
+    find(const image_t * image) const
+    {
+      typename std::map<const image_t *, entry_t>::const_iterator found = entries_.find(image);
+      if (found == entries_.end() || found->second.mtime_ != image->GetMTime())
+        return nullptr;
+
+      return &(found->second);
+    }
+
+    // add a blank entry for an image, replacing a stale entry;
+    // the entry address remains valid until the cache is cleared:
+    entry_t &
+    insert(const image_t * image)
+    {
+      entry_t & entry = entries_[image];
+      entry = entry_t();
+      entry.image_ = image;
+      entry.mtime_ = image->GetMTime();
+      return entry;
+    }
+
+    void
+    clear()
+    {
+      entries_.clear();
+    }
+
+    // accessors:
+    std::size_t
+    size() const
+    {
+      return entries_.size();
+    }
+
+    // memory used by the cached gradient images:
+    std::size_t
+    size_in_bytes() const
+    {
+      std::size_t bytes = 0;
+      for (typename std::map<const image_t *, entry_t>::const_iterator i = entries_.begin(); i != entries_.end(); ++i)
+      {
+        const gradient_image_t * gradient = i->second.gradient_.GetPointer();
+        if (gradient)
+        {
+          bytes += gradient->GetBufferedRegion().GetNumberOfPixels() * sizeof(gradient_pixel_t);
+        }
+      }
+
+      return bytes;
+    }
+
+  private:
+    std::map<const image_t *, entry_t> entries_;
+  };
+
+  typedef std::shared_ptr<image_cache_t> image_cache_ptr_t;
+
+  //----------------------------------------------------------------
+  // gradient_transaction_t
+  //
+  // Calculates the gradients of every stride-th image of a list
+  // of cache entries, starting with the given offset:
+  //
+  class gradient_transaction_t : public the_transaction_t
+  {
+  public:
+    gradient_transaction_t(const unsigned int                                    offset,
+                           const unsigned int                                    stride,
+                           const std::vector<typename image_cache_t::entry_t *> & entries)
+      : offset_(offset)
+      , stride_(stride)
+      , entries_(entries)
+    {}
+
+    // virtual:
+    void
+    execute(the_thread_interface_t * thread)
+    {
+      WRAP(itk_terminator_t terminator("ImageMosaicVarianceMetric::gradient_transaction_t"));
+
+      const unsigned int num_entries = entries_.size();
+      for (unsigned int i = offset_; i < num_entries; i += stride_)
+      {
+        // make sure there hasn't been an interrupt:
+        WRAP(terminator.terminate_on_request());
+
+        typename image_cache_t::entry_t & entry = *(entries_[i]);
+        entry.gradient_ = calc_gradient(entry.image_);
+      }
+    }
+
+  private:
+    const unsigned int                                    offset_;
+    const unsigned int                                    stride_;
+    const std::vector<typename image_cache_t::entry_t *> & entries_;
+  };
+
+  // calculate the gradient image of a mosaic tile:
+  static typename gradient_image_t::ConstPointer
+  calc_gradient(const image_t * image);
+
+  //----------------------------------------------------------------
+  // accumulator_t
+  //
+  // Partial sums of the metric, its derivative and the overlapping
+  // pixel count over one stripe of the mosaic region of interest:
+  //
+  class accumulator_t
+  {
+  public:
+    accumulator_t()
+      : measure_(measure_t(0))
+      , pixels_(0)
+    {}
+
+    measure_t              measure_;
+    std::vector<measure_t> derivative_;
+    unsigned long          pixels_;
+  };
+
+  //----------------------------------------------------------------
+  // stripes_transaction_t
+  //
+  // Evaluates every stride-th stripe of the mosaic region of interest,
+  // starting with the given offset. The stripes are independent, each
+  // has its own accumulator:
+  //
+  class stripes_transaction_t : public the_transaction_t
+  {
+  public:
+    stripes_transaction_t(const Self *                          metric,
+                          const unsigned int                    offset,
+                          const unsigned int                    stride,
+                          const image_t *                       mosaic,
+                          const typename image_t::RegionType &  roi,
+                          const std::vector<pnt2d_t> &          min,
+                          const std::vector<pnt2d_t> &          max,
+                          const tile_bins_t &                   bins,
+                          const overlap_spans_t *               spans,
+                          const std::vector<jacobian_table_t> * tables,
+                          const std::vector<index_t> *          samples,
+                          std::vector<accumulator_t> &          stripes)
+      : metric_(metric)
+      , offset_(offset)
+      , stride_(stride)
+      , mosaic_(mosaic)
+      , roi_(roi)
+      , min_(min)
+      , max_(max)
+      , bins_(bins)
+      , spans_(spans)
+      , tables_(tables)
+      , samples_(samples)
+      , stripes_(stripes)
+    {}
+
+    // virtual:
+    void
+    execute(the_thread_interface_t * thread)
+    {
+      WRAP(itk_terminator_t terminator("ImageMosaicVarianceMetric::stripes_transaction_t"));
+
+      const unsigned int num_stripes = stripes_.size();
+      for (unsigned int i = offset_; i < num_stripes; i += stride_)
+      {
+        metric_->evaluate_stripe(
+          mosaic_, roi_, i, num_stripes, min_, max_, bins_, spans_, tables_, samples_, stripes_[i]);
+      }
+    }
+
+  private:
+    const Self *                          metric_;
+    const unsigned int                    offset_;
+    const unsigned int                    stride_;
+    const image_t *                       mosaic_;
+    const typename image_t::RegionType    roi_;
+    const std::vector<pnt2d_t> &          min_;
+    const std::vector<pnt2d_t> &          max_;
+    const tile_bins_t &                   bins_;
+    const overlap_spans_t *               spans_;
+    const std::vector<jacobian_table_t> * tables_;
+    const std::vector<index_t> *          samples_;
+    std::vector<accumulator_t> &          stripes_;
+  };
+
+  //----------------------------------------------------------------
+  // run_t
+  //
+  // A run of mosaic pixels [x0_, x1_) of row y_:
+  //
+  class run_t
+  {
+  public:
+    long y_;
+    long x0_;
+    long x1_;
+  };
+
+  // collect the runs of mosaic pixels of rows [y0, y1) of the region
+  // of interest, either whole rows or the overlap spans of each row:
+  void
+  collect_runs(const image_t *                      mosaic,
+               const typename image_t::RegionType & roi,
+               const unsigned int                   y0,
+               const unsigned int                   y1,
+               const overlap_spans_t *              spans,
+               std::vector<run_t> &                 runs) const;
+
+  // evaluate the metric and its derivative over one stripe
+  // of the mosaic region of interest -- only within the overlap
+  // spans when given, or only at the samples within the stripe
+  // when samples are given; the tabulated Jacobians are used
+  // where available:
+  void
+  evaluate_stripe(const image_t *                       mosaic,
+                  const typename image_t::RegionType &  roi,
+                  const unsigned int                    stripe,
+                  const unsigned int                    num_stripes,
+                  const std::vector<pnt2d_t> &          min,
+                  const std::vector<pnt2d_t> &          max,
+                  const tile_bins_t &                   bins,
+                  const overlap_spans_t *               spans,
+                  const std::vector<jacobian_table_t> * tables,
+                  const std::vector<index_t> *          samples,
+                  accumulator_t &                       accumulator) const;
+
+  // draw a new set of stratified samples:
+  void
+  draw_samples() const;
+
   // calculate the bounding box for a given set of image bounding boxes:
   void
   CalcMosaicBBox(point_t &              mosaic_min,
@@ -272,6 +906,10 @@ public:
   // image gradients:
   std::vector<typename gradient_image_t::ConstPointer> gradient_;
 
+  // the interpolators and gradients of the images seen so far,
+  // may be shared with other metrics:
+  image_cache_ptr_t image_cache_;
+
   // adresses of the individual transform parameter indices within the
   // concatenated parameter vector:
   std::vector<std::vector<unsigned int>> address_;
@@ -284,11 +922,46 @@ public:
   // active and will be included into the metric parameter vector:
   std::vector<bool> param_active_;
 
+  // number of threads used to evaluate the metric, the result
+  // does not depend on the number of threads:
+  unsigned int num_threads_;
+
+  // stochastic sub-sampling: unless num_samples_ is zero the metric
+  // and its derivative are evaluated at num_samples_ pixels of the
+  // overlap spans within the region of interest, one random pixel in
+  // each of num_samples_ equal parts of the total span length
+  // (stratified sampling). The samples come from a generator seeded
+  // with sample_seed_, and are either drawn anew for every evaluation
+  // or kept until reset_samples is called:
+  unsigned int num_samples_;
+  unsigned int sample_seed_;
+  bool         resample_per_iteration_;
+
+  // restrict the evaluation to the cached spans where the tile
+  // bounding boxes overlap; the spans are recomputed once a bounding
+  // box moves by more than span_tolerance_ pixels:
+  bool   use_overlap_spans_;
+  double span_tolerance_;
+
+  // tabulate the Jacobians of Legendre polynomial transforms, instead
+  // of calling the transform for every pixel of every tile; the
+  // Jacobians of other transforms are always calculated per pixel:
+  bool use_jacobian_tables_;
+
 protected:
   ImageMosaicVarianceMetric()
-    : n_shared_(0)
+    : image_cache_(new image_cache_t())
+    , n_shared_(0)
     , n_unique_(0)
     , param_active_(0)
+    , num_threads_(std::max(1u, std::thread::hardware_concurrency()))
+    , num_samples_(0)
+    , sample_seed_(0)
+    , resample_per_iteration_(true)
+    , use_overlap_spans_(true)
+    , span_tolerance_(4.0)
+    , use_jacobian_tables_(false)
+    , sample_draws_(0)
     , m_NumberOfPixelsCounted(0)
   {}
 
@@ -298,6 +971,16 @@ protected:
   void
   PrintSelf(std::ostream & os, Indent indent) const;
 
+  // current samples, positions along the overlap runs
+  // normalized by the total length of the runs:
+  mutable std::vector<double> sample_t_;
+
+  // number of sample sets drawn so far:
+  mutable unsigned int sample_draws_;
+
+  // cached overlap spans:
+  mutable overlap_spans_t overlap_spans_;
+
   // number of pixels in the overlapping regions of the mosaic:
   mutable unsigned long m_NumberOfPixelsCounted;
 
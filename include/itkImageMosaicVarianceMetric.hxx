@@ -210,56 +210,143 @@ ImageMosaicVarianceMetric<TImage, TInterpolator>::Initialize()
   }
 
   // setup the interpolators, calculate the gradient images:
-  interpolator_.resize(num_transforms);
-  gradient_.resize(num_transforms);
-  for (unsigned int i = 0; i < num_transforms; i++)
+  update_image_cache();
+
+  // If there are any observers on the metric, call them to give the
+  // user code a chance to set parameters on the metric:
+  this->InvokeEvent(InitializeEvent());
+}
+
+//----------------------------------------------------------------
+// update_image_cache
+//
+template <class TImage, class TInterpolator>
+void
+ImageMosaicVarianceMetric<TImage, TInterpolator>::update_image_cache()
+{
+  const unsigned int num_images = image_.size();
+  if (!image_cache_)
+  {
+    image_cache_.reset(new image_cache_t());
+  }
+
+  // find the images that are not cached yet:
+  std::vector<typename image_cache_t::entry_t *> missing;
+  for (unsigned int i = 0; i < num_images; i++)
   {
-    interpolator_[i] = interpolator_t::New();
-    interpolator_[i]->SetInputImage(image_[i]);
+    const image_t * image = image_[i].GetPointer();
+    if (!image)
+    {
+      itkExceptionMacro(<< "One of the images is missing");
+    }
 
-    // calculate the image gradient:
-    typename gradient_filter_t::Pointer gradient_filter = gradient_filter_t::New();
-    gradient_filter->SetInput(image_[i]);
+    if (image_cache_->find(image))
+      continue;
 
-    const typename image_t::SpacingType & spacing = image_[i]->GetSpacing();
-    double                                maximum_spacing = 0.0;
-    for (unsigned int j = 0; j < ImageDimension; j++)
+    if (image->GetSource())
     {
-      maximum_spacing = std::max(maximum_spacing, spacing[j]);
+      // if the image is provided by a source, update the source:
+      image->GetSource()->Update();
     }
 
-    gradient_filter->SetSigma(maximum_spacing);
-    gradient_filter->SetNormalizeAcrossScale(true);
+    typename image_cache_t::entry_t & entry = image_cache_->insert(image);
+    entry.interpolator_ = interpolator_t::New();
+    entry.interpolator_->SetInputImage(image);
+    missing.push_back(&entry);
+  }
 
-    try
+  // calculate the missing gradients:
+  const unsigned int num_threads = std::min<unsigned int>(std::max(1u, num_threads_), missing.size());
+  if (num_threads == 1)
+  {
+    for (unsigned int i = 0; i < missing.size(); i++)
     {
-      gradient_filter->Update();
+      missing[i]->gradient_ = calc_gradient(missing[i]->image_);
     }
-    catch (itk::ExceptionObject & exception)
+  }
+  else if (num_threads > 1)
+  {
+    std::list<the_transaction_t *> schedule;
+    for (unsigned int i = 0; i < num_threads; i++)
     {
-      // oops:
-      cerr << "gradient filter threw an exception:" << endl << exception << endl;
-      throw exception;
+      schedule.push_back(new gradient_transaction_t(i, num_threads, missing));
     }
 
-    gradient_[i] = gradient_filter->GetOutput();
+    the_thread_pool_t thread_pool(num_threads);
+    thread_pool.set_idle_sleep_duration(50); // 50 usec
+    thread_pool.push_back(schedule);
+    thread_pool.pre_distribute_work();
+
+    suspend_itk_multithreading_t suspend_itk_mt;
+    thread_pool.start();
+    thread_pool.wait();
   }
 
-  // If there are any observers on the metric, call them to give the
-  // user code a chance to set parameters on the metric:
-  this->InvokeEvent(InitializeEvent());
+  // make sure all gradients have been calculated:
+  for (unsigned int i = 0; i < missing.size(); i++)
+  {
+    if (!missing[i]->gradient_)
+    {
+      itkExceptionMacro(<< "failed to calculate an image gradient");
+    }
+  }
+
+  // use the cached interpolators and gradients:
+  interpolator_.resize(num_images);
+  gradient_.resize(num_images);
+  for (unsigned int i = 0; i < num_images; i++)
+  {
+    const typename image_cache_t::entry_t * entry = image_cache_->find(image_[i]);
+    interpolator_[i] = entry->interpolator_;
+    gradient_[i] = entry->gradient_;
+  }
+}
+
+//----------------------------------------------------------------
+// calc_gradient
+//
+template <class TImage, class TInterpolator>
+typename ImageMosaicVarianceMetric<TImage, TInterpolator>::gradient_image_t::ConstPointer
+ImageMosaicVarianceMetric<TImage, TInterpolator>::calc_gradient(const image_t * image)
+{
+  typename gradient_filter_t::Pointer gradient_filter = gradient_filter_t::New();
+  gradient_filter->SetInput(image);
+
+  const typename image_t::SpacingType & spacing = image->GetSpacing();
+  double                                maximum_spacing = 0.0;
+  for (unsigned int j = 0; j < ImageDimension; j++)
+  {
+    maximum_spacing = std::max(maximum_spacing, spacing[j]);
+  }
+
+  gradient_filter->SetSigma(maximum_spacing);
+  gradient_filter->SetNormalizeAcrossScale(true);
+
+  try
+  {
+    gradient_filter->Update();
+  }
+  catch (itk::ExceptionObject & exception)
+  {
+    // oops:
+    cerr << "gradient filter threw an exception:" << endl << exception << endl;
+    return nullptr;
+  }
+
+  return gradient_filter->GetOutput();
 }
 
 //----------------------------------------------------------------
-// GetValueAndDerivative
+// evaluate
 //
 // FIXME: the following code assumes a 2D mosaic:
 //
 template <class TImage, class TInterpolator>
 void
-ImageMosaicVarianceMetric<TImage, TInterpolator>::GetValueAndDerivative(const params_t & parameters,
-                                                                        measure_t &      measure,
-                                                                        derivative_t &   derivative) const
+ImageMosaicVarianceMetric<TImage, TInterpolator>::evaluate(const params_t & parameters,
+                                                           measure_t &      measure,
+                                                           derivative_t &   derivative,
+                                                           const bool       subsample) const
 {
   WRAP(itk_terminator_t terminator("ImageMosaicVarianceMetric::GetValueAndDerivative"));
 
@@ -354,166 +441,159 @@ ImageMosaicVarianceMetric<TImage, TInterpolator>::GetValueAndDerivative(const pa
   mosaic->SetSpacing(spacing);
   mosaic->SetOrigin(pnt2d(mosaic_min[0], mosaic_min[1]));
 
-  // reset the accumulators:
-  derivative = derivative_t(n_concat);
-  derivative.Fill(NumericTraits<typename derivative_t::ValueType>::Zero);
-  measure = NumericTraits<measure_t>::Zero;
-  m_NumberOfPixelsCounted = 0;
+  // bin the tiles, so that each mosaic pixel is only tested
+  // against the tiles that may overlap it:
+  tile_bins_t bins;
+  bins.setup(min, max);
 
-  // pre-allocate and initialize image data for each image:
-  std::vector<image_data_t> image_data(num_images);
-  for (unsigned int i = 0; i < num_images; i++)
+  // visit only the mosaic pixels where the tiles may overlap,
+  // the stochastic samples are always drawn from there:
+  const bool sample_spans = subsample && num_samples_ > 0;
+  if ((use_overlap_spans_ || sample_spans) && !overlap_spans_.valid(min, max))
   {
-    image_data[i].id_ = i;
+    const double pixel_spacing = std::max(spacing[0], spacing[1]);
+    overlap_spans_.setup(min, max, pixel_spacing, span_tolerance_ * pixel_spacing);
   }
 
-  // preallocate derivatives of the mean and variance:
-  std::vector<measure_t> dMu(n_concat);
-  std::vector<measure_t> dV(n_concat);
-
-  // iterate over the mosaic, evaluate the metric in the overlapping regions:
-  typedef itk::ImageRegionConstIteratorWithIndex<image_t> itex_t;
-  // bool FIXME_FIRST_RUN = true;
-  itex_t itex(mosaic, ROI);
-  for (itex.GoToBegin(); !itex.IsAtEnd(); ++itex)
+  // map the stochastic samples onto the overlap runs of the region
+  // of interest, so that every sample is a potential overlap pixel:
+  std::vector<index_t> samples;
+  bool                 use_samples = false;
+  if (sample_spans)
   {
-    // make sure there hasn't been an interrupt:
-    WRAP(terminator.terminate_on_request());
+    std::vector<run_t> runs;
+    collect_runs(mosaic, ROI, 0, ROI.GetSize()[1], &overlap_spans_, runs);
 
-    pnt2d_t point;
-    mosaic->TransformIndexToPhysicalPoint(itex.GetIndex(), point);
-
-    // find pixels in overlapping regions of the mosaic:
-    std::list<const image_data_t *> overlap;
-    for (unsigned int k = 0; k < num_images; k++)
+    // cumulative run lengths:
+    std::vector<double> length(runs.size() + 1, 0.0);
+    for (std::size_t i = 0; i < runs.size(); i++)
     {
-      if (point[0] < min[k][0] || point[0] > max[k][0] || point[1] < min[k][1] || point[1] > max[k][1])
-        continue;
+      length[i + 1] = length[i] + double(runs[i].x1_ - runs[i].x0_);
+    }
 
-      typename transform_t::Pointer & t = transform_[k];
-      pnt2d_t                         pt_k = t->TransformPoint(point);
-      index_t                         index;
-      // make sure the pixel maps into the image:
-      image_[k]->TransformPhysicalPointToIndex(pt_k, index);
-      if (!interpolator_[k]->IsInsideBuffer(pt_k))
-        continue;
+    // there is no point sub-sampling a small overlap:
+    use_samples = length.back() > double(num_samples_);
+    if (use_samples)
+    {
+      if (resample_per_iteration_ || sample_t_.empty())
+      {
+        draw_samples();
+      }
 
-      // make sure the pixel maps into the mask:
-      if (mask_[k].GetPointer() && mask_[k]->GetPixel(index) == 0)
-        continue;
+      samples.resize(sample_t_.size());
+      for (std::size_t i = 0; i < sample_t_.size(); i++)
+      {
+        const double      t = sample_t_[i] * length.back();
+        const std::size_t k = std::upper_bound(length.begin() + 1, length.end(), t) - (length.begin() + 1);
+        const std::size_t j = std::min(k, runs.size() - 1);
+        const run_t &     run = runs[j];
 
-      // shortcut:
-      image_data_t & data = image_data[k];
+        samples[i][0] = std::min(run.x1_ - 1, run.x0_ + long(t - length[j]));
+        samples[i][1] = run.y_;
+      }
+    }
+  }
 
-      // get the image value:
-      // data.P_ = image_[k]->GetPixel(index); // faster
-      data.P_ = interpolator_[k]->Evaluate(pt_k); // slower
+  const bool use_spans = use_overlap_spans_ && !use_samples;
 
-      // get the image gradient:
-      const gradient_pixel_t & gradient = gradient_[k]->GetPixel(index);
-      data.dPdx_ = gradient[0];
-      data.dPdy_ = gradient[1];
+  // tabulate the Jacobians of the tile transforms over
+  // the tile bounding boxes:
+  std::vector<jacobian_table_t> tables;
+  if (use_jacobian_tables_)
+  {
+    tables.resize(num_images);
 
-      // get the transform Jacobian:
-      data.J_ = &(t->GetJacobian(point));
+    const index_t &   roi_index = ROI.GetIndex();
+    const imagesz_t & roi_size = ROI.GetSize();
+    for (unsigned int k = 0; k < num_images; k++)
+    {
+      index_t i0;
+      index_t i1;
+      for (unsigned int j = 0; j < 2; j++)
+      {
+        const double a = std::floor((min[k][j] - mosaic_min[j]) / spacing[j]);
+        const double b = std::ceil((max[k][j] - mosaic_min[j]) / spacing[j]) + 1.0;
+        i0[j] = std::max(roi_index[j], long(a));
+        i1[j] = std::min(roi_index[j] + long(roi_size[j]), long(b));
+      }
 
-      // add to the list:
-      overlap.push_back(&data);
+      tables[k].setup(transform_[k], mosaic, i0, i1);
     }
+  }
 
-    // skip over the regions that do not overlap:
-    if (overlap.size() < 2)
-      continue;
-
-    // found a pixel in an overlapping region, increment the counter:
-    m_NumberOfPixelsCounted++;
-
-    // shortcut:
-    measure_t normalization_factor = measure_t(1) / measure_t(overlap.size());
+  // split the region of interest into stripes of rows, the stripe
+  // layout does not depend on the number of threads:
+  const unsigned int num_stripes = std::min<unsigned int>(ROI.GetSize()[1], 64);
+  std::vector<accumulator_t> stripes(num_stripes);
 
-    // calculate the mean and derivative of the mean:
-    measure_t Mu = measure_t(0);
-    dMu.assign(n_concat, measure_t(0));
-    for (typename std::list<const image_data_t *>::const_iterator i = overlap.begin(); i != overlap.end(); ++i)
+  const unsigned int num_threads = std::max(1u, std::min(num_threads_, num_stripes));
+  if (num_threads == 1)
+  {
+    for (unsigned int i = 0; i < num_stripes; i++)
     {
-      const image_data_t & data = *(*i);
-      const unsigned int * addr = &(address_[data.id_][0]);
-      const jacobian_t &   J = *(data.J_);
-
-      Mu += data.P_;
-
-      for (unsigned int j = 0; j < n_params; j++)
-      {
-        dMu[addr[j]] += (J[0][j] * data.dPdx_ + J[1][j] * data.dPdy_) * normalization_factor;
-      }
+      evaluate_stripe(mosaic,
+                      ROI,
+                      i,
+                      num_stripes,
+                      min,
+                      max,
+                      bins,
+                      use_spans ? &overlap_spans_ : nullptr,
+                      use_jacobian_tables_ ? &tables : nullptr,
+                      use_samples ? &samples : nullptr,
+                      stripes[i]);
     }
-    Mu *= normalization_factor;
-#if 1
-    // normalize the shared portion of dMu:
-    for (unsigned int i = 0; i < n_shared_; i++)
+  }
+  else
+  {
+    std::list<the_transaction_t *> schedule;
+    for (unsigned int i = 0; i < num_threads; i++)
     {
-      dMu[i] *= normalization_factor;
+      schedule.push_back(new stripes_transaction_t(this,
+                                                   i,
+                                                   num_threads,
+                                                   mosaic,
+                                                   ROI,
+                                                   min,
+                                                   max,
+                                                   bins,
+                                                   use_spans ? &overlap_spans_ : nullptr,
+                                                   use_jacobian_tables_ ? &tables : nullptr,
+                                                   use_samples ? &samples : nullptr,
+                                                   stripes));
     }
-#endif
 
-    // calculate the variance:
-    measure_t V = measure_t(0);
-    dV.assign(n_concat, measure_t(0));
-    for (typename std::list<const image_data_t *>::const_iterator i = overlap.begin(); i != overlap.end(); ++i)
-    {
-      const image_data_t & data = *(*i);
-      const unsigned int * addr = &(address_[data.id_][0]);
-      const jacobian_t &   J = *(data.J_);
+    the_thread_pool_t thread_pool(num_threads);
+    thread_pool.set_idle_sleep_duration(50); // 50 usec
+    thread_pool.push_back(schedule);
+    thread_pool.pre_distribute_work();
 
-      measure_t d = data.P_ - Mu;
-      V += d * d;
+    suspend_itk_multithreading_t suspend_itk_mt;
+    thread_pool.start();
+    thread_pool.wait();
+  }
 
-      for (unsigned int j = 0; j < n_params; j++)
-      {
-        dV[addr[j]] +=
-          measure_t(2) * d * (J[0][j] * data.dPdx_ + J[1][j] * data.dPdy_ - dMu[addr[j]]) * normalization_factor;
-      }
-    }
-    V *= normalization_factor;
-#if 1
-    // normalize the shared portion of dV:
-    for (unsigned int i = 0; i < n_shared_; i++)
-    {
-      dV[i] *= normalization_factor;
-    }
-#endif
+  // make sure there hasn't been an interrupt:
+  WRAP(terminator.terminate_on_request());
 
-#if 0
-    if (FIXME_FIRST_RUN && overlap.size() > 2)
-    {
-      FIXME_FIRST_RUN = false;
-      for (typename std::list<const image_data_t *>::const_iterator
-	     i = overlap.begin(); i != overlap.end(); ++i)
-      {
-	const image_data_t & data = *(*i);
-	const unsigned int * addr = &(address_[data.id_][0]);
-	const jacobian_t & J = *(data.J_);
-	
-	for (unsigned int k = 0; k < 2; k++)
-	{
-	  cout << "J[" << k << "] =";
-	  for (unsigned int j = 0; j < n_params; j++)
-	  {
-	    cout << ' ' << J[k][j];
-	  }
-	  cout << endl;
-	}
-	cout << endl;
-      }
-    }
-#endif
-    // update the measure:
-    measure += V;
+  // reduce the stripes in order:
+  derivative = derivative_t(n_concat);
+  derivative.Fill(NumericTraits<typename derivative_t::ValueType>::Zero);
+  measure = NumericTraits<measure_t>::Zero;
+  m_NumberOfPixelsCounted = 0;
 
-    // update the derivative:
-    for (unsigned int i = 0; i < n_concat; i++)
+  for (unsigned int i = 0; i < num_stripes; i++)
+  {
+    const accumulator_t & stripe = stripes[i];
+    if (stripe.pixels_ == 0)
+      continue;
+
+    measure += stripe.measure_;
+    m_NumberOfPixelsCounted += stripe.pixels_;
+
+    for (unsigned int j = 0; j < n_concat; j++)
     {
-      derivative[i] += dV[i];
+      derivative[j] += stripe.derivative_[j];
     }
   }
 
@@ -545,6 +625,296 @@ ImageMosaicVarianceMetric<TImage, TInterpolator>::GetValueAndDerivative(const pa
 #endif
 }
 
+//----------------------------------------------------------------
+// evaluate_stripe
+//
+// FIXME: the following code assumes a 2D mosaic:
+//
+template <class TImage, class TInterpolator>
+void
+ImageMosaicVarianceMetric<TImage, TInterpolator>::evaluate_stripe(
+  const image_t *                       mosaic,
+  const typename image_t::RegionType &  roi,
+  const unsigned int                    stripe,
+  const unsigned int                    num_stripes,
+  const std::vector<pnt2d_t> &          min,
+  const std::vector<pnt2d_t> &          max,
+  const tile_bins_t &                   bins,
+  const overlap_spans_t *               spans,
+  const std::vector<jacobian_table_t> * tables,
+  const std::vector<index_t> *          samples,
+  accumulator_t &                       accumulator) const
+{
+  WRAP(itk_terminator_t terminator("ImageMosaicVarianceMetric::evaluate_stripe"));
+
+  // shortcuts:
+  const unsigned int num_images = interpolator_.size();
+  const unsigned int n_params = param_active_.size();
+  const unsigned int n_concat = GetNumberOfParameters();
+
+  // the rows of this stripe:
+  const unsigned int rows = roi.GetSize()[1];
+  const unsigned int y0 = (unsigned int)(std::size_t(rows) * stripe / num_stripes);
+  const unsigned int y1 = (unsigned int)(std::size_t(rows) * (stripe + 1) / num_stripes);
+
+  accumulator.measure_ = measure_t(0);
+  accumulator.derivative_.assign(n_concat, measure_t(0));
+  accumulator.pixels_ = 0;
+  if (y1 <= y0)
+    return;
+
+  // the runs of mosaic pixels to visit:
+  std::vector<run_t> runs;
+  if (samples)
+  {
+    const index_t & roi_index = roi.GetIndex();
+
+    // the samples within this stripe:
+    for (std::size_t i = 0; i < samples->size(); i++)
+    {
+      const index_t & sample = (*samples)[i];
+      const long      y = sample[1] - roi_index[1];
+      if (y < long(y0) || y >= long(y1))
+        continue;
+
+      const run_t run = { sample[1], sample[0], sample[0] + 1 };
+      runs.push_back(run);
+    }
+  }
+  else
+  {
+    collect_runs(mosaic, roi, y0, y1, spans, runs);
+  }
+
+  // pre-allocate and initialize image data for each image:
+  std::vector<image_data_t>           image_data(num_images);
+  std::vector<jacobian_t>             jacobian(num_images);
+  std::vector<std::vector<measure_t>> dPdp(num_images, std::vector<measure_t>(n_params));
+  for (unsigned int i = 0; i < num_images; i++)
+  {
+    // not every transform sizes the Jacobian it is given:
+    jacobian[i].SetSize(ImageDimension, transform_[i]->GetNumberOfParameters());
+    jacobian[i].Fill(0.0);
+
+    image_data[i].id_ = i;
+    image_data[i].J_ = &(jacobian[i]);
+    image_data[i].dPdp_ = &(dPdp[i][0]);
+  }
+
+  // preallocate derivatives of the mean and variance:
+  std::vector<measure_t> dMu(n_concat);
+  std::vector<measure_t> dV(n_concat);
+
+  // pixels in the overlapping regions of the mosaic:
+  std::vector<const image_data_t *> overlap;
+  overlap.reserve(num_images);
+
+  // shortcuts:
+  measure_t &              measure = accumulator.measure_;
+  std::vector<measure_t> & derivative = accumulator.derivative_;
+
+  // iterate over the mosaic, evaluate the metric in the overlapping regions:
+  for (std::size_t r = 0; r < runs.size(); r++)
+  {
+    // make sure there hasn't been an interrupt:
+    WRAP(terminator.terminate_on_request());
+
+    index_t mosaic_index;
+    mosaic_index[1] = runs[r].y_;
+    for (mosaic_index[0] = runs[r].x0_; mosaic_index[0] < runs[r].x1_; ++mosaic_index[0])
+    {
+      pnt2d_t point;
+      mosaic->TransformIndexToPhysicalPoint(mosaic_index, point);
+
+      // find pixels in overlapping regions of the mosaic:
+      overlap.clear();
+      const unsigned int * tiles = nullptr;
+      const unsigned int   num_tiles = bins.lookup(point, tiles);
+      for (unsigned int i = 0; i < num_tiles; i++)
+      {
+        const unsigned int k = tiles[i];
+        if (point[0] < min[k][0] || point[0] > max[k][0] || point[1] < min[k][1] || point[1] > max[k][1])
+          continue;
+
+        const transform_t * t = transform_[k];
+        pnt2d_t             pt_k = t->TransformPoint(point);
+        index_t             index;
+        // make sure the pixel maps into the image:
+        image_[k]->TransformPhysicalPointToIndex(pt_k, index);
+        if (!interpolator_[k]->IsInsideBuffer(pt_k))
+          continue;
+
+        // make sure the pixel maps into the mask:
+        if (mask_[k].GetPointer() && mask_[k]->GetPixel(index) == 0)
+          continue;
+
+        // shortcut:
+        image_data_t & data = image_data[k];
+
+        // get the image value:
+        // data.P_ = image_[k]->GetPixel(index); // faster
+        data.P_ = interpolator_[k]->Evaluate(pt_k); // slower
+
+        // get the image gradient:
+        const gradient_pixel_t & gradient = gradient_[k]->GetPixel(index);
+        data.dPdx_ = gradient[0];
+        data.dPdy_ = gradient[1];
+
+        // get the derivatives with respect to the transform parameters,
+        // from the tabulated Jacobian where possible:
+        measure_t * dPdp_k = &(dPdp[k][0]);
+        if (!tables || !(*tables)[k].eval(mosaic_index, data.dPdx_, data.dPdy_, dPdp_k))
+        {
+          const jacobian_t & J = jacobian[k];
+          t->ComputeJacobianWithRespectToParameters(point, jacobian[k]);
+
+          for (unsigned int j = 0; j < n_params; j++)
+          {
+            dPdp_k[j] = J[0][j] * data.dPdx_ + J[1][j] * data.dPdy_;
+          }
+        }
+
+        // add to the list:
+        overlap.push_back(&data);
+      }
+
+      // skip over the regions that do not overlap:
+      if (overlap.size() < 2)
+        continue;
+
+      // found a pixel in an overlapping region, increment the counter:
+      accumulator.pixels_++;
+
+      // shortcut:
+      measure_t normalization_factor = measure_t(1) / measure_t(overlap.size());
+
+      // calculate the mean and derivative of the mean:
+      measure_t Mu = measure_t(0);
+      dMu.assign(n_concat, measure_t(0));
+      for (typename std::vector<const image_data_t *>::const_iterator i = overlap.begin(); i != overlap.end(); ++i)
+      {
+        const image_data_t & data = *(*i);
+        const unsigned int * addr = &(address_[data.id_][0]);
+        const measure_t *    dPdp_i = data.dPdp_;
+
+        Mu += data.P_;
+
+        for (unsigned int j = 0; j < n_params; j++)
+        {
+          dMu[addr[j]] += dPdp_i[j] * normalization_factor;
+        }
+      }
+      Mu *= normalization_factor;
+#if 1
+      // normalize the shared portion of dMu:
+      for (unsigned int i = 0; i < n_shared_; i++)
+      {
+        dMu[i] *= normalization_factor;
+      }
+#endif
+
+      // calculate the variance:
+      measure_t V = measure_t(0);
+      dV.assign(n_concat, measure_t(0));
+      for (typename std::vector<const image_data_t *>::const_iterator i = overlap.begin(); i != overlap.end(); ++i)
+      {
+        const image_data_t & data = *(*i);
+        const unsigned int * addr = &(address_[data.id_][0]);
+        const measure_t *    dPdp_i = data.dPdp_;
+
+        measure_t d = data.P_ - Mu;
+        V += d * d;
+
+        for (unsigned int j = 0; j < n_params; j++)
+        {
+          dV[addr[j]] += measure_t(2) * d * (dPdp_i[j] - dMu[addr[j]]) * normalization_factor;
+        }
+      }
+      V *= normalization_factor;
+#if 1
+      // normalize the shared portion of dV:
+      for (unsigned int i = 0; i < n_shared_; i++)
+      {
+        dV[i] *= normalization_factor;
+      }
+#endif
+
+      // update the measure:
+      measure += V;
+
+      // update the derivative:
+      for (unsigned int i = 0; i < n_concat; i++)
+      {
+        derivative[i] += dV[i];
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------
+// collect_runs
+//
+template <class TImage, class TInterpolator>
+void
+ImageMosaicVarianceMetric<TImage, TInterpolator>::collect_runs(const image_t *                      mosaic,
+                                                               const typename image_t::RegionType & roi,
+                                                               const unsigned int                   y0,
+                                                               const unsigned int                   y1,
+                                                               const overlap_spans_t *              spans,
+                                                               std::vector<run_t> &                 runs) const
+{
+  const typename image_t::SpacingType & sp = mosaic->GetSpacing();
+  const typename image_t::PointType &   origin = mosaic->GetOrigin();
+
+  const index_t & roi_index = roi.GetIndex();
+  const long      roi_x1 = roi_index[0] + long(roi.GetSize()[0]);
+  for (unsigned int y = y0; y < y1; y++)
+  {
+    run_t run = { roi_index[1] + long(y), roi_index[0], roi_x1 };
+    if (!spans)
+    {
+      runs.push_back(run);
+      continue;
+    }
+
+    // the overlap spans of this row:
+    const pnt2d_t *    row_spans = nullptr;
+    const unsigned int num_spans = spans->lookup(origin[1] + double(run.y_) * sp[1], row_spans);
+    for (unsigned int i = 0; i < num_spans; i++)
+    {
+      run.x0_ = std::max(roi_index[0], long(std::floor((row_spans[i][0] - origin[0]) / sp[0])));
+      run.x1_ = std::min(roi_x1, long(std::ceil((row_spans[i][1] - origin[0]) / sp[0])) + 1);
+      if (run.x0_ < run.x1_)
+      {
+        runs.push_back(run);
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------
+// draw_samples
+//
+template <class TImage, class TInterpolator>
+void
+ImageMosaicVarianceMetric<TImage, TInterpolator>::draw_samples() const
+{
+  typedef itk::Statistics::MersenneTwisterRandomVariateGenerator generator_t;
+
+  // a private generator, so that the samples only depend on the seed:
+  generator_t::Pointer generator = generator_t::New();
+  generator->Initialize(sample_seed_ + sample_draws_);
+  sample_draws_++;
+
+  // split the total length of the overlap runs into num_samples_
+  // equal parts, one sample per part:
+  sample_t_.resize(num_samples_);
+  for (unsigned int i = 0; i < num_samples_; i++)
+  {
+    sample_t_[i] = (double(i) + generator->GetVariateWithOpenUpperRange()) / double(num_samples_);
+  }
+}
+
 //----------------------------------------------------------------
 // CalcMosaicBBox
 //
@@ -655,6 +1025,11 @@ ImageMosaicVarianceMetric<TImage, TInterpolator>::variance(const typename TImage
   mosaic->Allocate();
   mosaic->FillBuffer(NumericTraits<pixel_t>::Zero);
 
+  // bin the tiles, so that each mosaic pixel is only tested
+  // against the tiles that may overlap it:
+  tile_bins_t bins;
+  bins.setup(min, max);
+
   // iterate over the mosaic, evaluate the metric in the overlapping regions:
   typedef itk::ImageRegionIteratorWithIndex<image_t> itex_t;
   unsigned int                                       pixel_count = 0;
@@ -670,8 +1045,11 @@ ImageMosaicVarianceMetric<TImage, TInterpolator>::variance(const typename TImage
 
     // find pixels in overlapping regions of the mosaic:
     std::list<measure_t> overlap;
-    for (unsigned int k = 0; k < num_images; k++)
+    const unsigned int * tiles = nullptr;
+    const unsigned int   num_tiles = bins.lookup(point, tiles);
+    for (unsigned int i = 0; i < num_tiles; i++)
     {
+      const unsigned int k = tiles[i];
       if (point[0] < min[k][0] || point[0] > max[k][0] || point[1] < min[k][1] || point[1] > max[k][1])
         continue;
 
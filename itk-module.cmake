@@ -19,6 +19,7 @@ itk_module(Nornir
   ITKTransformFactory
   ITKSpatialObjects
   ITKOptimizers
+  ITKFFT
   COMPILE_DEPENDS
   ITKImageSources
   ITKImageIntensity
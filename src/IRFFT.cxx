@@ -32,19 +32,29 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #define _USE_MATH_DEFINES
 #endif
 #include <string.h>
+#include <algorithm>
 #include <math.h>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 // ITK includes:
 #include <itkImage.h>
-#include <itkImageRegionIteratorWithIndex.h>
-#include <itkImageRegionConstIteratorWithIndex.h>
-#include <itkForwardFFTImageFilter.h>
-#include <itkInverseFFTImageFilter.h>
-#include <itkImageDuplicator.h>
-#include <itkComposeImageFilter.h>
-#include <itkComplexToRealImageFilter.h>
-#include <itkComplexToImaginaryImageFilter.h>
-#include <itkComplexToComplexFFTImageFilter.h>
+#if defined(ITK_USE_FFTWF)
+#include <itkFFTWCommon.h>
+#include <itkFFTWGlobalConfiguration.h>
+#else
+#include <vnl/algo/vnl_fft_base.h>
+#endif
 
 // local includes:
 #include "IRFFT.h"
@@ -54,144 +64,353 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 namespace itk_fft
 {
-	// static the_mutex_interface_t * mutex = nullptr; 
-	// //----------------------------------------------------------------
-	// // fftw_mutex
-	// // 
-	// static the_mutex_interface_t *
-	// 	fftw_mutex()
-	// {
-	// 	if(mutex == nullptr)
-	// 		mutex = the_mutex_interface_t::create();
-	// 	return mutex;
-	// }
-
 	//----------------------------------------------------------------
 	// NUM_FFTW_THREADS
 	// 
 	static std::size_t NUM_FFTW_THREADS = 1;
 
 	//----------------------------------------------------------------
-	// set_num_fftw_threads
+	// FFT_CACHE_CAPACITY
 	// 
-	// set's number of threads used by fftw, returns previous value:
-	// std::size_t set_num_fftw_threads(std::size_t num_threads)
-	// {
-	// 	the_lock_t<the_mutex_interface_t> lock(fftw_mutex());
-	// 	std::size_t prev = NUM_FFTW_THREADS;
-	// 	if (num_threads > 0)
-	// 	{
+	// maximum number of transform sizes kept by each thread:
+	static const std::size_t FFT_CACHE_CAPACITY = 8;
 
-	// 		NUM_FFTW_THREADS = num_threads;
-	// 	}
+	//----------------------------------------------------------------
+	// is_fast_fft_size
+	// 
+	// sizes of the form 2^a 3^b 5^c are the fast ones for FFTW,
+	// and the only ones vnl_fft knows how to factor:
+	static bool
+		is_fast_fft_size(unsigned int n)
+	{
+		if (n == 0) return false;
+		while (n % 2 == 0) n /= 2;
+		while (n % 3 == 0) n /= 3;
+		while (n % 5 == 0) n /= 5;
+		return n == 1;
+	}
 
-	// 	return prev;
-	// }
+#if !defined(ITK_USE_FFTWF)
+	//----------------------------------------------------------------
+	// vnl_fft_2d_t
+	// 
+	class vnl_fft_2d_t : public vnl_fft_base<2, float>
+	{
+	public:
+		vnl_fft_2d_t(const unsigned int w, const unsigned int h)
+		{
+			// the slowest varying dimension comes first:
+			factors_[0].resize(h);
+			factors_[1].resize(w);
+		}
+	};
+#endif
 
+	//----------------------------------------------------------------
+	// hermitian_expand
+	// 
+	// Rebuild the full w x h spectrum of a real image from the
+	// non-redundant (w/2 + 1) x h half, using the Hermitian symmetry
+	// F(-x, -y) = conj(F(x, y)):
+	// 
+	static void
+		hermitian_expand(const unsigned int w,
+				 const unsigned int h,
+				 const fft_complex_t * half,
+				 fft_complex_t * full)
+	{
+		const unsigned int w_complex = w / 2 + 1;
+		for (unsigned int y = 0; y < h; y++)
+		{
+			const fft_complex_t * src = half + y * w_complex;
+			const fft_complex_t * mirror = half + ((h - y) % h) * w_complex;
+			fft_complex_t * dst = full + y * w;
 
-	// //----------------------------------------------------------------
-	// // fft_cache_t
-	// // 
-	// class fft_cache_t
-	// {
-	// public:
-	// 	fft_cache_t():
-	// 	  fwd_(nullptr),
-	// 		  inv_(nullptr),
-	// 		  w_(0),
-	// 		  h_(0),
-	// 		  h_complex_(0),
-	// 		  h_padded_(0),
-	// 		  buffer_(nullptr)
-	// 	  {}
-
-	// 	  ~fft_cache_t()
-	// 	  {
-	// 		  clear();
-	// 	  }
-
-	// 	  void clear()
-	// 	  {
-	// 		  if (buffer_)
-	// 		  {
-	// 			  // fftw is not thread safe:
-	// 			//   the_lock_t<the_mutex_interface_t> lock(fftw_mutex());
-
-	// 			  fftwf_destroy_plan(fwd_);
-	// 			  fwd_ = nullptr;
-
-	// 			  fftwf_destroy_plan(inv_);
-	// 			  inv_ = nullptr;
-
-	// 			  fftwf_free(buffer_);
-	// 			  buffer_ = nullptr;
-	// 		  }
-
-	// 		  w_ = 0;
-	// 		  h_ = 0;
-	// 		  h_complex_ = 0;
-	// 		  h_padded_ = 0;
-	// 	  }
-
-	// 	  void update(const unsigned int & w, const unsigned int & h)
-	// 	  {
-	// 		  if (w_ == w && h_ == h)
-	// 		  {
-	// 			  return;
-	// 		  }
-
-	// 		  // fftw is not thread safe:
-	// 		//   the_lock_t<the_mutex_interface_t> lock(fftw_mutex());
-
-	// 		//   if (buffer_)
-	// 		//   {
-	// 		// 	  fftwf_destroy_plan(fwd_);
-	// 		// 	  fftwf_destroy_plan(inv_);
-	// 		// 	  fftwf_free(buffer_);
-	// 		//   }
-
-	// 		  w_ = w;
-	// 		  h_ = h;
-
-	// 		  h_complex_ = h_ / 2 + 1;
-	// 		  h_padded_ = h_complex_ * 2;
-
-	// 		  buffer_ = (float *)(fftwf_malloc(w_ * h_padded_ * sizeof(float)));
-	// 		  fftwf_plan_with_nthreads(NUM_FFTW_THREADS);
-	// 		  fwd_ = fftwf_plan_dft_r2c_2d(w_,
-	// 			  h_,
-	// 			  buffer_,
-	// 			  (fftwf_complex *)buffer_,
-	// 			  FFTW_DESTROY_INPUT | FFTW_ESTIMATE);
-
-	// 		  fft_data_t dummy_in(4, 4);
-	// 		  fft_data_t dummy_out(4, 4);
-	// 		  fftwf_plan_with_nthreads(NUM_FFTW_THREADS);
-	// 		  inv_ = fftwf_plan_dft_2d(w_,
-	// 			  h_,
-	// 			  (fftwf_complex *)(dummy_in.data()),
-	// 			  (fftwf_complex *)(dummy_out.data()),
-	// 			  FFTW_BACKWARD,
-	// 			  FFTW_ESTIMATE);
-	// 	  }
-
-	// 	  fftwf_plan fwd_; // analysis, forward fft
-	// 	  fftwf_plan inv_; // synthesis, inverse fft
-	// 	  unsigned int w_;
-	// 	  unsigned int h_;
-	// 	  unsigned int h_complex_;
-	// 	  unsigned int h_padded_;
-	// 	  float * buffer_;
-	// };
+			memcpy(dst, src, sizeof(fft_complex_t) * w_complex);
+			for (unsigned int x = w_complex; x < w; x++)
+			{
+				dst[x] = std::conj(mirror[w - x]);
+			}
+		}
+	}
+
+	//----------------------------------------------------------------
+	// fft_plan_t
+	// 
+	// Transform plans for one w x h size, along with the scratch
+	// buffers the plans were created for. A plan is created once
+	// and is reused for every transform of the same size.
+	// 
+	class fft_plan_t
+	{
+	public:
+		fft_plan_t(const unsigned int w, const unsigned int h);
+		~fft_plan_t();
+
+		// forward transform of a real w x h image,
+		// the full complex spectrum is stored in out:
+		void r2c(const float * in, fft_complex_t * out);
+
+		// forward transform of a real w x h image, only the
+		// non-redundant w_complex_ x h half of the spectrum
+		// is stored in out:
+		void r2c_half(const float * in, fft_complex_t * out);
+
+		// inverse of r2c_half, unnormalized:
+		void c2r(const fft_complex_t * in, float * out);
+
+		// complex-to-complex transform, in and out may alias:
+		void c2c(const fft_complex_t * in,
+			 fft_complex_t * out,
+			 const bool forward);
+
+		const unsigned int w_;
+		const unsigned int h_;
+
+		// size of the non-redundant half of the spectrum along x:
+		const unsigned int w_complex_;
+
+	private:
+		// intentionally disabled:
+		fft_plan_t(const fft_plan_t &);
+		fft_plan_t & operator = (const fft_plan_t &);
+
+#if defined(ITK_USE_FFTWF)
+		typedef itk::fftw::Proxy<float> fftw_t;
+
+		float * real_;
+		fft_complex_t * half_;
+		fft_complex_t * full_;
+
+		fftw_t::PlanType r2c_;
+		fftw_t::PlanType c2r_;
+		fftw_t::PlanType fwd_;
+		fftw_t::PlanType inv_;
+#else
+		vnl_fft_2d_t vnl_;
+		std::vector<fft_complex_t> full_;
+#endif
+	};
+
+	//----------------------------------------------------------------
+	// fft_plan_t::fft_plan_t
+	// 
+	fft_plan_t::fft_plan_t(const unsigned int w, const unsigned int h):
+		w_(w),
+		h_(h),
+		w_complex_(w / 2 + 1)
+#if defined(ITK_USE_FFTWF)
+		,
+		real_((float *)(fftwf_malloc(sizeof(float) * w * h))),
+		half_((fft_complex_t *)(fftwf_malloc(sizeof(fft_complex_t) *
+						     w_complex_ * h))),
+		full_((fft_complex_t *)(fftwf_malloc(sizeof(fft_complex_t) * w * h))),
+		r2c_(nullptr),
+		c2r_(nullptr),
+		fwd_(nullptr),
+		inv_(nullptr)
+#else
+		,
+		vnl_(w, h),
+		full_(w * h)
+#endif
+	{
+#if defined(ITK_USE_FFTWF)
+		// the remaining plans are created on demand,
+		// most sizes are only ever used in one direction:
+		r2c_ = fftw_t::Plan_dft_r2c_2d(h_,
+					       w_,
+					       real_,
+					       (fftw_t::ComplexType *)(half_),
+					       itk::FFTWGlobalConfiguration::GetPlanRigor(),
+					       int(NUM_FFTW_THREADS),
+					       true);
+#endif
+	}
+
+	//----------------------------------------------------------------
+	// fft_plan_t::~fft_plan_t
+	// 
+	fft_plan_t::~fft_plan_t()
+	{
+#if defined(ITK_USE_FFTWF)
+		if (r2c_ != nullptr) fftw_t::DestroyPlan(r2c_);
+		if (c2r_ != nullptr) fftw_t::DestroyPlan(c2r_);
+		if (fwd_ != nullptr) fftw_t::DestroyPlan(fwd_);
+		if (inv_ != nullptr) fftw_t::DestroyPlan(inv_);
+
+		fftwf_free(real_);
+		fftwf_free(half_);
+		fftwf_free(full_);
+#endif
+	}
+
+	//----------------------------------------------------------------
+	// fft_plan_t::r2c
+	// 
+	void
+		fft_plan_t::r2c(const float * in, fft_complex_t * out)
+	{
+#if defined(ITK_USE_FFTWF)
+		memcpy(real_, in, sizeof(float) * w_ * h_);
+		fftw_t::Execute(r2c_);
+		hermitian_expand(w_, h_, half_, out);
+#else
+		const unsigned int size = w_ * h_;
+		for (unsigned int i = 0; i < size; i++)
+		{
+			out[i] = fft_complex_t(in[i], 0);
+		}
+
+		vnl_.transform(out, -1);
+#endif
+	}
+
+	//----------------------------------------------------------------
+	// fft_plan_t::r2c_half
+	// 
+	void
+		fft_plan_t::r2c_half(const float * in, fft_complex_t * out)
+	{
+#if defined(ITK_USE_FFTWF)
+		memcpy(real_, in, sizeof(float) * w_ * h_);
+		fftw_t::Execute(r2c_);
+		memcpy(out, half_, sizeof(fft_complex_t) * w_complex_ * h_);
+#else
+		r2c(in, &(full_[0]));
+		for (unsigned int y = 0; y < h_; y++)
+		{
+			memcpy(out + y * w_complex_,
+			       &(full_[y * w_]),
+			       sizeof(fft_complex_t) * w_complex_);
+		}
+#endif
+	}
+
+	//----------------------------------------------------------------
+	// fft_plan_t::c2r
+	// 
+	void
+		fft_plan_t::c2r(const fft_complex_t * in, float * out)
+	{
+#if defined(ITK_USE_FFTWF)
+		if (c2r_ == nullptr)
+		{
+			// multi-dimensional c2r transforms always destroy the input,
+			// which is why the input is copied into the scratch buffer:
+			c2r_ = fftw_t::Plan_dft_c2r_2d(h_,
+						       w_,
+						       (fftw_t::ComplexType *)(half_),
+						       real_,
+						       itk::FFTWGlobalConfiguration::GetPlanRigor(),
+						       int(NUM_FFTW_THREADS),
+						       true);
+		}
+
+		memcpy(half_, in, sizeof(fft_complex_t) * w_complex_ * h_);
+		fftw_t::Execute(c2r_);
+		memcpy(out, real_, sizeof(float) * w_ * h_);
+#else
+		hermitian_expand(w_, h_, in, &(full_[0]));
+		vnl_.transform(&(full_[0]), 1);
+
+		const unsigned int size = w_ * h_;
+		for (unsigned int i = 0; i < size; i++)
+		{
+			out[i] = full_[i].real();
+		}
+#endif
+	}
+
+	//----------------------------------------------------------------
+	// fft_plan_t::c2c
+	// 
+	void
+		fft_plan_t::c2c(const fft_complex_t * in,
+				fft_complex_t * out,
+				const bool forward)
+	{
+		const std::size_t num_bytes = sizeof(fft_complex_t) * w_ * h_;
+
+#if defined(ITK_USE_FFTWF)
+		fftw_t::PlanType & plan = forward ? fwd_ : inv_;
+		if (plan == nullptr)
+		{
+			plan = fftw_t::Plan_dft_2d(h_,
+						   w_,
+						   (fftw_t::ComplexType *)(full_),
+						   (fftw_t::ComplexType *)(full_),
+						   forward ? FFTW_FORWARD : FFTW_BACKWARD,
+						   itk::FFTWGlobalConfiguration::GetPlanRigor(),
+						   int(NUM_FFTW_THREADS),
+						   true);
+		}
+
+		memcpy(full_, in, num_bytes);
+		fftw_t::Execute(plan);
+		memcpy(out, full_, num_bytes);
+#else
+		if (out != in) memcpy(out, in, num_bytes);
+		vnl_.transform(out, forward ? -1 : 1);
+#endif
+	}
+
+	//----------------------------------------------------------------
+	// fft_cache_t
+	// 
+	// A small most-recently-used list of plans, one per transform size.
+	// Each thread keeps its own cache, so no locking is necessary.
+	// 
+	class fft_cache_t
+	{
+	public:
+		~fft_cache_t()
+		{
+			while (!plans_.empty())
+			{
+				delete remove_head(plans_);
+			}
+		}
+
+		// returns nullptr if a transform of the given size
+		// is not supported by the underlying FFT library:
+		fft_plan_t * plan(const unsigned int w, const unsigned int h)
+		{
+			for (std::list<fft_plan_t *>::iterator i = plans_.begin();
+			     i != plans_.end(); ++i)
+			{
+				fft_plan_t * p = *i;
+				if (p->w_ == w && p->h_ == h)
+				{
+					// keep the most recently used plan at the front:
+					if (i != plans_.begin()) plans_.splice(plans_.begin(), plans_, i);
+					return p;
+				}
+			}
+
+#if !defined(ITK_USE_FFTWF)
+			if (!is_fast_fft_size(w) || !is_fast_fft_size(h)) return nullptr;
+#endif
+
+			if (plans_.size() >= FFT_CACHE_CAPACITY)
+			{
+				delete plans_.back();
+				plans_.pop_back();
+			}
+
+			fft_plan_t * p = new fft_plan_t(w, h);
+			plans_.push_front(p);
+			return p;
+		}
+
+	private:
+		std::list<fft_plan_t *> plans_;
+	};
 
 	//----------------------------------------------------------------
 	// tss
 	// 
-	// static boost::thread_specific_ptr<fft_cache_t> tss;
-	using ForwardFFTFilterType = itk::ForwardFFTImageFilter<itk_image_t, itk_complex_image_t>;
-	static thread_local ForwardFFTFilterType::Pointer forwardFFTFilter = ForwardFFTFilterType::New();
-	using InverseFFTFilterType = itk::ComplexToComplexFFTImageFilter<itk_complex_image_t, itk_complex_image_t>;
-	static thread_local InverseFFTFilterType::Pointer inverseFFTFilter = InverseFFTFilterType::New();
+	static thread_local fft_cache_t tss;
 
 	//----------------------------------------------------------------
 	// fft_data_t::fft_data_t
@@ -248,12 +467,10 @@ namespace itk_fft
 
 		if (data.image_ != nullptr)
 		{
-			using DuplicatorType = itk::ImageDuplicator<itk_complex_image_t>;
-			DuplicatorType::Pointer duplicator = DuplicatorType::New();
-			duplicator->SetInputImage(data.image_);
-			duplicator->Update();
-			image_ = duplicator->GetOutput();
 			resize(data.nx_, data.ny_);
+			memcpy(buffer(),
+			       data.buffer(),
+			       sizeof(fft_complex_t) * nx_ * ny_);
 		}
 		else
 		{
@@ -269,8 +486,7 @@ namespace itk_fft
 	void
 		fft_data_t::cleanup()
 	{
-		// if (data_ != nullptr) fftwf_free((fft_complex_t *)(data_));
-		// data_ = nullptr;
+		image_ = nullptr;
 		nx_ = 0;
 		ny_ = 0;
 	}
@@ -281,15 +497,19 @@ namespace itk_fft
 	void
 		fft_data_t::resize(const unsigned int w, const unsigned int h)
 	{
-		const unsigned int new_sz = w  * h;
-		const unsigned int old_sz = nx_ * ny_;
-		if (old_sz == new_sz) return;
+		if (image_ != nullptr && nx_ == w && ny_ == h) return;
 
-		// if (data_ != nullptr) fftwf_free((fft_complex_t *)(data_));
-		// data_ = (fft_complex_t *)(fftwf_malloc(new_sz * sizeof(fft_complex_t)));
-		// assert(data_ != nullptr);
-		image_->SetRegions({ w, h });
-		image_->Allocate();
+		if (image_ == nullptr || nx_ * ny_ != w * h)
+		{
+			image_ = itk_complex_image_t::New();
+			image_->SetRegions({ w, h });
+			image_->Allocate();
+		}
+		else
+		{
+			// same number of elements, reuse the buffer:
+			image_->SetRegions({ w, h });
+		}
 
 		nx_ = w;
 		ny_ = h;
@@ -312,12 +532,20 @@ namespace itk_fft
 		fft_data_t::setup(const itk_image_t::Pointer & real,
 		const itk_image_t::Pointer & imag)
 	{
-		using ComposeFilterType = itk::ComposeImageFilter<itk_image_t, itk_complex_image_t>;
-		ComposeFilterType::Pointer composeFilter = ComposeFilterType::New();
-		composeFilter->SetInput1(real);
-		composeFilter->SetInput2(imag);
-		composeFilter->Update();
-		image_ = composeFilter->GetOutput();
+		const itk_image_t::SizeType sz =
+			real->GetLargestPossibleRegion().GetSize();
+		resize(sz[0], sz[1]);
+
+		const float * re = real->GetBufferPointer();
+		const float * im = (imag.GetPointer() == nullptr) ?
+			nullptr : imag->GetBufferPointer();
+
+		fft_complex_t * dst = buffer();
+		const unsigned int size = nx_ * ny_;
+		for (unsigned int i = 0; i < size; i++)
+		{
+			dst[i] = fft_complex_t(re[i], (im == nullptr) ? 0.0f : im[i]);
+		}
 	}
 
 	//----------------------------------------------------------------
@@ -326,34 +554,100 @@ namespace itk_fft
 	itk_image_t::Pointer
 		fft_data_t::component(const bool imag) const
 	{
+		itk_image_t::Pointer out = itk_image_t::New();
+		out->SetRegions({ nx_, ny_ });
+		out->Allocate();
+
+		const fft_complex_t * src = buffer();
+		float * dst = out->GetBufferPointer();
+		const unsigned int size = nx_ * ny_;
+
 		if (imag)
 		{
-			using ComplexToImaginaryFilterType = itk::ComplexToImaginaryImageFilter<itk_complex_image_t, itk_image_t>;
-			ComplexToImaginaryFilterType::Pointer complexToImaginaryFilter = ComplexToImaginaryFilterType::New();
-			complexToImaginaryFilter->SetInput(image_);
-			complexToImaginaryFilter->Update();
-			return complexToImaginaryFilter->GetOutput();
+			for (unsigned int i = 0; i < size; i++) dst[i] = src[i].imag();
 		}
-		using ComplexToRealFilterType = itk::ComplexToRealImageFilter<itk_complex_image_t, itk_image_t>;
-		ComplexToRealFilterType::Pointer complexToRealFilter = ComplexToRealFilterType::New();
-		complexToRealFilter->SetInput(image_);
-		complexToRealFilter->Update();
-		return complexToRealFilter->GetOutput();
+		else
+		{
+			for (unsigned int i = 0; i < size; i++) dst[i] = src[i].real();
+		}
+
+		return out;
 	}
 
-	static std::vector<double> syLookup;
-	static std::vector<double> sySquaredLookup;
+	//----------------------------------------------------------------
+	// next_fast_fft_size
+	// 
+	unsigned int
+		next_fast_fft_size(const unsigned int n)
+	{
+		unsigned int m = std::max(n, 1u);
+		while (!is_fast_fft_size(m)) m++;
+		return m;
+	}
 
 	//----------------------------------------------------------------
-	// fft_data_t::apply_lp_filter
+	// prev_fast_fft_size
 	// 
-	void
-		fft_data_t::apply_lp_filter(const double r, const double s)
+	unsigned int
+		prev_fast_fft_size(const unsigned int n)
 	{
-		if (r > ::sqrt(2.0)) return;
+		unsigned int m = std::max(n, 1u);
+		while (!is_fast_fft_size(m)) m--;
+		return m;
+	}
+
+	//----------------------------------------------------------------
+	// lp_filter_key_t
+	// 
+	class lp_filter_key_t
+	{
+	public:
+		bool operator < (const lp_filter_key_t & k) const
+		{
+			if (w_ != k.w_) return w_ < k.w_;
+			if (h_ != k.h_) return h_ < k.h_;
+			if (half_ != k.half_) return half_ < k.half_;
+			if (r_ != k.r_) return r_ < k.r_;
+			return s_ < k.s_;
+		}
+
+		unsigned int w_;
+		unsigned int h_;
+		bool half_;
+		double r_;
+		double s_;
+	};
+
+	//----------------------------------------------------------------
+	// MAX_LP_FILTER_MASKS
+	// 
+	// there are only a handful of distinct transform sizes and filter
+	// parameters in a typical run, this is merely a safety net:
+	static const std::size_t MAX_LP_FILTER_MASKS = 64;
+
+	//----------------------------------------------------------------
+	// lp_filter_masks
+	// 
+	static std::map<lp_filter_key_t, lp_filter_mask_t> lp_filter_masks;
+	static std::mutex lp_filter_masks_mutex;
+
+	//----------------------------------------------------------------
+	// make_lp_filter_mask
+	// 
+	static lp_filter_mask_t
+		make_lp_filter_mask(const unsigned int w,
+				    const unsigned int h,
+				    const bool half,
+				    const double r,
+				    const double s)
+	{
+		const unsigned int nx = half ? (w / 2 + 1) : w;
+		const unsigned int ny = h;
+		std::shared_ptr<std::vector<float> > mask(new std::vector<float>(nx * ny, 1.0f));
+		if (r > ::sqrt(2.0)) return mask;
 
-		const unsigned int hx = nx_ / 2;
-		const unsigned int hy = ny_ / 2;
+		const unsigned int hx = w / 2;
+		const unsigned int hy = h / 2;
 
 		const double r0 = (r - s);
 		const double r1 = (r + s);
@@ -362,34 +656,16 @@ namespace itk_fft
 		const double r0sqr = r0 * r0;
 		const double r1sqr = r1 * r1;
 
-		//The use of this static cache needs to be wrapped in a lock, copied, or some other protection if multithreaded calls with different image sizes are used.
-		if((unsigned int)syLookup.size() != ny_)
+		float * dst = &((*mask)[0]);
+		for (unsigned int y = 0; y < ny; y++)
 		{
-			syLookup.clear(); 
-			sySquaredLookup.clear(); 
+			const double sy = 2.0 * (double((y + hy) % h) - double(hy)) / double(h);
+			const double y2 = sy * sy;
 
-			syLookup.reserve(ny_);
-			sySquaredLookup.reserve(ny_);
-			for (unsigned int y = 0; y < ny_; y++)
+			for (unsigned int x = 0; x < nx; x++)
 			{
-				double sy = 2.0 * (double((y + hy) % ny_) - double(hy)) / double(ny_);
-				double y2 = sy * sy;
-				syLookup.push_back(sy);
-				sySquaredLookup.push_back(sy); 
-			}
-		}
-
-		fft_complex_t * data_ = this->image_->GetBufferPointer();
-		unsigned int i = 0; 
-		for (unsigned int x = 0; x < nx_; x++)
-		{
-			double sx = 2.0 * (double((x + hx) % nx_) - double(hx)) / double(nx_);
-			double x2 = sx * sx;
-
-			for (unsigned int y = 0; y < ny_; y++)
-			{
-				double sy = syLookup[y];
-				double y2 = sySquaredLookup[y];
+				const double sx = 2.0 * (double((x + hx) % w) - double(hx)) / double(w);
+				const double x2 = sx * sx;
 
 				double d2 = x2 + y2;
 				double v;
@@ -400,13 +676,96 @@ namespace itk_fft
 					v = 0.0; 
 				else
 				{
-					double d = ::sqrt(x2 + y2);
+					double d = ::sqrt(d2);
 					v = (1.0 + cos(M_PI * (d - r0) / dr)) / 2.0;
 				}
 
-				data_[i++] *= v;
+				*dst++ = float(v);
 			}
 		}
+
+		return mask;
+	}
+
+	//----------------------------------------------------------------
+	// lp_filter_mask
+	// 
+	lp_filter_mask_t
+		lp_filter_mask(const unsigned int w,
+			       const unsigned int h,
+			       const bool half,
+			       const double r,
+			       const double s)
+	{
+		lp_filter_key_t key;
+		key.w_ = w;
+		key.h_ = h;
+		key.half_ = half;
+		key.r_ = r;
+		key.s_ = s;
+
+		{
+			std::lock_guard<std::mutex> lock(lp_filter_masks_mutex);
+			std::map<lp_filter_key_t, lp_filter_mask_t>::const_iterator
+				found = lp_filter_masks.find(key);
+			if (found != lp_filter_masks.end()) return found->second;
+		}
+
+		// build the mask outside the lock, if another thread builds
+		// the same mask concurrently the first one to finish wins:
+		lp_filter_mask_t mask = make_lp_filter_mask(w, h, half, r, s);
+
+		std::lock_guard<std::mutex> lock(lp_filter_masks_mutex);
+		if (lp_filter_masks.size() >= MAX_LP_FILTER_MASKS)
+		{
+			// masks that are still in use stay alive with their users:
+			lp_filter_masks.clear();
+		}
+
+		return lp_filter_masks.insert(std::make_pair(key, mask)).first->second;
+	}
+
+	//----------------------------------------------------------------
+	// apply_mask
+	// 
+	static void
+		apply_mask(fft_complex_t * data,
+			   const lp_filter_mask_t & mask)
+	{
+		const float * m = &((*mask)[0]);
+		const std::size_t size = mask->size();
+
+		// treat the complex samples as interleaved floats,
+		// this loop is easy for the compiler to vectorize:
+		float * d = reinterpret_cast<float *>(data);
+		for (std::size_t i = 0; i < size; i++)
+		{
+			d[2 * i] *= m[i];
+			d[2 * i + 1] *= m[i];
+		}
+	}
+
+	//----------------------------------------------------------------
+	// fft_data_t::apply_lp_filter
+	// 
+	void
+		fft_data_t::apply_lp_filter(const double r, const double s)
+	{
+		if (r > ::sqrt(2.0)) return;
+		apply_mask(buffer(), lp_filter_mask(nx_, ny_, false, r, s));
+	}
+
+	//----------------------------------------------------------------
+	// fft_data_t::apply_lp_filter_r2c
+	// 
+	void
+		fft_data_t::apply_lp_filter_r2c(const unsigned int w,
+						const double r,
+						const double s)
+	{
+		assert(nx_ == w / 2 + 1);
+		if (r > ::sqrt(2.0)) return;
+		apply_mask(buffer(), lp_filter_mask(w, ny_, true, r, s));
 	}
 
 
@@ -416,28 +775,241 @@ namespace itk_fft
 	bool
 		fft(itk_image_t::ConstPointer & in, fft_data_t & out)
 	{
-		forwardFFTFilter->SetInput(in);
-		forwardFFTFilter->GraftOutput(out.data());
-		forwardFFTFilter->UpdateLargestPossibleRegion();
+		const itk_image_t::SizeType sz = in->GetBufferedRegion().GetSize();
+		const unsigned int w = sz[0];
+		const unsigned int h = sz[1];
 
+		fft_plan_t * plan = tss.plan(w, h);
+		if (plan == nullptr) return false;
+
+		out.resize(w, h);
+		plan->r2c(in->GetBufferPointer(), out.buffer());
 		return true;
 	}
 
 
 	//----------------------------------------------------------------
-	// ifft
+	// fft
 	// 
 	bool
-		ifft(const fft_data_t & in, fft_data_t & out)
+		fft(const fft_data_t & in, fft_data_t & out, TransformDirectionEnum sign)
 	{
+		fft_plan_t * plan = tss.plan(in.nx(), in.ny());
+		if (plan == nullptr) return false;
+
 		out.resize(in.nx(), in.ny());
-		inverseFFTFilter->SetInput(in.data());
-		inverseFFTFilter->GraftOutput(out.data());
-		inverseFFTFilter->UpdateLargestPossibleRegion();
+		plan->c2c(in.buffer(),
+			  out.buffer(),
+			  sign == TransformDirectionEnum::FORWARD);
+		return true;
+	}
+
+
+	//----------------------------------------------------------------
+	// fft_r2c
+	// 
+	bool
+		fft_r2c(itk_image_t::ConstPointer & in, fft_data_t & out)
+	{
+		const itk_image_t::SizeType sz = in->GetBufferedRegion().GetSize();
+		const unsigned int w = sz[0];
+		const unsigned int h = sz[1];
+
+		fft_plan_t * plan = tss.plan(w, h);
+		if (plan == nullptr) return false;
+
+		out.resize(plan->w_complex_, h);
+		plan->r2c_half(in->GetBufferPointer(), out.buffer());
+		return true;
+	}
+
+
+	//----------------------------------------------------------------
+	// ifft_c2r
+	// 
+	bool
+		ifft_c2r(const fft_data_t & in, itk_image_t * out)
+	{
+		const itk_image_t::SizeType sz = out->GetBufferedRegion().GetSize();
+		const unsigned int w = sz[0];
+		const unsigned int h = sz[1];
+		if (in.nx() != w / 2 + 1 || in.ny() != h) return false;
+
+		fft_plan_t * plan = tss.plan(w, h);
+		if (plan == nullptr) return false;
 
+		plan->c2r(in.buffer(), out->GetBufferPointer());
 		return true;
 	}
 
+
+	//----------------------------------------------------------------
+	// ifft
+	// 
+	// NOTE: the inverse transform is not normalized, the result
+	// is scaled by nx * ny, just like the FFTW backward transform:
+	// 
+	bool
+		ifft(const fft_data_t & in, fft_data_t & out)
+	{
+		return fft(in, out, TransformDirectionEnum::INVERSE);
+	}
+
+	//----------------------------------------------------------------
+	// cross_power_eps
+	// 
+	// keeps the normalization finite where the spectrum vanishes:
+	static const float cross_power_eps = 1e-8f;
+
+	//----------------------------------------------------------------
+	// normalized_cross_power_scalar
+	// 
+	static void
+		normalized_cross_power_scalar(const fft_complex_t * f0,
+					      const fft_complex_t * f1,
+					      const float * in_mask,
+					      const float * out_mask,
+					      fft_complex_t * out,
+					      const std::size_t size)
+	{
+		const float * a = reinterpret_cast<const float *>(f1);
+		const float * b = reinterpret_cast<const float *>(f0);
+		float * c = reinterpret_cast<float *>(out);
+
+		for (std::size_t i = 0; i < size; i++)
+		{
+			const float ar = a[2 * i];
+			const float ai = a[2 * i + 1];
+			const float br = b[2 * i];
+			const float bi = b[2 * i + 1];
+
+			// p = g * f1 * conj(f0):
+			const float g = in_mask[i] * in_mask[i];
+			const float pr = g * (ar * br + ai * bi);
+			const float pi = g * (ai * br - ar * bi);
+
+			const float mag = ::sqrtf(pr * pr + pi * pi);
+			const float scale = out_mask[i] / (mag + cross_power_eps);
+
+			c[2 * i] = pr * scale;
+			c[2 * i + 1] = pi * scale;
+		}
+	}
+
+	//----------------------------------------------------------------
+	// normalized_cross_power
+	// 
+	void
+		normalized_cross_power(const fft_complex_t * f0,
+				       const fft_complex_t * f1,
+				       const float * in_mask,
+				       const float * out_mask,
+				       fft_complex_t * out,
+				       const std::size_t size)
+	{
+		std::size_t i = 0;
+
+#if defined(__AVX__)
+		// 4 complex samples per iteration:
+		const __m256 conj_sign = _mm256_setr_ps(0.0f, -0.0f, 0.0f, -0.0f,
+							0.0f, -0.0f, 0.0f, -0.0f);
+		const __m256 eps = _mm256_set1_ps(cross_power_eps);
+
+		for (; i + 4 <= size; i += 4)
+		{
+			const __m256 a = _mm256_loadu_ps((const float *)(f1 + i));
+			const __m256 b = _mm256_loadu_ps((const float *)(f0 + i));
+
+			// [ar*br, ai*br] + [ai*bi, -ar*bi]:
+			const __m256 br = _mm256_moveldup_ps(b);
+			const __m256 bi = _mm256_movehdup_ps(b);
+			const __m256 a_swap = _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+			__m256 p = _mm256_add_ps(_mm256_mul_ps(a, br),
+						 _mm256_xor_ps(_mm256_mul_ps(a_swap, bi), conj_sign));
+
+			// duplicate each mask value for the real and imaginary parts:
+			const __m128 gm = _mm_loadu_ps(in_mask + i);
+			const __m128 om = _mm_loadu_ps(out_mask + i);
+			__m256 g = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(gm, gm)),
+							_mm_unpackhi_ps(gm, gm),
+							1);
+			const __m256 m = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(om, om)),
+							      _mm_unpackhi_ps(om, om),
+							      1);
+			g = _mm256_mul_ps(g, g);
+			p = _mm256_mul_ps(p, g);
+
+			// |p|, duplicated for the real and imaginary parts:
+			const __m256 sq = _mm256_mul_ps(p, p);
+			const __m256 mag = _mm256_sqrt_ps(_mm256_add_ps(sq, _mm256_permute_ps(sq, _MM_SHUFFLE(2, 3, 0, 1))));
+			const __m256 scale = _mm256_div_ps(m, _mm256_add_ps(mag, eps));
+
+			_mm256_storeu_ps((float *)(out + i), _mm256_mul_ps(p, scale));
+		}
+#elif defined(__SSE2__) || defined(_M_X64)
+		// 2 complex samples per iteration:
+		const __m128 conj_sign = _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f);
+		const __m128 eps = _mm_set1_ps(cross_power_eps);
+
+		for (; i + 2 <= size; i += 2)
+		{
+			const __m128 a = _mm_loadu_ps((const float *)(f1 + i));
+			const __m128 b = _mm_loadu_ps((const float *)(f0 + i));
+
+			// [ar*br, ai*br] + [ai*bi, -ar*bi]:
+			const __m128 br = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+			const __m128 bi = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+			const __m128 a_swap = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+			__m128 p = _mm_add_ps(_mm_mul_ps(a, br),
+					      _mm_xor_ps(_mm_mul_ps(a_swap, bi), conj_sign));
+
+			// duplicate each mask value for the real and imaginary parts:
+			__m128 g = _mm_setr_ps(in_mask[i], in_mask[i], in_mask[i + 1], in_mask[i + 1]);
+			const __m128 m = _mm_setr_ps(out_mask[i], out_mask[i], out_mask[i + 1], out_mask[i + 1]);
+			g = _mm_mul_ps(g, g);
+			p = _mm_mul_ps(p, g);
+
+			// |p|, duplicated for the real and imaginary parts:
+			const __m128 sq = _mm_mul_ps(p, p);
+			const __m128 mag = _mm_sqrt_ps(_mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1))));
+			const __m128 scale = _mm_div_ps(m, _mm_add_ps(mag, eps));
+
+			_mm_storeu_ps((float *)(out + i), _mm_mul_ps(p, scale));
+		}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+		// 4 complex samples per iteration, deinterleaved on load:
+		const float32x4_t eps = vdupq_n_f32(cross_power_eps);
+
+		for (; i + 4 <= size; i += 4)
+		{
+			const float32x4x2_t a = vld2q_f32((const float *)(f1 + i));
+			const float32x4x2_t b = vld2q_f32((const float *)(f0 + i));
+
+			const float32x4_t gm = vld1q_f32(in_mask + i);
+			const float32x4_t g = vmulq_f32(gm, gm);
+
+			const float32x4_t pr = vmulq_f32(g, vmlaq_f32(vmulq_f32(a.val[0], b.val[0]), a.val[1], b.val[1]));
+			const float32x4_t pi = vmulq_f32(g, vmlsq_f32(vmulq_f32(a.val[1], b.val[0]), a.val[0], b.val[1]));
+
+			const float32x4_t mag = vsqrtq_f32(vmlaq_f32(vmulq_f32(pr, pr), pi, pi));
+			const float32x4_t scale = vdivq_f32(vld1q_f32(out_mask + i), vaddq_f32(mag, eps));
+
+			float32x4x2_t c;
+			c.val[0] = vmulq_f32(pr, scale);
+			c.val[1] = vmulq_f32(pi, scale);
+			vst2q_f32((float *)(out + i), c);
+		}
+#endif
+
+		// the remainder:
+		normalized_cross_power_scalar(f0 + i,
+					      f1 + i,
+					      in_mask + i,
+					      out_mask + i,
+					      out + i,
+					      size - i);
+	}
+
 	// //----------------------------------------------------------------
 	// // elem_by_elem
 	// // 
@@ -33,6 +33,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 
 // system includes:
 #include <functional>
+#include <queue>
+#include <vector>
 
 //----------------------------------------------------------------
 // DEBUG_COUNTER1
@@ -43,6 +45,269 @@ unsigned int DEBUG_COUNTER2 = 0;
 #endif
 
 
+//----------------------------------------------------------------
+// cluster_forest_t
+//
+// Flat array union-find over the pixels of an image. Along with the
+// parent link each node records its displacement from the parent,
+// so that clusters broken up across the periodic boundary can be
+// put back together in one piece (unwrapped coordinates).
+//
+class cluster_forest_t
+{
+public:
+  cluster_forest_t(const unsigned int size)
+    : parent_(size)
+    , dx_(size, 0)
+    , dy_(size, 0)
+  {
+    for (unsigned int i = 0; i < size; i++)
+    {
+      parent_[i] = i;
+    }
+  }
+
+  // find the root of a node, along with the displacement
+  // of the node from the root; compresses the path:
+  unsigned int
+  find(const unsigned int node, int & dx, int & dy)
+  {
+    // first pass, find the root:
+    unsigned int root = node;
+    dx = 0;
+    dy = 0;
+    while (parent_[root] != root)
+    {
+      dx += dx_[root];
+      dy += dy_[root];
+      root = parent_[root];
+    }
+
+    // second pass, link every node on the path directly to the root:
+    int          ox = dx;
+    int          oy = dy;
+    unsigned int i = node;
+    while (parent_[i] != root && i != root)
+    {
+      const unsigned int next = parent_[i];
+      const int          nx = ox - dx_[i];
+      const int          ny = oy - dy_[i];
+
+      parent_[i] = root;
+      dx_[i] = ox;
+      dy_[i] = oy;
+
+      i = next;
+      ox = nx;
+      oy = ny;
+    }
+
+    return root;
+  }
+
+  // merge the trees of nodes a and b, where b is displaced
+  // from a by (dx, dy) in unwrapped coordinates:
+  void
+  unite(const unsigned int a, const unsigned int b, const int dx, const int dy)
+  {
+    int                ax = 0;
+    int                ay = 0;
+    int                bx = 0;
+    int                by = 0;
+    const unsigned int ra = find(a, ax, ay);
+    const unsigned int rb = find(b, bx, by);
+    if (ra == rb)
+    {
+      // a cluster that wraps all the way around keeps
+      // the displacements it was found with first:
+      return;
+    }
+
+    // displacement of root b from root a:
+    const int rx = dx + ax - bx;
+    const int ry = dy + ay - by;
+
+    // the lowest index becomes the root, this keeps the
+    // result independent of the order of the merges:
+    if (ra < rb)
+    {
+      parent_[rb] = ra;
+      dx_[rb] = rx;
+      dy_[rb] = ry;
+    }
+    else
+    {
+      parent_[ra] = rb;
+      dx_[ra] = -rx;
+      dy_[ra] = -ry;
+    }
+  }
+
+private:
+  std::vector<unsigned int> parent_;
+  std::vector<int>          dx_;
+  std::vector<int>          dy_;
+};
+
+//----------------------------------------------------------------
+// label_clusters
+//
+unsigned int
+label_clusters(std::vector<cluster_stats_t> & clusters,
+               const itk_image_t *            image,
+               const double                   background,
+               const bool                     periodic)
+{
+  clusters.clear();
+
+  const itk_image_t::SizeType size = image->GetLargestPossibleRegion().GetSize();
+  const unsigned int          w = size[0];
+  const unsigned int          h = size[1];
+  const float *               data = image->GetBufferPointer();
+  if (w == 0 || h == 0)
+  {
+    return 0;
+  }
+
+  // the neighbors that precede a pixel in scan order,
+  // together these cover the 8-connected neighborhood:
+  static const int stencil[][2] = { { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } };
+
+  // first pass, merge each foreground pixel with its
+  // foreground neighbors that have already been visited:
+  cluster_forest_t forest(w * h);
+  for (unsigned int y = 0; y < h; y++)
+  {
+    for (unsigned int x = 0; x < w; x++)
+    {
+      const unsigned int i = x + y * w;
+      if (data[i] <= background)
+        continue;
+
+      for (unsigned int k = 0; k < 4; k++)
+      {
+        int u = int(x) + stencil[k][0];
+        int v = int(y) + stencil[k][1];
+
+        if ((unsigned int)(u) >= w || (unsigned int)(v) >= h)
+          continue;
+
+        const unsigned int j = u + v * w;
+        if (data[j] > background)
+        {
+          // pixel i is displaced from pixel j by -stencil[k]:
+          forest.unite(j, i, -stencil[k][0], -stencil[k][1]);
+        }
+      }
+    }
+  }
+
+  if (periodic)
+  {
+    // merge the clusters that are broken up across the periodic
+    // boundary, pixels on the last column (row) are adjacent to
+    // the pixels on the first column (row):
+    for (unsigned int y = 0; y < h; y++)
+    {
+      const unsigned int i = (w - 1) + y * w;
+      if (data[i] <= background)
+        continue;
+
+      for (int dy = -1; dy <= 1; dy++)
+      {
+        const unsigned int v = (y + h + dy) % h;
+        const unsigned int j = v * w;
+        if (data[j] > background)
+        {
+          forest.unite(i, j, 1, dy);
+        }
+      }
+    }
+
+    for (unsigned int x = 0; x < w; x++)
+    {
+      const unsigned int i = x + (h - 1) * w;
+      if (data[i] <= background)
+        continue;
+
+      for (int dx = -1; dx <= 1; dx++)
+      {
+        const unsigned int u = (x + w + dx) % w;
+        const unsigned int j = u;
+        if (data[j] > background)
+        {
+          forest.unite(i, j, dx, 1);
+        }
+      }
+    }
+  }
+
+  // second pass, accumulate the cluster statistics:
+  const unsigned int        no_label = ~0u;
+  std::vector<unsigned int> label(w * h, no_label);
+  std::vector<double>       sum_x;
+  std::vector<double>       sum_y;
+
+  for (unsigned int y = 0; y < h; y++)
+  {
+    for (unsigned int x = 0; x < w; x++)
+    {
+      const unsigned int i = x + y * w;
+      const double       m = data[i] - background;
+      if (m <= 0.0)
+        continue;
+
+      int                dx = 0;
+      int                dy = 0;
+      const unsigned int root = forest.find(i, dx, dy);
+      if (label[root] == no_label)
+      {
+        label[root] = (unsigned int)(clusters.size());
+        clusters.push_back(cluster_stats_t());
+        sum_x.push_back(0.0);
+        sum_y.push_back(0.0);
+      }
+
+      // position of this pixel in the unwrapped coordinates of the cluster:
+      const unsigned int root_x = root % w;
+      const unsigned int root_y = root / w;
+      const int          ux = int(root_x) + dx;
+      const int          uy = int(root_y) + dy;
+
+      const unsigned int id = label[root];
+      cluster_stats_t &  cluster = clusters[id];
+      cluster.mass_ += m;
+      cluster.area_++;
+      cluster.bbox_.update(ux, uy);
+      sum_x[id] += m * double(ux);
+      sum_y[id] += m * double(uy);
+    }
+  }
+
+  for (std::size_t i = 0; i < clusters.size(); i++)
+  {
+    cluster_stats_t & cluster = clusters[i];
+    cluster.cx_ = sum_x[i] / cluster.mass_;
+    cluster.cy_ = sum_y[i] / cluster.mass_;
+
+    if (periodic)
+    {
+      // keep the center of mass within the image:
+      if (cluster.cx_ < 0.0)
+        cluster.cx_ += w;
+      if (cluster.cx_ >= w)
+        cluster.cx_ -= w;
+      if (cluster.cy_ < 0.0)
+        cluster.cy_ += h;
+      if (cluster.cy_ >= h)
+        cluster.cy_ -= h;
+    }
+  }
+
+  return (unsigned int)(clusters.size());
+}
+
+
 //----------------------------------------------------------------
 // find_maxima_cm
 //
@@ -62,10 +327,7 @@ find_maxima_cm(std::list<local_max_t> &     max_list,
                const the_text_t &           prefix,
                const the_text_t &           suffix)
 {
-  typedef itk::ImageRegionConstIterator<itk_image_t>          iter_t;
-  typedef itk::ImageRegionConstIteratorWithIndex<itk_image_t> itex_t;
-  typedef itk_image_t::IndexType                              index_t;
-  typedef std::list<index_t>                                  cluster_t;
+  typedef itk::ImageRegionConstIterator<itk_image_t> iter_t;
 
   // local copy of the image that will be destroyed in the process:
   itk_image_t::Pointer peaks = cast<itk_image_t, itk_image_t>(image);
@@ -153,213 +415,255 @@ find_maxima_cm(std::list<local_max_t> &     max_list,
 #endif
 
   // classify the clusters:
-  static const int stencil[][2] = { // 4 connected:
-                                    { 0, -1 },
-                                    { -1, 0 },
-                                    { 0, 1 },
-                                    { 1, 0 },
-
-                                    // 8 connected:
-                                    { -1, -1 },
-                                    { 1, 1 },
-                                    { -1, 1 },
-                                    { 1, -1 }
-  };
-
-  the_dynamic_array_t<cluster_t>      clusters;
-  the_dynamic_array_t<cluster_bbox_t> bboxes;
-  std::vector<unsigned int>           cluster_map(w * h);
-  cluster_map.assign(w * h, ~0);
-
-  itex_t itex(peaks, peaks->GetLargestPossibleRegion());
-  for (itex.GoToBegin(); !itex.IsAtEnd(); ++itex)
-  {
-    const double v = itex.Get();
-
-    // skip over the background:
-    if (v <= background)
-      continue;
+  std::vector<cluster_stats_t> clusters;
+  label_clusters(clusters, peaks, background);
+
+  // FIXME:
+#ifdef DEBUG_MARKERS
+  itk_image_t::Pointer markers = make_image<itk_image_t>(size, background);
+#endif
 
-    const index_t      index = itex.GetIndex();
-    const unsigned int x = index[0];
-    const unsigned int y = index[1];
+  // the center of mass of each cluster is a maxima:
+  unsigned int num_peaks = 0;
+  for (std::size_t i = 0; i < clusters.size(); i++)
+  {
+    const cluster_stats_t & cluster = clusters[i];
+    double                  cm_x = cluster.cx_;
+    double                  cm_y = cluster.cy_;
+    double                  m = cluster.mass_ / double(cluster.area_);
 
-    // iterate over the neighborhood, collect the blob ids
-    // of the neighbors:
-    // James A: Changed to vector instead of a list... much faster
-    std::vector<unsigned int> neighbors;
-    neighbors.reserve(8);
+    // FIXME:
+#ifdef DEBUG_MARKERS
+    mark<itk_image_t>(markers, pnt2d(cm_x, cm_y), m, 2, '+');
+#endif
 
-    for (unsigned int k = 0; k < 8; k++)
-    {
-      int u = x + stencil[k][0];
-      int v = y + stencil[k][1];
-      if ((unsigned int)(u) >= w || (unsigned int)(v) >= h)
-        continue;
+    max_list.push_back(local_max_t(m, cm_x, cm_y, cluster.area_));
+    num_peaks++;
+  }
 
-      unsigned int cluster_id = cluster_map[u * h + v];
-      if (cluster_id != (unsigned int)(~0))
-      {
-        push_back_unique(neighbors, cluster_id);
-      }
-    }
+  // FIXME:
+#ifdef DEBUG_MARKERS
+  save<native_image_t>(cast<itk_image_t, native_image_t>(remap_min_max<itk_image_t>(markers, 0.0, 255.0)),
+                       prefix + the_text_t("markings") + suffix,
+                       false);
+#endif
 
-    if (neighbors.empty())
-    {
-      // make a new cluster:
-      clusters.append(cluster_t());
-      bboxes.append(cluster_bbox_t());
-
-      unsigned int id = clusters.end_index(true);
-      cluster_map[x * h + y] = id;
-      clusters[id].push_back(index);
-      bboxes[id].update(x, y);
-    }
-    else
-    {
-      // add this pixel to the cluster:
-      unsigned int id = *(neighbors.begin());
-      cluster_map[x * h + y] = id;
-      clusters[id].push_back(index);
-      bboxes[id].update(x, y);
+  // sort the max points so that the best candidate is first:
+  max_list.sort(std::greater<local_max_t>());
 
-      if (neighbors.size() > 1)
-      {
-        // merge the clusters into one (the first one):
-        // James A: Changed to vector instead of a list... much faster
-        std::vector<unsigned int>::iterator bi = ++(neighbors.begin());
-        for (; bi != neighbors.end(); ++bi)
-        {
-          unsigned int old_id = *bi;
-          bboxes[old_id].reset();
+  return num_peaks;
+}
 
-          while (!clusters[old_id].empty())
-          {
-            index_t ij = remove_head(clusters[old_id]);
 
-            cluster_map[ij[0] * h + ij[1]] = id;
-            clusters[id].push_back(ij);
-            bboxes[id].update(ij[0], ij[1]);
-          }
-        }
-      }
-    }
+//----------------------------------------------------------------
+// top_k_peak_t
+//
+// A local maximum candidate of find_maxima_top_k:
+//
+class top_k_peak_t
+{
+public:
+  top_k_peak_t(const float value, const unsigned int x, const unsigned int y)
+    : value_(value)
+    , x_(x)
+    , y_(y)
+  {}
+
+  inline bool
+  operator>(const top_k_peak_t & p) const
+  {
+    return value_ > p.value_;
   }
 
-  // merge the clusters that are broken up across the periodic boundary:
-  for (unsigned int i = 0; i < clusters.size(); i++)
+  float        value_;
+  unsigned int x_;
+  unsigned int y_;
+};
+
+//----------------------------------------------------------------
+// quadratic_peak_offset
+//
+// Sub-pixel offset of the vertex of a parabola fitted through
+// three equidistant samples, where the middle sample is the maximum:
+//
+static inline double
+quadratic_peak_offset(const double a, const double b, const double c, bool & ok)
+{
+  const double d = a - 2.0 * b + c;
+  ok = d < 0.0;
+  if (!ok)
   {
-    cluster_t & cluster = clusters[i];
-    if (cluster.empty())
-      continue;
+    return 0.0;
+  }
 
-    for (std::list<index_t>::iterator j = cluster.begin(); j != cluster.end(); ++j)
-    {
-      const index_t index = *j;
-      unsigned int  x = (index[0] + w) % w;
-      unsigned int  y = (index[1] + h) % h;
+  return std::max(-0.5, std::min(0.5, 0.5 * (a - c) / d));
+}
 
-      for (unsigned int k = 0; k < 8; k++)
-      {
-        int dx = stencil[k][0];
-        int dy = stencil[k][1];
+//----------------------------------------------------------------
+// find_maxima_top_k
+//
+unsigned int
+find_maxima_top_k(std::list<local_max_t> & max_list,
+                  const itk_image_t *      image,
+                  const unsigned char *    zone,
+                  const unsigned int       max_peaks)
+{
+  const itk_image_t::SizeType size = image->GetLargestPossibleRegion().GetSize();
+  const unsigned int          w = size[0];
+  const unsigned int          h = size[1];
+  const float *               pdf = image->GetBufferPointer();
 
-        // adjust for periodicity:
-        int u = (x + dx + w) % w;
-        int v = (y + dy + h) % h;
+  if (w < 3 || h < 3 || max_peaks == 0)
+  {
+    return 0;
+  }
 
-        unsigned int cluster_id = cluster_map[u * h + v];
-        if (cluster_id == i || cluster_id == (unsigned int)(~0))
-          continue;
+  // the smallest retained peak is at the top of the heap:
+  typedef std::priority_queue<top_k_peak_t, std::vector<top_k_peak_t>, std::greater<top_k_peak_t>> heap_t;
+  heap_t heap;
 
-        // figure out which boundaries this cluster was broken accross:
-        cluster_bbox_t & ba = bboxes[i];
-        cluster_bbox_t & bb = bboxes[cluster_id];
+  double       sum = 0.0;
+  unsigned int num_eligible = 0;
+  float        v_max = -std::numeric_limits<float>::max();
 
-        bool merge_x = ((bb.max_[0] - ba.min_[0] > int(w / 2)) || (ba.max_[0] - bb.min_[0] > int(w / 2)));
+  for (unsigned int y = 0; y < h; y++)
+  {
+    // neighboring rows, with periodic wraparound:
+    const float * r0 = pdf + ((y + h - 1) % h) * w;
+    const float * r1 = pdf + y * w;
+    const float * r2 = pdf + ((y + 1) % h) * w;
 
-        bool merge_y = ((bb.max_[1] - ba.min_[1] > int(h / 2)) || (ba.max_[1] - bb.min_[1] > int(h / 2)));
+    for (unsigned int x = 0; x < w; x++)
+    {
+      if (zone != nullptr && !zone[x + y * w])
+      {
+        continue;
+      }
 
-        int shift_x = (!merge_x) ? 0 : (ba.min_[0] <= 0) ? -w : w;
-        int shift_y = (!merge_y) ? 0 : (ba.min_[1] <= 0) ? -h : h;
+      const float v = r1[x];
+      sum += v;
+      num_eligible++;
+      v_max = std::max(v_max, v);
+
+      if (heap.size() == max_peaks && v <= heap.top().value_)
+      {
+        continue;
+      }
 
-        // merge the clusters into one (the first one):
-        cluster_t & neighbor = clusters[cluster_id];
+      const unsigned int xa = (x + w - 1) % w;
+      const unsigned int xb = (x + 1) % w;
 
-        bb.reset();
-        while (!neighbor.empty())
-        {
-          index_t ij = remove_head(neighbor);
-          cluster_map[ij[0] * h + ij[1]] = i;
+      // plateaus are attributed to their first pixel in scan order:
+      if (!(v > r0[xa] && v > r0[x] && v > r0[xb] && v > r1[xa] && v >= r1[xb] && v >= r2[xa] && v >= r2[x] &&
+            v >= r2[xb]))
+      {
+        continue;
+      }
 
-          ij[0] += shift_x;
-          ij[1] += shift_y;
-          clusters[i].push_back(ij);
-          ba.update(ij[0], ij[1]);
-        }
+      heap.push(top_k_peak_t(v, x, y));
+      if (heap.size() > max_peaks)
+      {
+        heap.pop();
       }
     }
   }
 
-  // FIXME:
-#ifdef DEBUG_MARKERS
-  itk_image_t::Pointer markers = make_image<itk_image_t>(size, background);
-#endif
+  if (num_eligible == 0)
+  {
+    return 0;
+  }
+
+  // peak values are measured above the mean of the eligible zone,
+  // and normalized by the highest peak:
+  const double background = sum / double(num_eligible);
+  const double v_rng = double(v_max) - background;
+  if (!(v_rng > 0.0) || v_rng == std::numeric_limits<double>::infinity())
+  {
+    // there are no peaks in this image:
+    return 0;
+  }
 
-  // calculate the center of mass for each cluster:
   unsigned int num_peaks = 0;
-  for (unsigned int i = 0; i < clusters.size(); i++)
+  while (!heap.empty())
   {
-    const cluster_t & cluster = clusters[i];
-    if (cluster.empty())
-      continue;
+    const top_k_peak_t peak = heap.top();
+    heap.pop();
 
-    double mx = 0.0;
-    double my = 0.0;
-    double mt = 0.0;
+    if (double(peak.value_) <= background)
+    {
+      continue;
+    }
 
-    for (std::list<index_t>::const_iterator j = cluster.begin(); j != cluster.end(); ++j)
+    const unsigned int x = peak.x_;
+    const unsigned int y = peak.y_;
+    const unsigned int xa = (x + w - 1) % w;
+    const unsigned int xb = (x + 1) % w;
+    const unsigned int ya = (y + h - 1) % h;
+    const unsigned int yb = (y + 1) % h;
+
+    // 3x3 neighborhood, with periodic wraparound:
+    const double v[3][3] = {
+      { pdf[xa + ya * w], pdf[x + ya * w], pdf[xb + ya * w] },
+      { pdf[xa + y * w], pdf[x + y * w], pdf[xb + y * w] },
+      { pdf[xa + yb * w], pdf[x + yb * w], pdf[xb + yb * w] },
+    };
+
+    // sub-pixel refinement, a separable quadratic fit
+    // with a center of mass fallback:
+    bool   ok_x = false;
+    bool   ok_y = false;
+    double dx = quadratic_peak_offset(v[1][0], v[1][1], v[1][2], ok_x);
+    double dy = quadratic_peak_offset(v[0][1], v[1][1], v[2][1], ok_y);
+
+    unsigned int area = 0;
+    double       mx = 0.0;
+    double       my = 0.0;
+    double       mt = 0.0;
+    for (int j = 0; j < 3; j++)
     {
-      index_t ij = *j;
-      double  x = double(ij[0]);
-      double  y = double(ij[1]);
-
-      // adjust index for periodicity:
-      if (x < 0)
-        ij[0] += w;
-      if (x >= w)
-        ij[0] -= w;
-      if (y < 0)
-        ij[1] += h;
-      if (y >= h)
-        ij[1] -= h;
-
-      double m = peaks->GetPixel(ij);
-      mx += m * x;
-      my += m * y;
-      mt += m;
+      for (int i = 0; i < 3; i++)
+      {
+        const double m = v[j][i] - background;
+        if (m <= 0.0)
+        {
+          continue;
+        }
+
+        mx += m * double(i - 1);
+        my += m * double(j - 1);
+        mt += m;
+        area++;
+      }
     }
 
-    double cm_x = mx / mt;
-    double cm_y = my / mt;
-    double m = mt / double(cluster.size());
+    if (!ok_x)
+    {
+      dx = mx / mt;
+    }
 
-    // FIXME:
-#ifdef DEBUG_MARKERS
-    mark<itk_image_t>(markers, pnt2d(cm_x, cm_y), m, 2, '+');
-#endif
+    if (!ok_y)
+    {
+      dy = my / mt;
+    }
 
-    max_list.push_back(local_max_t(m, cm_x, cm_y, cluster.size()));
+    // keep the peak coordinates within [0, w) x [0, h),
+    // the caller considers the wrapped permutations:
+    double px = double(x) + dx;
+    double py = double(y) + dy;
+    if (px < 0.0)
+      px += w;
+    if (px >= w)
+      px -= w;
+    if (py < 0.0)
+      py += h;
+    if (py >= h)
+      py -= h;
+
+    const double value = (double(peak.value_) - background) / v_rng;
+    max_list.push_back(local_max_t(value, px, py, area));
     num_peaks++;
   }
 
-  // FIXME:
-#ifdef DEBUG_MARKERS
-  save<native_image_t>(cast<itk_image_t, native_image_t>(remap_min_max<itk_image_t>(markers, 0.0, 255.0)),
-                       prefix + the_text_t("markings") + suffix,
-                       false);
-#endif
-
   // sort the max points so that the best candidate is first:
   max_list.sort(std::greater<local_max_t>());
 
@@ -462,131 +766,320 @@ reject_negligible_overlap(std::list<overlap_t> & ol, const double threshold)
 
 
 //----------------------------------------------------------------
-// find_correlation
+// spectrum_cache_t::key_t::operator <
 //
-template <>
-unsigned int
-find_correlation(std::list<local_max_t> & max_list,
-                 const itk_image_t *      fi,
-                 const itk_image_t *      mi,
+bool
+spectrum_cache_t::key_t::operator<(const key_t & k) const
+{
+  if (image_ != k.image_)
+    return image_ < k.image_;
+  if (mtime_ != k.mtime_)
+    return mtime_ < k.mtime_;
+  if (tag_ != k.tag_)
+    return tag_ < k.tag_;
+  if (nx_ != k.nx_)
+    return nx_ < k.nx_;
+  return ny_ < k.ny_;
+}
 
-                 // low pass filter parameters
-                 // (resampled data requires less smoothing):
-                 double       lp_filter_r,
-                 double       lp_filter_s,
-                 const double overlap_min,
-                 const double overlap_max)
+//----------------------------------------------------------------
+// spectrum_cache_t::spectrum_cache_t
+//
+spectrum_cache_t::spectrum_cache_t(const std::size_t max_bytes)
+  : max_bytes_(max_bytes)
+  , bytes_(0)
+  , hits_(0)
+  , misses_(0)
+{}
+
+//----------------------------------------------------------------
+// spectrum_cache_t::make_key
+//
+spectrum_cache_t::key_t
+spectrum_cache_t::make_key(const tile_t & tile, const unsigned int nx, const unsigned int ny)
 {
-  itk_image_t::SizeType max_sz = calc_padding<itk_image_t>(fi, mi);
+  key_t key;
+  key.image_ = tile.image_;
+  key.mtime_ = tile.mtime_;
+  key.tag_ = tile.tag_;
+  key.nx_ = nx;
+  key.ny_ = ny;
+  return key;
+}
 
-  typedef itk_image_t::SizeType   sz_t;
-  typedef itk_image_t::RegionType rn_t;
+//----------------------------------------------------------------
+// spectrum_cache_t::find
+//
+spectrum_cache_t::spectrum_ptr_t
+spectrum_cache_t::find(const tile_t & tile, const unsigned int nx, const unsigned int ny)
+{
+  const key_t key = make_key(tile, nx, ny);
 
-  rn_t fi_region = fi->GetLargestPossibleRegion();
-  sz_t fi_size = fi_region.GetSize();
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<key_t, lru_t::iterator>::iterator found = index_.find(key);
+  if (found == index_.end())
+  {
+    misses_++;
+    return spectrum_ptr_t();
+  }
+
+  // move the entry to the front of the list:
+  lru_.splice(lru_.begin(), lru_, found->second);
+  hits_++;
+  return found->second->second;
+}
+
+//----------------------------------------------------------------
+// spectrum_cache_t::insert
+//
+void
+spectrum_cache_t::insert(const tile_t &         tile,
+                         const unsigned int     nx,
+                         const unsigned int     ny,
+                         const spectrum_ptr_t & spectrum)
+{
+  const key_t       key = make_key(tile, nx, ny);
+  const std::size_t num_bytes = sizeof(fft_complex_t) * spectrum->nx() * spectrum->ny();
+  if (num_bytes > max_bytes_)
+  {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (index_.find(key) != index_.end())
+  {
+    // another thread got here first:
+    return;
+  }
+
+  // evict the least recently used spectra:
+  while (!lru_.empty() && bytes_ + num_bytes > max_bytes_)
+  {
+    const spectrum_ptr_t & lru = lru_.back().second;
+    bytes_ -= sizeof(fft_complex_t) * lru->nx() * lru->ny();
+    index_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+
+  lru_.push_front(std::make_pair(key, spectrum));
+  index_[key] = lru_.begin();
+  bytes_ += num_bytes;
+}
 
-  rn_t mi_region = mi->GetLargestPossibleRegion();
-  sz_t mi_size = mi_region.GetSize();
+//----------------------------------------------------------------
+// spectrum_cache_t::clear
+//
+void
+spectrum_cache_t::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  index_.clear();
+  lru_.clear();
+  bytes_ = 0;
+}
 
-  itk_image_t::ConstPointer z0 =
-    (fi_size[0] == max_sz[0] && fi_size[1] == max_sz[1]) ? fi : pad<itk_image_t>(fi, max_sz);
-  itk_image_t::ConstPointer z1 =
-    (mi_size[0] == max_sz[0] && mi_size[1] == max_sz[1]) ? mi : pad<itk_image_t>(mi, max_sz);
+//----------------------------------------------------------------
+// spectrum_cache_t::size_in_bytes
+//
+std::size_t
+spectrum_cache_t::size_in_bytes() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
 
-  fft_data_t f0;
-  fft(z0, f0);
-  f0.apply_lp_filter(lp_filter_r, lp_filter_s);
+//----------------------------------------------------------------
+// spectrum_cache_t::hits
+//
+std::size_t
+spectrum_cache_t::hits() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
 
-  fft_data_t f1;
-  fft(z1, f1);
-  f1.apply_lp_filter(lp_filter_r, lp_filter_s);
+//----------------------------------------------------------------
+// spectrum_cache_t::misses
+//
+std::size_t
+spectrum_cache_t::misses() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
 
-  const unsigned int & nx = f0.nx();
-  const unsigned int & ny = f0.ny();
-  fft_data_t           P(nx, ny);
 
-  // Blank out areas outside the min or max overlap
-  unsigned int xLeftBorderStart = std::ceil(nx * overlap_min);
-  unsigned int xRightBorderStart = nx - xLeftBorderStart;
-  unsigned int yLowBorderStart = std::ceil(ny * overlap_min);
-  unsigned int yHighBorderStart = ny - yLowBorderStart;
+//----------------------------------------------------------------
+// crop_and_apodize
+//
+// Crop the image to the given size, keeping the origin in place
+// so the displacements found on the correlation surface are not
+// affected, and taper the edges of the cropped image with a raised
+// cosine window. Dimensions smaller than the given size are padded
+// with zeros.
+//
+static itk_image_t::Pointer
+crop_and_apodize(const itk_image_t * image, const itk_image_t::SizeType & max_sz)
+{
+  const unsigned int nx = max_sz[0];
+  const unsigned int ny = max_sz[1];
+
+  const itk_image_t::SizeType sz = image->GetLargestPossibleRegion().GetSize();
+  const unsigned int          w = std::min<unsigned int>(sz[0], nx);
+  const unsigned int          h = std::min<unsigned int>(sz[1], ny);
+
+  // taper 1/16th of the cropped extent on each side:
+  const unsigned int tx = std::max(1u, w / 16);
+  const unsigned int ty = std::max(1u, h / 16);
+  std::vector<float> wx(w, 1.0f);
+  std::vector<float> wy(h, 1.0f);
+  for (unsigned int i = 0; i < tx && i < w; i++)
+  {
+    const float v = float(0.5 * (1.0 - cos(M_PI * (double(i) + 0.5) / double(tx))));
+    wx[i] = v;
+    wx[w - 1 - i] = v;
+  }
 
+  for (unsigned int i = 0; i < ty && i < h; i++)
+  {
+    const float v = float(0.5 * (1.0 - cos(M_PI * (double(i) + 0.5) / double(ty))));
+    wy[i] = v;
+    wy[h - 1 - i] = v;
+  }
 
-  unsigned int xLeftBorderCutoff = std::ceil(nx * overlap_max);
-  unsigned int xRightBorderCutoff = nx - xLeftBorderCutoff;
-  unsigned int yLowBorderCutoff = std::ceil(ny * overlap_max);
-  unsigned int yHighBorderCutoff = ny - yLowBorderCutoff;
+  itk_image_t::Pointer out = make_image<itk_image_t>(max_sz);
+  out->SetSpacing(image->GetSpacing());
 
-  for (unsigned int x = 0; x < nx; x++)
+  const float * src = image->GetBufferPointer();
+  float *       dst = out->GetBufferPointer();
+  for (unsigned int y = 0; y < h; y++)
   {
-    for (unsigned int y = 0; y < ny; y++)
+    const float * s = src + y * sz[0];
+    float *       d = dst + y * nx;
+    for (unsigned int x = 0; x < w; x++)
     {
-      // TODO: Skip pixels we know can't possibly be overlapping
-      /*
-      if(!(y <= yLowBorderCutoff ||
-           y >= yHighBorderCutoff ||
-           x <= xLeftBorderCutoff ||
-           x >= xRightBorderCutoff))
-        {
-            P(x, y) = 0;
-            continue;
-        }
-      */
-#if 1
-      // Girod-Kuo, normalized cross power spectrum,
-      // corresponds to phase correlation in spatial domain:
-      fft_complex_t p10 = f1(x, y) * std::conj(f0(x, y));
-      P(x, y) = _div(p10, _add(std::sqrt(p10 * std::conj(p10)), 1e-8f));
-#else
-      // cross power spectrum,
-      // corresponds to cross correlation in spatial domain:
-      P(x, y) = f1(x, y) * std::conj(f0(x, y));
-#endif
+      d[x] = s[x] * wx[x] * wy[y];
     }
   }
 
-  // resampled data produces less noisy PDF and requires less smoothing:
-  P.apply_lp_filter(lp_filter_r * 0.8, lp_filter_s);
+  return out;
+}
 
-  // calculate the displacement probability density function:
-  fft_data_t ifft_P;
+//----------------------------------------------------------------
+// padded_spectrum
+//
+spectrum_cache_t::spectrum_ptr_t
+padded_spectrum(const itk_image_t *              image,
+                const itk_image_t::SizeType &    max_sz,
+                spectrum_cache_t *               spectrum_cache,
+                const spectrum_cache_t::tile_t & tile)
+{
+  const unsigned int nx = max_sz[0];
+  const unsigned int ny = max_sz[1];
 
-#ifndef NDEBUG // get around an annoying compiler warning:
-  bool ok =
-#endif
-    ifft(P, ifft_P);
-  assert(ok);
+  const bool use_cache = spectrum_cache != nullptr && tile.valid();
+  if (use_cache)
+  {
+    spectrum_cache_t::spectrum_ptr_t found = spectrum_cache->find(tile, nx, ny);
+    if (found)
+    {
+      return found;
+    }
+  }
 
-  itk_image_t::Pointer PDF = ifft_P.real();
+  const itk_image_t::SizeType sz = image->GetLargestPossibleRegion().GetSize();
+  itk_image_t::ConstPointer   z = image;
+  if (sz[0] > nx || sz[1] > ny)
+  {
+    // cropped images are always smaller than their padded
+    // counterparts, so their cached spectra never collide:
+    z = crop_and_apodize(image, max_sz);
+  }
+  else if (sz[0] != nx || sz[1] != ny)
+  {
+    z = pad<itk_image_t>(image, max_sz);
+  }
 
-  itk_image_t::PixelType min;
-  itk_image_t::PixelType max;
-  image_min_max<itk_image_t>(PDF.GetPointer(), min, max);
+  // the input images are real, so their spectra are Hermitian
+  // and only the non-redundant half has to be processed:
+  std::shared_ptr<fft_data_t> spectrum(new fft_data_t());
+  if (!fft_r2c(z, *spectrum))
+  {
+    return spectrum_cache_t::spectrum_ptr_t();
+  }
+
+  if (use_cache)
+  {
+    spectrum_cache->insert(tile, nx, ny, spectrum);
+  }
+
+  return spectrum;
+}
+
+
+//----------------------------------------------------------------
+// MAX_OVERLAP_ZONES
+//
+static const std::size_t MAX_OVERLAP_ZONES = 64;
+
+//----------------------------------------------------------------
+// overlap_zone_key_t
+//
+class overlap_zone_key_t
+{
+public:
+  bool
+  operator<(const overlap_zone_key_t & k) const
+  {
+    if (fi_w_ != k.fi_w_)
+      return fi_w_ < k.fi_w_;
+    if (fi_h_ != k.fi_h_)
+      return fi_h_ < k.fi_h_;
+    if (w_ != k.w_)
+      return w_ < k.w_;
+    if (h_ != k.h_)
+      return h_ < k.h_;
+    if (overlap_min_ != k.overlap_min_)
+      return overlap_min_ < k.overlap_min_;
+    return overlap_max_ < k.overlap_max_;
+  }
+
+  unsigned int fi_w_;
+  unsigned int fi_h_;
+  unsigned int w_;
+  unsigned int h_;
+  double       overlap_min_;
+  double       overlap_max_;
+};
+
+//----------------------------------------------------------------
+// overlap_zones
+//
+static std::map<overlap_zone_key_t, overlap_zone_ptr_t> overlap_zones;
+static std::mutex                                        overlap_zones_mutex;
+
+//----------------------------------------------------------------
+// make_overlap_zone
+//
+static overlap_zone_ptr_t
+make_overlap_zone(const itk_image_t::SizeType & fi_size,
+                  const itk_image_t::SizeType & padded_size,
+                  const double                  overlap_min,
+                  const double                  overlap_max)
+{
+  const unsigned int w = padded_size[0];
+  const unsigned int h = padded_size[1];
+
+  std::shared_ptr<overlap_zone_t> zone(new overlap_zone_t);
+  zone->mask_.assign(w * h, 1);
+  unsigned char * mask = &(zone->mask_[0]);
+  unsigned int    pixels = 0;
 
-  // save<native_image_t>(cast<itk_image_t, native_image_t>(remap_min_max<itk_image_t>(PDF, 0.0, 255.0)),
-  // "Prefill.tif");
-
-  // Set areas that cannot be a match to zero
-  // TODO: //Need to fill with an ellipse to get mins/maxs correct
-
-  //	if(xLeftBorderCutoff < xRightBorderCutoff &&
-  //	   yLowBorderCutoff < yHighBorderCutoff)
-  //	{
-  //		fill<itk_image_t>(PDF, xLeftBorderCutoff, yLowBorderCutoff, xRightBorderCutoff-xLeftBorderCutoff,
-  //yHighBorderCutoff-yLowBorderCutoff, min);
-  //	}
-  //
-  //  #ifdef DEBUG
-  //	save<native_image_t>(cast<itk_image_t, native_image_t>(remap_min_max<itk_image_t>(PDF, 0.0, 255.0)),
-  //"Prefill.tif");
-  //  #endif
-
-  int                    PixelsInOverlapZone = 0;
   itk_image_t::IndexType iPixel;
-  for (iPixel[1] = 0; iPixel[1] <= ny / 2; iPixel[1]++)
+  for (iPixel[1] = 0; iPixel[1] <= h / 2; iPixel[1]++)
   {
     vec2d_t pt;
-    for (iPixel[0] = 0; iPixel[0] <= nx / 2; iPixel[0]++)
+    for (iPixel[0] = 0; iPixel[0] <= w / 2; iPixel[0]++)
     {
       pt[0] = iPixel[0];
       pt[1] = iPixel[1];
@@ -594,97 +1087,217 @@ find_correlation(std::list<local_max_t> & max_list,
       double overlap = OverlapPercent(fi_size, pt);
       if (overlap >= overlap_min && overlap <= overlap_max)
       {
-        PixelsInOverlapZone += 4;
+        pixels += 4;
         continue;
       }
 
-      pt[0] = nx - iPixel[0];
+      pt[0] = w - iPixel[0];
       pt[1] = iPixel[1];
 
       overlap = OverlapPercent(fi_size, pt);
       if (overlap >= overlap_min && overlap <= overlap_max)
       {
-        PixelsInOverlapZone += 4;
+        pixels += 4;
         continue;
       }
 
       pt[0] = iPixel[0];
-      pt[1] = ny - iPixel[1];
+      pt[1] = h - iPixel[1];
 
       overlap = OverlapPercent(fi_size, pt);
       if (overlap >= overlap_min && overlap <= overlap_max)
       {
-        PixelsInOverlapZone += 4;
+        pixels += 4;
         continue;
       }
 
-      pt[0] = nx - iPixel[0];
-      pt[1] = ny - iPixel[1];
+      pt[0] = w - iPixel[0];
+      pt[1] = h - iPixel[1];
 
       overlap = OverlapPercent(fi_size, pt);
       if (overlap >= overlap_min && overlap <= overlap_max)
       {
-        PixelsInOverlapZone += 4;
+        pixels += 4;
         continue;
       }
 
       // If we got here the pixel can't be overlapping
-      itk_image_t::IndexType iSetPixel = iPixel;
-      PDF->SetPixel(iSetPixel, min);
-
-      iSetPixel[0] = (nx - 1) - iPixel[0];
-      PDF->SetPixel(iSetPixel, min);
-
-      iSetPixel[0] = iPixel[0];
-      iSetPixel[1] = (ny - 1) - iPixel[1];
-      PDF->SetPixel(iSetPixel, min);
-
-      iSetPixel[0] = (nx - 1) - iPixel[0];
-      iSetPixel[1] = (ny - 1) - iPixel[1];
-      PDF->SetPixel(iSetPixel, min);
-      /*
-      if(overlap < overlap_min)
-        PDF->SetPixel(iPixel, min);
-
-      else if(overlap > overlap_max)
-        PDF->SetPixel(iPixel, min);
-      */
+      const unsigned int x0 = iPixel[0];
+      const unsigned int y0 = iPixel[1];
+      const unsigned int x1 = (w - 1) - x0;
+      const unsigned int y1 = (h - 1) - y0;
+      mask[x0 + y0 * w] = 0;
+      mask[x1 + y0 * w] = 0;
+      mask[x0 + y1 * w] = 0;
+      mask[x1 + y1 * w] = 0;
     }
   }
 
-  /*
-    itk_image_t::IndexType ix;
-    ix[0] = 0;
-    ix[1] = 0;
-    PDF->SetPixel(ix, min);
-    ix[0] = nx-1;
-    ix[1] = 0;
-    PDF->SetPixel(ix, min);
-    ix[0] = 0;
-    ix[1] = ny-1;
-    PDF->SetPixel(ix, min);
-    ix[0] = nx-1;
-    ix[1] = ny-1;
-    PDF->SetPixel(ix, min);
-  */
-  //	fill<itk_image_t>(PDF, 0, 0, xLeftBorderStart, ny, min);
-  //	ill<itk_image_t>(PDF, xRightBorderStart, 0, nx-xRightBorderStart, ny, min);
-  //	fill<itk_image_t>(PDF, xLeftBorderStart, 0, xRightBorderStart-xLeftBorderStart, yLowBorderStart, min);
-  //	fill<itk_image_t>(PDF, xLeftBorderStart, yHighBorderStart, xRightBorderStart-xLeftBorderStart,
-  //ny-yHighBorderStart, min);
-
-  //  #ifdef DEBUG
-  //	save<native_image_t>(cast<itk_image_t, native_image_t>(remap_min_max<itk_image_t>(PDF, 0.0, 255.0)),
-  //"Postfill.tif");
-  //  #endif
+  zone->pixels_ = pixels;
+  return zone;
+}
+
+//----------------------------------------------------------------
+// overlap_zone
+//
+overlap_zone_ptr_t
+overlap_zone(const itk_image_t::SizeType & fi_size,
+             const itk_image_t::SizeType & padded_size,
+             const double                  overlap_min,
+             const double                  overlap_max)
+{
+  overlap_zone_key_t key;
+  key.fi_w_ = fi_size[0];
+  key.fi_h_ = fi_size[1];
+  key.w_ = padded_size[0];
+  key.h_ = padded_size[1];
+  key.overlap_min_ = overlap_min;
+  key.overlap_max_ = overlap_max;
+
+  {
+    std::lock_guard<std::mutex>                                       lock(overlap_zones_mutex);
+    std::map<overlap_zone_key_t, overlap_zone_ptr_t>::const_iterator found = overlap_zones.find(key);
+    if (found != overlap_zones.end())
+      return found->second;
+  }
+
+  // build the zone outside the lock, if another thread builds
+  // the same zone concurrently the first one to finish wins:
+  overlap_zone_ptr_t zone = make_overlap_zone(fi_size, padded_size, overlap_min, overlap_max);
+
+  std::lock_guard<std::mutex> lock(overlap_zones_mutex);
+  if (overlap_zones.size() >= MAX_OVERLAP_ZONES)
+  {
+    // zones that are still in use stay alive with their users:
+    overlap_zones.clear();
+  }
+
+  return overlap_zones.insert(std::make_pair(key, zone)).first->second;
+}
+
+
+//----------------------------------------------------------------
+// find_correlation
+//
+template <>
+unsigned int
+find_correlation(std::list<local_max_t> & max_list,
+                 const itk_image_t *      fi,
+                 const itk_image_t *      mi,
+
+                 // low pass filter parameters
+                 // (resampled data requires less smoothing):
+                 double       lp_filter_r,
+                 double       lp_filter_s,
+                 const double overlap_min,
+                 const double overlap_max,
+
+                 // optional cache of the filtered spectra:
+                 spectrum_cache_t *               spectrum_cache,
+                 const spectrum_cache_t::tile_t & fi_tile,
+                 const spectrum_cache_t::tile_t & mi_tile,
+
+                 // how to find the maxima of the PDF:
+                 const peak_detector_t peak_detector,
+
+                 // how to size the images for the FFT:
+                 const fft_padding_t fft_padding)
+{
+  itk_image_t::SizeType max_sz = calc_fft_padding<itk_image_t>(fi, mi, fft_padding);
+
+  typedef itk_image_t::SizeType   sz_t;
+  typedef itk_image_t::RegionType rn_t;
+
+  rn_t fi_region = fi->GetLargestPossibleRegion();
+  sz_t fi_size = fi_region.GetSize();
+
+  const unsigned int nx = max_sz[0];
+  const unsigned int ny = max_sz[1];
+
+  spectrum_cache_t::spectrum_ptr_t f0 =
+    padded_spectrum(fi, max_sz, spectrum_cache, fi_tile.valid() ? fi_tile : spectrum_cache_t::tile_t(fi));
+  if (!f0)
+  {
+    return 0;
+  }
+
+  spectrum_cache_t::spectrum_ptr_t f1 =
+    padded_spectrum(mi, max_sz, spectrum_cache, mi_tile.valid() ? mi_tile : spectrum_cache_t::tile_t(mi));
+  if (!f1)
+  {
+    return 0;
+  }
+
+  // both inputs are low-pass filtered with the same mask, and the
+  // cross power spectrum is low-pass filtered once more, all three
+  // filters are applied in the same sweep over the spectrum:
+  const lp_filter_mask_t in_mask = lp_filter_mask(nx, ny, true, lp_filter_r, lp_filter_s);
+
+  // resampled data produces less noisy PDF and requires less smoothing:
+  const lp_filter_mask_t pdf_mask = lp_filter_mask(nx, ny, true, lp_filter_r * 0.8, lp_filter_s);
+
+  const unsigned int    num_bins = f0->nx() * f0->ny();
+  const fft_complex_t * s0 = f0->buffer();
+  const fft_complex_t * s1 = f1->buffer();
+  const float *         m0 = &((*in_mask)[0]);
+  const float *         m1 = &((*pdf_mask)[0]);
+  fft_data_t            P(f0->nx(), f0->ny());
+  fft_complex_t *       sp = P.buffer();
+
+#if 1
+  // Girod-Kuo, normalized cross power spectrum,
+  // corresponds to phase correlation in spatial domain,
+  // filtering both inputs scales their product by the mask squared:
+  normalized_cross_power(s0, s1, m0, m1, sp, num_bins);
+#else
+  for (unsigned int i = 0; i < num_bins; i++)
+  {
+    // cross power spectrum,
+    // corresponds to cross correlation in spatial domain:
+    sp[i] = (m0[i] * m0[i] * m1[i]) * (s1[i] * std::conj(s0[i]));
+  }
+#endif
+
+  // calculate the displacement probability density function,
+  // the inverse transform writes straight into the PDF image:
+  itk_image_t::Pointer PDF = itk_image_t::New();
+  PDF->SetRegions(max_sz);
+  PDF->Allocate();
+
+#ifndef NDEBUG // get around an annoying compiler warning:
+  bool ok =
+#endif
+    ifft_c2r(P, PDF);
+  assert(ok);
+
+  // the displacements that would produce an overlap outside
+  // of the [overlap_min, overlap_max] range can't be a match:
+  const overlap_zone_ptr_t zone_ptr = overlap_zone(fi_size, max_sz, overlap_min, overlap_max);
+  const unsigned char *    zone = &(zone_ptr->mask_[0]);
+
+  if (peak_detector == PEAK_DETECTOR_TOP_K_E)
+  {
+    // the ineligible displacements are simply skipped over,
+    // the PDF does not have to be modified:
+    return find_maxima_top_k(max_list, PDF, zone);
+  }
+
+  // Set areas that cannot be a match to the PDF minimum:
+  itk_image_t::PixelType min;
+  itk_image_t::PixelType max;
+  image_min_max<itk_image_t>(PDF.GetPointer(), min, max);
+
+  // a branch-free select, easy for the compiler to vectorize:
+  itk_image_t::PixelType * pdf = PDF->GetBufferPointer();
+  const unsigned int       num_pixels = nx * ny;
+  for (unsigned int i = 0; i < num_pixels; i++)
+  {
+    pdf[i] = zone[i] ? pdf[i] : min;
+  }
 
   // look for the maxima in the PDF,
   // TODO: Should we count the dead regions towards our histogram because they'll be examined?
-  // double area = double(max_sz[0] * max_sz[1]);
-  // if(xLeftBorderCutoff < xRightBorderCutoff &&
-  // yLowBorderCutoff < yHighBorderCutoff)
-  // area -= ((xRightBorderCutoff-xLeftBorderCutoff) * (yHighBorderCutoff-yLowBorderCutoff));
-  double area = PixelsInOverlapZone;
+  double area = zone_ptr->pixels_;
 
   // a minimum of 5 pixels and a maximum of 64 pixels may be attributed
   // to local maxima in the image:
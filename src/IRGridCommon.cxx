@@ -331,3 +331,295 @@ setup_mesh_transform(the_mesh_transform_t &         transform,
   transform.setup(tile_min, tile_max, uv_list, xy_arr);
   return true;
 }
+
+
+//----------------------------------------------------------------
+// ncc_translation_t::eval
+//
+double
+ncc_translation_t::eval(const vec2d_t & t, vec2d_t & dmdt) const
+{
+  return eval(fixed_, moving_, t, dmdt);
+}
+
+//----------------------------------------------------------------
+// ncc_translation_t::downsample
+//
+void
+ncc_translation_t::downsample(const buffer_t & fine, buffer_t & coarse)
+{
+  coarse.w_ = fine.w_ / 2;
+  coarse.h_ = fine.h_ / 2;
+  coarse.x0_ = fine.x0_ + 0.5 * fine.sx_;
+  coarse.y0_ = fine.y0_ + 0.5 * fine.sy_;
+  coarse.sx_ = 2.0 * fine.sx_;
+  coarse.sy_ = 2.0 * fine.sy_;
+  coarse.data_.resize(coarse.w_ * coarse.h_);
+  coarse.mask_.resize(coarse.w_ * coarse.h_);
+
+  unsigned int i = 0;
+  for (unsigned int y = 0; y < coarse.h_; y++)
+  {
+    const unsigned int    j = 2 * y * fine.w_;
+    const float *         r0 = &(fine.data_[j]);
+    const float *         r1 = r0 + fine.w_;
+    const unsigned char * m0 = &(fine.mask_[j]);
+    const unsigned char * m1 = m0 + fine.w_;
+
+    for (unsigned int x = 0; x < coarse.w_; x++, i++)
+    {
+      const unsigned int k = 2 * x;
+      coarse.data_[i] = 0.25f * (r0[k] + r0[k + 1] + r1[k] + r1[k + 1]);
+      coarse.mask_[i] = m0[k] && m0[k + 1] && m1[k] && m1[k + 1];
+    }
+  }
+}
+
+//----------------------------------------------------------------
+// ncc_translation_t::eval
+//
+double
+ncc_translation_t::eval(const buffer_t & f, const buffer_t & m, const vec2d_t & t, vec2d_t & dmdt)
+{
+  dmdt[0] = 0.0;
+  dmdt[1] = 0.0;
+  if (f.w_ == 0 || f.h_ == 0 || m.w_ < 2 || m.h_ < 2)
+  {
+    return std::numeric_limits<double>::max();
+  }
+
+  // fixed pixel (x, y) maps to the moving continuous index (ax + bx * x, ay + by * y):
+  const double bx = f.sx_ / m.sx_;
+  const double by = f.sy_ / m.sy_;
+  const double ax = (f.x0_ + t[0] - m.x0_) / m.sx_;
+  const double ay = (f.y0_ + t[1] - m.y0_) / m.sy_;
+
+  // the fixed pixels that map inside the moving buffer:
+  const double umax = double(m.w_ - 1);
+  const double vmax = double(m.h_ - 1);
+  const double x0 = std::max(0.0, std::ceil(-ax / bx));
+  const double x1 = std::min(double(f.w_ - 1), std::floor((umax - ax) / bx));
+  const double y0 = std::max(0.0, std::ceil(-ay / by));
+  const double y1 = std::min(double(f.h_ - 1), std::floor((vmax - ay) / by));
+  if (x1 < x0 || y1 < y0)
+  {
+    return std::numeric_limits<double>::max();
+  }
+
+  // counters:
+  double       sf = 0.0;
+  double       sm = 0.0;
+  double       sff = 0.0;
+  double       smm = 0.0;
+  double       sfm = 0.0;
+  double       dsm[] = { 0.0, 0.0 };
+  double       dsmm[] = { 0.0, 0.0 };
+  double       dsfm[] = { 0.0, 0.0 };
+  unsigned int n = 0;
+
+  for (unsigned int y = (unsigned int)y0; y <= (unsigned int)y1; y++)
+  {
+    const double       v = std::min(vmax, ay + by * double(y));
+    const unsigned int iv = std::min((unsigned int)v, m.h_ - 2);
+    const double       fv = v - double(iv);
+    const unsigned int nv = (unsigned int)(v + 0.5);
+
+    const float *         f_row = &(f.data_[y * f.w_]);
+    const unsigned char * f_mask = &(f.mask_[y * f.w_]);
+    const float *         m_row = &(m.data_[iv * m.w_]);
+    const unsigned char * m_mask = &(m.mask_[nv * m.w_]);
+
+    for (unsigned int x = (unsigned int)x0; x <= (unsigned int)x1; x++)
+    {
+      if (!f_mask[x])
+        continue;
+
+      const double       u = std::min(umax, ax + bx * double(x));
+      const unsigned int iu = std::min((unsigned int)u, m.w_ - 2);
+      const double       fu = u - double(iu);
+
+      // the moving mask is sampled at the nearest pixel:
+      if (!m_mask[(unsigned int)(u + 0.5)])
+        continue;
+
+      const double m00 = m_row[iu];
+      const double m10 = m_row[iu + 1];
+      const double m01 = m_row[iu + m.w_];
+      const double m11 = m_row[iu + m.w_ + 1];
+
+      // bilinear interpolation, and its derivatives:
+      const double a = m00 + fu * (m10 - m00);
+      const double b = m01 + fu * (m11 - m01);
+      const double M = a + fv * (b - a);
+      const double dMdx = ((m10 - m00) + fv * ((m11 - m01) - (m10 - m00))) / m.sx_;
+      const double dMdy = (b - a) / m.sy_;
+      const double F = f_row[x];
+
+      sf += F;
+      sm += M;
+      sff += F * F;
+      smm += M * M;
+      sfm += F * M;
+
+      dsm[0] += dMdx;
+      dsm[1] += dMdy;
+      dsmm[0] += 2.0 * M * dMdx;
+      dsmm[1] += 2.0 * M * dMdy;
+      dsfm[0] += F * dMdx;
+      dsfm[1] += F * dMdy;
+      n++;
+    }
+  }
+
+  if (n < 2)
+  {
+    return std::numeric_limits<double>::max();
+  }
+
+  // covariances:
+  const double N = double(n);
+  const double cff = sff - sf * sf / N;
+  const double cmm = smm - sm * sm / N;
+  const double cfm = sfm - sf * sm / N;
+  if (cff <= 0.0 || cmm <= 0.0)
+  {
+    return std::numeric_limits<double>::max();
+  }
+
+  const double s = std::sqrt(cff * cmm);
+  const double r = cfm / s;
+  for (unsigned int j = 0; j < 2; j++)
+  {
+    const double dcfm = dsfm[j] - sf * dsm[j] / N;
+    const double dcmm = dsmm[j] - 2.0 * sm * dsm[j] / N;
+    dmdt[j] = -(dcfm - 0.5 * cfm * dcmm / cmm) / s;
+  }
+
+  return -r;
+}
+
+//----------------------------------------------------------------
+// ncc_translation_t::optimize
+//
+double
+ncc_translation_t::optimize(vec2d_t &          t,
+                            const unsigned int iterations,
+                            const double       min_step,
+                            const double       max_step,
+                            const unsigned int pyramid_levels,
+                            const unsigned int pick_up_pace_steps)
+{
+  // the coarse levels, while the neighborhoods remain large enough
+  // to correlate; the buffers are kept for the next neighborhoods:
+  if (fixed_pyramid_.size() + 1 < pyramid_levels)
+  {
+    fixed_pyramid_.resize(pyramid_levels - 1);
+    moving_pyramid_.resize(pyramid_levels - 1);
+  }
+
+  unsigned int levels = 1;
+  for (; levels < pyramid_levels; levels++)
+  {
+    const buffer_t & f = (levels > 1) ? fixed_pyramid_[levels - 2] : fixed_;
+    const buffer_t & m = (levels > 1) ? moving_pyramid_[levels - 2] : moving_;
+    if (std::min(f.w_, f.h_) < 16 || std::min(m.w_, m.h_) < 16)
+    {
+      break;
+    }
+
+    downsample(f, fixed_pyramid_[levels - 1]);
+    downsample(m, moving_pyramid_[levels - 1]);
+  }
+
+  // coarse to fine, every level starts where the coarser level
+  // stopped and only needs to search about one coarse pixel; the
+  // first steps are a couple of pixels, so the descent does not leap
+  // out of the basin of the optimum (single scale starts with the
+  // longest step, as before):
+  double metric = std::numeric_limits<double>::max();
+  for (unsigned int level = levels; level > 0; level--)
+  {
+    const buffer_t & f = (level > 1) ? fixed_pyramid_[level - 2] : fixed_;
+    const buffer_t & m = (level > 1) ? moving_pyramid_[level - 2] : moving_;
+
+    const double pixel = std::max(f.sx_, f.sy_);
+    const double level_min_step = (level > 1) ? std::max(min_step, 0.1 * pixel) : min_step;
+    const double level_first_step = (levels > 1) ? 2.0 * pixel : max_step;
+    const double level_max_step = (level < levels) ? std::min(max_step, 4.0 * pixel) : max_step;
+    metric = descend(f, m, t, iterations, level_min_step, level_first_step, level_max_step, pick_up_pace_steps);
+  }
+
+  return metric;
+}
+
+//----------------------------------------------------------------
+// ncc_translation_t::descend
+//
+double
+ncc_translation_t::descend(const buffer_t &   f,
+                           const buffer_t &   m,
+                           vec2d_t &          t,
+                           const unsigned int iterations,
+                           const double       min_step,
+                           const double       first_step,
+                           const double       max_step,
+                           const unsigned int pick_up_pace_steps)
+{
+  vec2d_t dmdt;
+  double  metric = eval(f, m, t, dmdt);
+  if (metric == std::numeric_limits<double>::max())
+  {
+    return metric;
+  }
+
+  // steps longer than the moving neighborhood can not improve the metric:
+  const double extent = std::max(double(m.w_) * m.sx_, double(m.h_) * m.sy_);
+  const double longest_step = std::min(max_step, extent);
+  double       step = std::min(first_step, longest_step);
+  unsigned int successes = 0;
+
+  vec2d_t next_dmdt;
+  for (unsigned int i = 0; i < iterations && step >= min_step; i++)
+  {
+    const double gradient_magnitude = dmdt.GetNorm();
+    if (gradient_magnitude < 1e-6)
+    {
+      break;
+    }
+
+    const vec2d_t next = t - dmdt * (step / gradient_magnitude);
+    const double  next_metric = eval(f, m, next, next_dmdt);
+    if (next_metric < metric)
+    {
+      t = next;
+      dmdt = next_dmdt;
+      metric = next_metric;
+
+      // pick up the pace after several successful steps:
+      successes++;
+      if (successes == pick_up_pace_steps)
+      {
+        step = std::min(longest_step, 2.0 * step);
+        successes = 0;
+      }
+    }
+    else
+    {
+      // back track:
+      step *= 0.5;
+      successes = 0;
+    }
+  }
+
+  return metric;
+}
+
+//----------------------------------------------------------------
+// ncc_translation_workspace
+//
+ncc_translation_t &
+ncc_translation_workspace()
+{
+  static thread_local ncc_translation_t workspace;
+  return workspace;
+}
@@ -29,6 +29,10 @@
 // local includes:
 #include "IRMosaicRefinementCommon.h"
 
+// system includes:
+#include <algorithm>
+#include <utility>
+
 
 //----------------------------------------------------------------
 // regularize_displacements
@@ -161,3 +165,166 @@ regularize_displacements( // computed displacement vectors of the moving image
     mass[i] += db->GetPixel(index);
   }
 }
+
+//----------------------------------------------------------------
+// find_tile_pairs
+//
+void
+find_tile_pairs(const std::vector<the_dynamic_array_t<unsigned int>> & neighbors, std::vector<tile_pair_t> & pairs)
+{
+  pairs.clear();
+
+  const unsigned int num_tiles = neighbors.size();
+  for (unsigned int i = 0; i < num_tiles; i++)
+  {
+    const the_dynamic_array_t<unsigned int> & ni = neighbors[i];
+    for (unsigned int k = 0; k < ni.size(); k++)
+    {
+      const unsigned int                        j = ni[k];
+      const the_dynamic_array_t<unsigned int> & nj = neighbors[j];
+
+      // find tile i among the neighbors of tile j:
+      unsigned int slot = ~0;
+      for (unsigned int l = 0; l < nj.size(); l++)
+      {
+        if (nj[l] == i)
+        {
+          slot = l;
+          break;
+        }
+      }
+
+      if (slot != (unsigned int)(~0) && j < i)
+      {
+        // this pair was already added when visiting tile j:
+        continue;
+      }
+
+      tile_pair_t pair;
+      pair.tile_[0] = i;
+      pair.tile_[1] = j;
+      pair.slot_[0] = k;
+      pair.slot_[1] = slot;
+      pairs.push_back(pair);
+    }
+  }
+}
+
+//----------------------------------------------------------------
+// find_active_tile_pairs
+//
+void
+find_active_tile_pairs(const std::vector<tile_pair_t> & pairs,
+                       const std::vector<bool> &        active,
+                       std::vector<tile_pair_t> &       active_pairs)
+{
+  active_pairs.clear();
+
+  for (std::size_t k = 0; k < pairs.size(); k++)
+  {
+    tile_pair_t pair = pairs[k];
+    if (!active[pair.tile_[0]])
+    {
+      if (!active[pair.tile_[1]])
+      {
+        continue;
+      }
+
+      // sample the active tile:
+      std::swap(pair.tile_[0], pair.tile_[1]);
+      std::swap(pair.slot_[0], pair.slot_[1]);
+    }
+
+    if (!active[pair.tile_[1]])
+    {
+      // the inactive neighbor is not updated:
+      pair.slot_[1] = ~0;
+    }
+
+    active_pairs.push_back(pair);
+  }
+}
+
+//----------------------------------------------------------------
+// scatter_pair_displacements
+//
+void
+scatter_pair_displacements(const the_grid_transform_t &       gt,
+                           const std::vector<pnt2d_t> &       center,
+                           const std::vector<vec2d_t> &       shift,
+                           const std::vector<unsigned char> & valid,
+                           const image_t::Pointer &           dx,
+                           const image_t::Pointer &           dy,
+                           const image_t::Pointer &           db,
+                           const double                       min_weight)
+{
+  // shortcuts:
+  const unsigned int mesh_cols = gt.cols_ + 1;
+  const unsigned int mesh_size = gt.grid_.mesh_.size();
+  const unsigned int num_samples = center.size();
+  const vertex_t *   v_arr = &(gt.grid_.mesh_[0]);
+
+  std::vector<vec2d_t> sum_shift(mesh_size, vec2d(0, 0));
+  std::vector<double>  sum_weight(mesh_size, 0.0);
+
+  for (unsigned int i = 0; i < num_samples; i++)
+  {
+    if (!valid[i])
+    {
+      continue;
+    }
+
+    pnt2d_t            uv;
+    const unsigned int tri_id = gt.grid_.xy_triangle(center[i], uv);
+    if (tri_id == (unsigned int)(~0))
+    {
+      continue;
+    }
+
+    // barycentric coordinates of the sample within the triangle:
+    const triangle_t & tri = gt.grid_.tri_[tri_id];
+    const pnt2d_t &    a = v_arr[tri.vertex_[0]].xy_;
+    const vec2d_t      ab = v_arr[tri.vertex_[1]].xy_ - a;
+    const vec2d_t      ac = v_arr[tri.vertex_[2]].xy_ - a;
+    const vec2d_t      ap = center[i] - a;
+
+    const double det = ab[0] * ac[1] - ab[1] * ac[0];
+    if (det == 0.0)
+    {
+      continue;
+    }
+
+    double w[3];
+    w[1] = (ap[0] * ac[1] - ap[1] * ac[0]) / det;
+    w[2] = (ab[0] * ap[1] - ab[1] * ap[0]) / det;
+    w[0] = 1.0 - w[1] - w[2];
+
+    for (unsigned int k = 0; k < 3; k++)
+    {
+      const unsigned int v = tri.vertex_[k];
+      sum_shift[v] -= shift[i] * w[k];
+      sum_weight[v] += w[k];
+    }
+  }
+
+  dx->FillBuffer(0);
+  dy->FillBuffer(0);
+  db->FillBuffer(0);
+
+  for (unsigned int i = 0; i < mesh_size; i++)
+  {
+    // a vertex barely touched by the samples is not a measurement,
+    // leave it to be filled in from the neighboring vertices:
+    if (sum_weight[i] < min_weight || sum_weight[i] <= 0.0)
+    {
+      continue;
+    }
+
+    image_t::IndexType index;
+    index[0] = i % mesh_cols;
+    index[1] = i / mesh_cols;
+    dx->SetPixel(index, sum_shift[i][0] / sum_weight[i]);
+    dy->SetPixel(index, sum_shift[i][1] / sum_weight[i]);
+    db->SetPixel(index, std::min(1.0, sum_weight[i]));
+  }
+}
@@ -34,6 +34,7 @@
 
 // system includes:
 #include <iostream>
+#include <iterator>
 
 // namespace access:
 using std::cout;
@@ -162,7 +163,8 @@ the_transaction_wrapper_t::notify(the_transaction_t * t,
 // the_thread_pool_t::the_thread_pool_t
 // 
 the_thread_pool_t::the_thread_pool_t(unsigned int num_threads):
-  pool_size_(num_threads)
+  pool_size_(num_threads),
+  work_stealing_(false)
 {
   mutex_ = the_mutex_interface_t::create();
   assert(mutex_ != nullptr);
@@ -384,6 +386,16 @@ the_thread_pool_t::pre_distribute_work()
   }
 }
 
+//----------------------------------------------------------------
+// the_thread_pool_t::set_work_stealing
+// 
+void
+the_thread_pool_t::set_work_stealing(bool enable)
+{
+  the_lock_t<the_mutex_interface_t> locker(mutex_);
+  work_stealing_ = enable;
+}
+
 //----------------------------------------------------------------
 // the_thread_pool_t::has_work
 // 
@@ -602,6 +614,14 @@ the_thread_pool_t::handle_thread(the_thread_pool_data_t * data)
     return;
   }
   
+  if (transactions_.empty() && work_stealing_ && no_lock_steal_work(id))
+  {
+#ifdef DEBUG_THREAD
+    cerr << "thread " << t << " stole work" << endl;
+#endif
+    return;
+  }
+  
   if (transactions_.empty())
   {
     // tell the thread to stop:
@@ -645,6 +665,50 @@ the_thread_pool_t::handle_thread(the_thread_pool_data_t * data)
   t->transactions_.push_back(transaction);
 }
 
+//----------------------------------------------------------------
+// the_thread_pool_t::no_lock_steal_work
+// 
+// move the newer half of the pending transactions of the busiest
+// thread to the given thread, return false if there was nothing
+// to steal. The pool mutex and the mutex of the given thread must
+// be locked by the caller:
+// 
+bool
+the_thread_pool_t::no_lock_steal_work(unsigned int id)
+{
+  // find the thread with the most pending transactions:
+  unsigned int victim = id;
+  std::size_t most = 0;
+  for (unsigned int i = 0; i < pool_size_; i++)
+  {
+    if (i == id) continue;
+    
+    std::size_t pending = pool_[i].thread_->transactions_.size();
+    if (pending > most)
+    {
+      most = pending;
+      victim = i;
+    }
+  }
+  
+  if (most == 0) return false;
+  
+  the_thread_interface_t * thief = thread(id);
+  the_thread_interface_t * busy = thread(victim);
+  the_lock_t<the_mutex_interface_t> lock_busy(busy->mutex());
+  
+  // the busy thread keeps the transactions it would execute next:
+  std::list<the_transaction_t *> & pending = busy->transactions_;
+  std::list<the_transaction_t *>::iterator first = pending.begin();
+  std::advance(first, pending.size() / 2);
+  
+  thief->transactions_.splice(thief->transactions_.end(),
+			      pending,
+			      first,
+			      pending.end());
+  return true;
+}
+
 //----------------------------------------------------------------
 // the_thread_pool_t::no_lock_flush
 // 
@@ -42,6 +42,8 @@
 #include "itkNormalizeImageFilterWithMask.h"
 
 // system includes:
+#include <algorithm>
+#include <cmath>
 #include <iomanip>
 
 // namespace access:
@@ -455,6 +457,139 @@ clamp_bbox(const pnt2d_t & confines_min, const pnt2d_t & confines_max, pnt2d_t &
   }
 }
 
+//----------------------------------------------------------------
+// tile_bins_t::tile_bins_t
+//
+tile_bins_t::tile_bins_t()
+  : cols_(0)
+  , rows_(0)
+{
+  bin_sz_[0] = 1.0;
+  bin_sz_[1] = 1.0;
+}
+
+//----------------------------------------------------------------
+// tile_bins_t::setup
+//
+void
+tile_bins_t::setup(const std::vector<pnt2d_t> & min, const std::vector<pnt2d_t> & max)
+{
+  const unsigned int num_tiles = min.size();
+  min_ = min;
+  max_ = max;
+
+  cols_ = 0;
+  rows_ = 0;
+  first_.clear();
+  tiles_.clear();
+
+  origin_ = pnt2d(std::numeric_limits<double>::max(), std::numeric_limits<double>::max());
+  pnt2d_t      extent = pnt2d(-origin_[0], -origin_[1]);
+  unsigned int num_binned = 0;
+  for (unsigned int k = 0; k < num_tiles; k++)
+  {
+    if (is_empty_bbox(min[k], max[k]))
+      continue;
+
+    origin_[0] = std::min(origin_[0], min[k][0]);
+    origin_[1] = std::min(origin_[1], min[k][1]);
+    extent[0] = std::max(extent[0], max[k][0]);
+    extent[1] = std::max(extent[1], max[k][1]);
+    num_binned++;
+  }
+
+  if (num_binned == 0)
+    return;
+
+  // aim for a few bins per tile:
+  const double w = extent[0] - origin_[0];
+  const double h = extent[1] - origin_[1];
+  const double cell = std::sqrt(std::max(w * h, 1e-12) / double(4 * num_binned));
+
+  cols_ = (unsigned int)(std::max(1.0, std::min(1024.0, std::ceil(w / cell))));
+  rows_ = (unsigned int)(std::max(1.0, std::min(1024.0, std::ceil(h / cell))));
+  bin_sz_[0] = (w > 0.0) ? w / double(cols_) : 1.0;
+  bin_sz_[1] = (h > 0.0) ? h / double(rows_) : 1.0;
+
+  // count the tiles in each bin, then list them:
+  first_.assign(cols_ * rows_ + 1, 0);
+  for (unsigned int pass = 0; pass < 2; pass++)
+  {
+    std::vector<unsigned int> next(first_.begin(), first_.end() - 1);
+    for (unsigned int k = 0; k < num_tiles; k++)
+    {
+      if (is_empty_bbox(min[k], max[k]))
+        continue;
+
+      const unsigned int c0 = col(min[k][0]);
+      const unsigned int c1 = col(max[k][0]);
+      const unsigned int r0 = row(min[k][1]);
+      const unsigned int r1 = row(max[k][1]);
+
+      for (unsigned int r = r0; r <= r1; r++)
+      {
+        for (unsigned int c = c0; c <= c1; c++)
+        {
+          const unsigned int bin = c + r * cols_;
+          if (pass == 0)
+          {
+            first_[bin + 1]++;
+          }
+          else
+          {
+            tiles_[next[bin]++] = k;
+          }
+        }
+      }
+    }
+
+    if (pass == 0)
+    {
+      for (unsigned int i = 0; i < cols_ * rows_; i++)
+      {
+        first_[i + 1] += first_[i];
+      }
+      tiles_.resize(first_.back());
+    }
+  }
+}
+
+//----------------------------------------------------------------
+// tile_bins_t::find
+//
+void
+tile_bins_t::find(const pnt2d_t & min, const pnt2d_t & max, std::vector<unsigned int> & tiles) const
+{
+  tiles.clear();
+  if (tiles_.empty() || is_empty_bbox(min, max))
+    return;
+
+  const unsigned int c0 = col(min[0]);
+  const unsigned int c1 = col(max[0]);
+  const unsigned int r0 = row(min[1]);
+  const unsigned int r1 = row(max[1]);
+
+  for (unsigned int r = r0; r <= r1; r++)
+  {
+    for (unsigned int c = c0; c <= c1; c++)
+    {
+      const unsigned int bin = c + r * cols_;
+      for (unsigned int i = first_[bin]; i < first_[bin + 1]; i++)
+      {
+        const unsigned int k = tiles_[i];
+        if (min_[k][0] > max[0] || max_[k][0] < min[0] || min_[k][1] > max[1] || max_[k][1] < min[1])
+          continue;
+
+        tiles.push_back(k);
+      }
+    }
+  }
+
+  // a tile spanning several bins is found once per bin:
+  std::sort(tiles.begin(), tiles.end());
+  tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+}
+
 
 //----------------------------------------------------------------
 // clip_histogram
@@ -0,0 +1,128 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IRFFT.h"
+
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+#include "itkTimeProbe.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace itk_fft;
+
+namespace
+{
+// The per-bin loop find_correlation used before the vectorized kernel:
+void
+ReferenceCrossPower(const std::vector<fft_complex_t> & f0,
+                    const std::vector<fft_complex_t> & f1,
+                    const std::vector<float> &         inMask,
+                    const std::vector<float> &         outMask,
+                    std::vector<fft_complex_t> &       out)
+{
+  for (size_t i = 0; i < out.size(); ++i)
+  {
+    const float   g = inMask[i] * inMask[i];
+    fft_complex_t p10 = g * (f1[i] * std::conj(f0[i]));
+    out[i] = outMask[i] * _div(p10, _add(std::sqrt(p10 * std::conj(p10)), 1e-8f));
+  }
+}
+} // namespace
+
+int
+itkIRCrossPowerSpectrumTest(int, char *[])
+{
+  using GeneratorType = itk::Statistics::MersenneTwisterRandomVariateGenerator;
+  GeneratorType::Pointer generator = GeneratorType::New();
+  generator->Initialize(1234);
+
+  // half spectra of the typical neighborhood and tile sizes:
+  const unsigned int sizes[] = { 64, 128, 256 };
+  const unsigned int repetitions = 200;
+
+  int status = EXIT_SUCCESS;
+  for (const unsigned int n : sizes)
+  {
+    const unsigned int halfWidth = n / 2 + 1;
+    const size_t       numBins = size_t(halfWidth) * n;
+
+    std::vector<fft_complex_t> f0(numBins);
+    std::vector<fft_complex_t> f1(numBins);
+    for (size_t i = 0; i < numBins; ++i)
+    {
+      f0[i] = fft_complex_t(generator->GetVariateWithClosedRange(2.0) - 1.0,
+                            generator->GetVariateWithClosedRange(2.0) - 1.0);
+      f1[i] = fft_complex_t(generator->GetVariateWithClosedRange(2.0) - 1.0,
+                            generator->GetVariateWithClosedRange(2.0) - 1.0);
+    }
+
+    const lp_filter_mask_t inMask = lp_filter_mask(n, n, true, 0.5, 0.1);
+    const lp_filter_mask_t outMask = lp_filter_mask(n, n, true, 0.4, 0.1);
+
+    std::vector<fft_complex_t> expected(numBins);
+    std::vector<fft_complex_t> actual(numBins);
+
+    itk::TimeProbe referenceProbe;
+    for (unsigned int r = 0; r < repetitions; ++r)
+    {
+      referenceProbe.Start();
+      ReferenceCrossPower(f0, f1, *inMask, *outMask, expected);
+      referenceProbe.Stop();
+    }
+
+    itk::TimeProbe kernelProbe;
+    for (unsigned int r = 0; r < repetitions; ++r)
+    {
+      kernelProbe.Start();
+      normalized_cross_power(&f0[0], &f1[0], &(*inMask)[0], &(*outMask)[0], &actual[0], numBins);
+      kernelProbe.Stop();
+    }
+
+    double maxError = 0.0;
+    for (size_t i = 0; i < numBins; ++i)
+    {
+      maxError = std::max(maxError, double(std::abs(expected[i] - actual[i])));
+    }
+
+    std::cout << n << " x " << n << ": reference " << referenceProbe.GetMean() << " s, kernel "
+              << kernelProbe.GetMean() << " s, speedup " << referenceProbe.GetMean() / kernelProbe.GetMean()
+              << ", max error " << maxError << std::endl;
+
+    if (maxError > 1e-5)
+    {
+      std::cerr << "Kernel result differs from the reference loop." << std::endl;
+      status = EXIT_FAILURE;
+    }
+
+    // in place, the result overwrites the second spectrum:
+    normalized_cross_power(&f0[0], &f1[0], &(*inMask)[0], &(*outMask)[0], &f1[0], numBins);
+    for (size_t i = 0; i < numBins; ++i)
+    {
+      if (std::abs(f1[i] - actual[i]) > 1e-6)
+      {
+        std::cerr << "In place result differs at bin " << i << std::endl;
+        status = EXIT_FAILURE;
+        break;
+      }
+    }
+  }
+
+  return status;
+}
@@ -0,0 +1,207 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IRFFTCommon.h"
+
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+#include "itkTimeProbe.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+using GeneratorType = itk::Statistics::MersenneTwisterRandomVariateGenerator;
+
+itk_image_t::Pointer
+MakeNoiseImage(GeneratorType * generator, const unsigned int w, const unsigned int h)
+{
+  itk_image_t::SizeType sz;
+  sz[0] = w;
+  sz[1] = h;
+
+  itk_image_t::Pointer image = make_image<itk_image_t>(sz);
+  float *              data = image->GetBufferPointer();
+  for (unsigned int i = 0; i < w * h; ++i)
+  {
+    data[i] = float(generator->GetVariateWithClosedRange(255.0));
+  }
+  return image;
+}
+
+// Mean time of a forward half spectrum transform of a w x h image,
+// or a negative value if the size is not supported:
+double
+TimeTransform(GeneratorType * generator, const unsigned int w, const unsigned int h, const unsigned int repetitions)
+{
+  itk_image_t::ConstPointer image = MakeNoiseImage(generator, w, h).GetPointer();
+  fft_data_t                spectrum;
+
+  // the first transform creates the plan:
+  if (!fft_r2c(image, spectrum))
+  {
+    return -1.0;
+  }
+
+  itk::TimeProbe probe;
+  for (unsigned int r = 0; r < repetitions; ++r)
+  {
+    probe.Start();
+    fft_r2c(image, spectrum);
+    probe.Stop();
+  }
+  return probe.GetMean();
+}
+} // namespace
+
+int
+itkIRFFTPaddingTest(int, char *[])
+{
+  int status = EXIT_SUCCESS;
+
+  // fast sizes:
+  const unsigned int sizes[][3] = {
+    // n, next, previous
+    { 1, 1, 1 },          { 7, 8, 6 },          { 199, 200, 192 },     { 211, 216, 200 },
+    { 1002, 1024, 1000 }, { 1037, 1080, 1024 }, { 1392, 1440, 1350 }, { 2160, 2160, 2160 }
+  };
+  for (const auto & s : sizes)
+  {
+    if (next_fast_fft_size(s[0]) != s[1] || prev_fast_fft_size(s[0]) != s[2])
+    {
+      std::cerr << "Unexpected fast sizes for " << s[0] << ": " << next_fast_fft_size(s[0]) << ", "
+                << prev_fast_fft_size(s[0]) << std::endl;
+      status = EXIT_FAILURE;
+    }
+  }
+
+  GeneratorType::Pointer generator = GeneratorType::New();
+  generator->Initialize(1234);
+
+  // transform speed at the tile sizes of the cameras we use:
+  const unsigned int tiles[][2] = { { 1004, 1002 }, { 1389, 1037 }, { 1392, 1040 }, { 2560, 2160 } };
+  for (const auto & t : tiles)
+  {
+    const unsigned int grown[] = { next_fast_fft_size(t[0]), next_fast_fft_size(t[1]) };
+    const unsigned int cropped[] = { prev_fast_fft_size(t[0]), prev_fast_fft_size(t[1]) };
+
+    const double rawTime = TimeTransform(generator, t[0], t[1], 5);
+    const double grownTime = TimeTransform(generator, grown[0], grown[1], 5);
+    const double croppedTime = TimeTransform(generator, cropped[0], cropped[1], 5);
+
+    std::cout << t[0] << " x " << t[1] << ": ";
+    if (rawTime < 0.0)
+    {
+      std::cout << "unsupported";
+    }
+    else
+    {
+      std::cout << rawTime << " s";
+    }
+    std::cout << ", grown to " << grown[0] << " x " << grown[1] << ": " << grownTime << " s";
+    if (rawTime > 0.0)
+    {
+      std::cout << " (speedup " << rawTime / grownTime << ")";
+    }
+    std::cout << ", cropped to " << cropped[0] << " x " << cropped[1] << ": " << croppedTime << " s";
+    if (rawTime > 0.0)
+    {
+      std::cout << " (speedup " << rawTime / croppedTime << ")";
+    }
+    std::cout << std::endl;
+
+    if (grownTime < 0.0 || croppedTime < 0.0)
+    {
+      std::cerr << "Fast sizes must always be supported." << std::endl;
+      status = EXIT_FAILURE;
+    }
+  }
+
+  // the displacement must not depend on the padding, in particular
+  // the wraparound must use the period of the padded surface:
+  const unsigned int w = 211;
+  const unsigned int h = 199;
+  const int          dx = 61;
+  const int          dy = -47;
+
+  itk_image_t::Pointer fi = MakeNoiseImage(generator, w + 2 * 64, h + 2 * 64);
+  itk_image_t::Pointer a = MakeNoiseImage(generator, w, h);
+  itk_image_t::Pointer b = MakeNoiseImage(generator, w, h);
+  for (unsigned int y = 0; y < h; ++y)
+  {
+    for (unsigned int x = 0; x < w; ++x)
+    {
+      itk_image_t::IndexType src;
+      src[0] = x + 64;
+      src[1] = y + 64;
+      itk_image_t::IndexType dst;
+      dst[0] = x;
+      dst[1] = y;
+      a->SetPixel(dst, fi->GetPixel(src));
+
+      src[0] += dx;
+      src[1] += dy;
+      b->SetPixel(dst, fi->GetPixel(src));
+    }
+  }
+
+  image_t::PointType offsetMin;
+  image_t::PointType offsetMax;
+  offsetMin.Fill(-double(w));
+  offsetMax.Fill(double(w));
+
+  const fft_padding_t paddings[] = { FFT_PADDING_NONE_E, FFT_PADDING_GROW_E, FFT_PADDING_CROP_E };
+  const char *        names[] = { "none", "grow", "crop" };
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    translate_transform_t::Pointer ti;
+    const double                   metric = match_one_pair<itk_image_t, mask_t>(*null_log(),
+                                                              false,
+                                                              false,
+                                                              a.GetPointer(),
+                                                              b.GetPointer(),
+                                                              nullptr,
+                                                              nullptr,
+                                                              0.2,
+                                                              1.0,
+                                                              offsetMin,
+                                                              offsetMax,
+                                                              ti,
+                                                              nullptr,
+                                                              paddings[i]);
+
+    if (ti.IsNull() || metric == std::numeric_limits<double>::max())
+    {
+      std::cerr << names[i] << ": no match found" << std::endl;
+      status = EXIT_FAILURE;
+      continue;
+    }
+
+    const translate_transform_t::OutputVectorType offset = ti->GetOffset();
+    std::cout << names[i] << ": offset " << offset << std::endl;
+
+    // b is a shifted by (dx, dy):
+    if (std::abs(offset[0] + dx) > 1.0 || std::abs(offset[1] + dy) > 1.0)
+    {
+      std::cerr << names[i] << ": expected offset (" << -dx << ", " << -dy << ")" << std::endl;
+      status = EXIT_FAILURE;
+    }
+  }
+
+  return status;
+}
@@ -0,0 +1,346 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkImageMosaicVarianceMetric.h"
+#include "IRStdThread.h"
+#include "IRStdMutex.h"
+
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkMath.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+using ImageType = itk::Image<float, 2>;
+using InterpolatorType = itk::LinearInterpolateImageFunction<ImageType, double>;
+using MetricType = itk::ImageMosaicVarianceMetric<ImageType, InterpolatorType>;
+using TransformType = itk::LegendrePolynomialTransform<double, 2>;
+
+constexpr unsigned int tile_size = 64;
+
+// where the second tile sits in the mosaic; the mosaic pixels
+// land between its pixels, away from the tile bounding box edges:
+constexpr double tile_x = 24.25;
+constexpr double tile_y = 8.25;
+
+// a smooth scene, sampled by both tiles:
+double
+Scene(const double x, const double y)
+{
+  return 100.0 + 40.0 * std::sin(2.0 * itk::Math::pi * x / 90.0) * std::cos(2.0 * itk::Math::pi * y / 70.0) +
+         20.0 * std::sin(2.0 * itk::Math::pi * (x + y) / 110.0);
+}
+
+ImageType::Pointer
+MakeTile(const double x0, const double y0)
+{
+  ImageType::Pointer tile = make_image<ImageType>(tile_size, tile_size, 1.0, 0.0);
+
+  ImageType::IndexType index;
+  for (index[1] = 0; index[1] < long(tile_size); ++index[1])
+  {
+    for (index[0] = 0; index[0] < long(tile_size); ++index[0])
+    {
+      tile->SetPixel(index, Scene(x0 + double(index[0]), y0 + double(index[1])));
+    }
+  }
+
+  return tile;
+}
+
+// the recursive Gaussian gradient is biased near the tile edges,
+// keep them out of the overlap:
+MetricType::mask_t::Pointer
+MakeMask()
+{
+  constexpr long border = 4;
+
+  MetricType::mask_t::Pointer mask = make_image<MetricType::mask_t>(tile_size, tile_size, 1.0, 0);
+
+  MetricType::mask_t::IndexType index;
+  for (index[1] = border; index[1] < long(tile_size) - border; ++index[1])
+  {
+    for (index[0] = border; index[0] < long(tile_size) - border; ++index[0])
+    {
+      mask->SetPixel(index, 255);
+    }
+  }
+
+  return mask;
+}
+
+// compare the derivative of the metric with respect to the parameters
+// of the second tile against central differences of the metric value:
+bool
+CheckDerivative(const MetricType * metric, const bool subsample, MetricType::derivative_t & derivative)
+{
+  constexpr double step = 1e-4;
+
+  const MetricType::params_t params = metric->GetTransformParameters();
+  MetricType::measure_t      measure = 0.0;
+  metric->evaluate(params, measure, derivative, subsample);
+
+  const unsigned int n_params = TransformType::ParameterVectorLength;
+
+  std::vector<double> numeric(n_params);
+  double              scale = 0.0;
+  for (unsigned int i = 0; i < n_params; i++)
+  {
+    MetricType::params_t     p = params;
+    MetricType::derivative_t unused;
+    MetricType::measure_t    v0 = 0.0;
+    MetricType::measure_t    v1 = 0.0;
+
+    p[n_params + i] = params[n_params + i] - step;
+    metric->evaluate(p, v0, unused, subsample);
+
+    p[n_params + i] = params[n_params + i] + step;
+    metric->evaluate(p, v1, unused, subsample);
+
+    numeric[i] = (v1 - v0) / (2.0 * step);
+    scale = std::max(scale, std::fabs(numeric[i]));
+  }
+  metric->SetTransformParameters(params);
+
+  if (scale == 0.0)
+  {
+    std::cerr << "the metric does not depend on the parameters" << std::endl;
+    return false;
+  }
+
+  bool ok = true;
+  for (unsigned int i = 0; i < n_params; i++)
+  {
+    const double analytic = derivative[n_params + i];
+    if (std::fabs(analytic - numeric[i]) > 0.1 * scale)
+    {
+      std::cerr << "parameter " << i << ": derivative " << analytic << ", central difference " << numeric[i]
+                << std::endl;
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+// compare the tabulated derivatives with respect to the parameters of
+// a Legendre polynomial transform against the transform Jacobian:
+template <unsigned int N>
+bool
+CheckJacobianTable()
+{
+  using LegendreType = itk::LegendrePolynomialTransform<double, N>;
+
+  typename LegendreType::Pointer t = LegendreType::New();
+  t->setup(-10.0, 30.0, 0.0, 25.0);
+
+  // the Jacobian does not depend on the parameters, but make sure
+  // the table does not assume an identity transform either:
+  typename LegendreType::ParametersType params = t->GetParameters();
+  for (unsigned int i = 0; i < params.GetSize(); i++)
+  {
+    params[i] += 1e-2 * double(i % 7) - 3e-2;
+  }
+  t->SetParameters(params);
+
+  ImageType::SizeType size;
+  size[0] = 80;
+  size[1] = 60;
+
+  ImageType::SpacingType spacing;
+  spacing[0] = 0.5;
+  spacing[1] = 0.75;
+
+  ImageType::Pointer mosaic = ImageType::New();
+  mosaic->SetRegions(size);
+  mosaic->SetSpacing(spacing);
+  mosaic->SetOrigin(pnt2d(-12.5, -1.25));
+
+  MetricType::index_t i0;
+  MetricType::index_t i1;
+  i0[0] = 5;
+  i0[1] = 4;
+  i1[0] = 70;
+  i1[1] = 50;
+
+  MetricType::jacobian_table_t table;
+  if (!table.setup(t.GetPointer(), mosaic, i0, i1))
+  {
+    std::cerr << "degree " << N << ": the table does not recognize the transform" << std::endl;
+    return false;
+  }
+
+  const unsigned int     n_params = LegendreType::ParameterVectorLength;
+  const double           dPdx = 0.7;
+  const double           dPdy = -1.3;
+  std::vector<double>    dPdp(n_params);
+  MetricType::jacobian_t jacobian(2, n_params);
+
+  MetricType::index_t index;
+  for (index[1] = i0[1]; index[1] < i1[1]; index[1] += 3)
+  {
+    for (index[0] = i0[0]; index[0] < i1[0]; index[0] += 4)
+    {
+      if (!table.eval(index, dPdx, dPdy, &(dPdp[0])))
+      {
+        std::cerr << "degree " << N << ": pixel " << index << " is not tabulated" << std::endl;
+        return false;
+      }
+
+      pnt2d_t point;
+      mosaic->TransformIndexToPhysicalPoint(index, point);
+      t->ComputeJacobianWithRespectToParameters(point, jacobian);
+
+      for (unsigned int i = 0; i < n_params; i++)
+      {
+        const double expected = jacobian(0, i) * dPdx + jacobian(1, i) * dPdy;
+        if (std::fabs(dPdp[i] - expected) > 1e-9 * (1.0 + std::fabs(expected)))
+        {
+          std::cerr << "degree " << N << ": pixel " << index << ", parameter " << i << ": tabulated " << dPdp[i]
+                    << ", expected " << expected << std::endl;
+          return false;
+        }
+      }
+    }
+  }
+
+  // the pixels outside the table are left to the transform:
+  index = i1;
+  if (table.eval(index, dPdx, dPdy, &(dPdp[0])))
+  {
+    std::cerr << "degree " << N << ": pixel " << index << " is outside the table" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool
+SameDerivative(const MetricType::derivative_t & a, const MetricType::derivative_t & b, const double tolerance)
+{
+  if (a.GetSize() != b.GetSize())
+    return false;
+
+  double scale = 0.0;
+  for (unsigned int i = 0; i < a.GetSize(); i++)
+  {
+    scale = std::max(scale, std::fabs(a[i]));
+  }
+
+  for (unsigned int i = 0; i < a.GetSize(); i++)
+  {
+    if (std::fabs(a[i] - b[i]) > tolerance * scale)
+    {
+      std::cerr << "derivative " << i << ": " << a[i] << " vs " << b[i] << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+} // namespace
+
+int
+itkIRMosaicVarianceMetricTest(int, char *[])
+{
+  the_mutex_interface_t::set_creator(&the_std_mutex_t::create);
+  the_thread_interface_t::set_creator(&the_std_thread_t::create);
+
+  // the first tile is the identity, the second one is translated
+  // and misregistered by (1.5, -1) pixels:
+  TransformType::Pointer t0 = TransformType::New();
+  t0->setup(0, tile_size, 0, tile_size);
+
+  TransformType::Pointer t1 = TransformType::New();
+  t1->setup(tile_x, tile_x + tile_size, tile_y, tile_y + tile_size);
+
+  TransformType::ParametersType params = t1->GetParameters();
+  params[TransformType::index_a(0, 0)] -= tile_x / t1->GetXmax();
+  params[TransformType::index_b(0, 0)] -= tile_y / t1->GetYmax();
+  t1->SetParameters(params);
+
+  MetricType::Pointer metric = MetricType::New();
+  metric->image_.resize(2);
+  metric->mask_.resize(2);
+  metric->transform_.resize(2);
+
+  metric->image_[0] = MakeTile(0.0, 0.0);
+  metric->image_[1] = MakeTile(tile_x + 1.5, tile_y - 1.0);
+  metric->mask_[0] = MakeMask();
+  metric->mask_[1] = MakeMask();
+  metric->transform_[0] = t0;
+  metric->transform_[1] = t1;
+
+  std::vector<bool> param_shared(t0->GetNumberOfParameters(), false);
+  std::vector<bool> param_active(t0->GetNumberOfParameters(), true);
+  metric->setup_param_map(param_shared, param_active);
+  metric->Initialize();
+
+  bool ok = true;
+  ok = CheckJacobianTable<1>() && ok;
+  ok = CheckJacobianTable<2>() && ok;
+  ok = CheckJacobianTable<3>() && ok;
+  ok = CheckJacobianTable<4>() && ok;
+  ok = CheckJacobianTable<5>() && ok;
+
+  // the Jacobians calculated per pixel, then tabulated:
+  MetricType::derivative_t per_pixel;
+  MetricType::derivative_t tabulated;
+
+  metric->num_threads_ = 1;
+  metric->use_jacobian_tables_ = false;
+  ok = CheckDerivative(metric, false, per_pixel) && ok;
+
+  metric->use_jacobian_tables_ = true;
+  ok = CheckDerivative(metric, false, tabulated) && ok;
+
+  if (!SameDerivative(per_pixel, tabulated, 1e-6))
+  {
+    std::cerr << "the tabulated Jacobians do not match the transform Jacobians" << std::endl;
+    ok = false;
+  }
+
+  // the result does not depend on the number of threads:
+  MetricType::derivative_t threaded;
+  metric->num_threads_ = 4;
+  metric->use_jacobian_tables_ = false;
+  ok = CheckDerivative(metric, false, threaded) && ok;
+
+  if (!SameDerivative(per_pixel, threaded, 1e-12))
+  {
+    std::cerr << "the threaded derivative does not match the single threaded one" << std::endl;
+    ok = false;
+  }
+
+  // the same samples are kept for all evaluations:
+  MetricType::derivative_t sampled;
+  metric->num_samples_ = 400;
+  metric->resample_per_iteration_ = false;
+  metric->reset_samples();
+  ok = CheckDerivative(metric, true, sampled) && ok;
+
+  if (!ok)
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Test finished." << std::endl;
+  return EXIT_SUCCESS;
+}
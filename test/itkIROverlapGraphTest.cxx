@@ -0,0 +1,115 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkIRCommon.h"
+
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+#include "itkTimeProbe.h"
+
+#include <iostream>
+
+namespace
+{
+// the all-pairs bounding box test the overlap graph replaces:
+void
+BruteForceOverlapGraph(const std::vector<pnt2d_t> &             min,
+                       const std::vector<pnt2d_t> &             max,
+                       std::vector<std::vector<unsigned int>> & neighbors)
+{
+  const unsigned int num_tiles = min.size();
+  neighbors.assign(num_tiles, std::vector<unsigned int>());
+  for (unsigned int i = 0; i < num_tiles; i++)
+  {
+    if (is_empty_bbox(min[i], max[i]))
+      continue;
+
+    for (unsigned int j = 0; j < num_tiles; j++)
+    {
+      if (i == j || is_empty_bbox(min[j], max[j]))
+        continue;
+
+      if (min[i][0] > max[j][0] || min[j][0] > max[i][0] || min[i][1] > max[j][1] || min[j][1] > max[i][1])
+        continue;
+
+      neighbors[i].push_back(j);
+    }
+  }
+}
+} // namespace
+
+int
+itkIROverlapGraphTest(int, char *[])
+{
+  using GeneratorType = itk::Statistics::MersenneTwisterRandomVariateGenerator;
+  GeneratorType::Pointer generator = GeneratorType::New();
+  generator->Initialize(1234);
+
+  // a jittered 100 x 100 grid of 1000 x 1000 tiles with 10% overlap:
+  const unsigned int   cols = 100;
+  const unsigned int   rows = 100;
+  const double         step = 900.0;
+  std::vector<pnt2d_t> min;
+  std::vector<pnt2d_t> max;
+  for (unsigned int r = 0; r < rows; r++)
+  {
+    for (unsigned int c = 0; c < cols; c++)
+    {
+      const double x = double(c) * step + generator->GetVariateWithClosedRange(50.0);
+      const double y = double(r) * step + generator->GetVariateWithClosedRange(50.0);
+      min.push_back(pnt2d(x, y));
+      max.push_back(pnt2d(x + 1000.0, y + 1000.0));
+    }
+  }
+
+  // tiles that merely touch are neighbors:
+  min.push_back(pnt2d(-500.0, -500.0));
+  max.push_back(pnt2d(min[0][0], min[0][1]));
+
+  // tiles with empty bounding boxes have no neighbors:
+  min.push_back(pnt2d(std::numeric_limits<double>::max(), std::numeric_limits<double>::max()));
+  max.push_back(pnt2d(-std::numeric_limits<double>::max(), -std::numeric_limits<double>::max()));
+
+  itk::TimeProbe                         bruteForceProbe;
+  std::vector<std::vector<unsigned int>> expected;
+  bruteForceProbe.Start();
+  BruteForceOverlapGraph(min, max, expected);
+  bruteForceProbe.Stop();
+
+  itk::TimeProbe                         binnedProbe;
+  std::vector<std::vector<unsigned int>> neighbors;
+  binnedProbe.Start();
+  calc_overlap_graph(min, max, neighbors);
+  binnedProbe.Stop();
+
+  std::cout << min.size() << " tiles, all pairs: " << bruteForceProbe.GetTotal()
+            << " s, binned: " << binnedProbe.GetTotal() << " s" << std::endl;
+
+  if (neighbors != expected)
+  {
+    std::cerr << "The overlap graph does not match the all-pairs bounding box test." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (neighbors[cols * rows].size() != 1 || neighbors[cols * rows][0] != 0)
+  {
+    std::cerr << "Touching tiles must be neighbors." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
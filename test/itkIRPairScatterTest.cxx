@@ -0,0 +1,177 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IRMosaicRefinementCommon.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+// an undeformed mesh of rows x cols quads covering [tile_min, tile_max]:
+void
+SetupRegularMesh(the_grid_transform_t & gt,
+                 const unsigned int     rows,
+                 const unsigned int     cols,
+                 const pnt2d_t &        tile_min,
+                 const pnt2d_t &        tile_max)
+{
+  std::vector<pnt2d_t> xy((rows + 1) * (cols + 1));
+  for (unsigned int row = 0; row <= rows; row++)
+  {
+    for (unsigned int col = 0; col <= cols; col++)
+    {
+      pnt2d_t & p = xy[row * (cols + 1) + col];
+      p[0] = tile_min[0] + (tile_max[0] - tile_min[0]) * double(col) / double(cols);
+      p[1] = tile_min[1] + (tile_max[1] - tile_min[1]) * double(row) / double(rows);
+    }
+  }
+
+  gt.setup(rows, cols, tile_min, tile_max, xy);
+}
+} // namespace
+
+int
+itkIRPairScatterTest(int, char *[])
+{
+  constexpr double       tolerance = 1e-5;
+  constexpr unsigned int rows = 4;
+  constexpr unsigned int cols = 4;
+  const vec2d_t          tile_shift = vec2d(2.5, -1.5);
+
+  // the neighbor mesh covers [0, 100] x [0, 100]:
+  the_grid_transform_t gt;
+  SetupRegularMesh(gt, rows, cols, pnt2d(0, 0), pnt2d(100, 100));
+
+  // the sampled tile covers [60, 160] x [10, 110] with a denser mesh,
+  // its vertices fall inside the neighbor triangles and several of
+  // them land in the triangles around each neighbor vertex:
+  the_grid_transform_t sampled;
+  SetupRegularMesh(sampled, 2 * rows, 2 * cols, pnt2d(60, 10), pnt2d(160, 110));
+
+  const unsigned int         num_samples = sampled.grid_.mesh_.size();
+  std::vector<pnt2d_t>       center(num_samples);
+  std::vector<vec2d_t>       shift(num_samples, tile_shift);
+  std::vector<unsigned char> valid(num_samples, 1);
+  for (unsigned int i = 0; i < num_samples; i++)
+  {
+    center[i] = sampled.grid_.mesh_[i].xy_;
+  }
+
+  image_t::Pointer dx = make_image<image_t>(cols + 1, rows + 1, 1.0, 0.0);
+  image_t::Pointer dy = make_image<image_t>(cols + 1, rows + 1, 1.0, 0.0);
+  image_t::Pointer db = make_image<image_t>(cols + 1, rows + 1, 1.0, 0.0);
+
+  // a uniform shift of the sampled tile is the opposite uniform shift
+  // of its neighbor, wherever the neighbor mesh is supported:
+  scatter_pair_displacements(gt, center, shift, valid, dx, dy, db);
+
+  unsigned int num_supported = 0;
+  unsigned int num_full_weight = 0;
+  for (unsigned int row = 0; row <= rows; row++)
+  {
+    for (unsigned int col = 0; col <= cols; col++)
+    {
+      image_t::IndexType index;
+      index[0] = col;
+      index[1] = row;
+
+      const double w = db->GetPixel(index);
+      if (w < 0.0 || w > 1.0)
+      {
+        std::cerr << "vertex " << col << ", " << row << " weight out of range: " << w << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if (w == 0.0)
+      {
+        continue;
+      }
+
+      num_supported++;
+      if (w == 1.0)
+      {
+        num_full_weight++;
+      }
+
+      if (std::fabs(dx->GetPixel(index) + tile_shift[0]) > tolerance ||
+          std::fabs(dy->GetPixel(index) + tile_shift[1]) > tolerance)
+      {
+        std::cerr << "vertex " << col << ", " << row << " displacement " << dx->GetPixel(index) << ", "
+                  << dy->GetPixel(index) << " is not the opposite of " << tile_shift << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    // the first two columns (x = 0, 25) are outside the overlap:
+    for (unsigned int col = 0; col < 2; col++)
+    {
+      image_t::IndexType index;
+      index[0] = col;
+      index[1] = row;
+      if (db->GetPixel(index) != 0.0)
+      {
+        std::cerr << "vertex " << col << ", " << row << " is outside the overlap but has weight "
+                  << db->GetPixel(index) << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  if (num_supported == 0 || num_full_weight == 0)
+  {
+    std::cerr << "the overlap is not supported: " << num_supported << " vertices, " << num_full_weight
+              << " with full weight" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // a single sample near a vertex carries the weight of that vertex,
+  // the vertices it barely touches are not measurements:
+  center.assign(1, pnt2d(1, 2));
+  shift.assign(1, tile_shift);
+  valid.assign(1, 1);
+  scatter_pair_displacements(gt, center, shift, valid, dx, dy, db);
+
+  image_t::IndexType index;
+  index[0] = 0;
+  index[1] = 0;
+  if (std::fabs(db->GetPixel(index) - 0.92) > tolerance ||
+      std::fabs(dx->GetPixel(index) + tile_shift[0]) > tolerance ||
+      std::fabs(dy->GetPixel(index) + tile_shift[1]) > tolerance)
+  {
+    std::cerr << "the nearest vertex has weight " << db->GetPixel(index) << " and displacement "
+              << dx->GetPixel(index) << ", " << dy->GetPixel(index) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  for (unsigned int k = 0; k < 2; k++)
+  {
+    // the other two vertices of the triangle, with 0.04 weight each:
+    index[0] = k;
+    index[1] = 1;
+    if (db->GetPixel(index) != 0.0)
+    {
+      std::cerr << "vertex " << index[0] << ", " << index[1] << " is barely supported but has weight "
+                << db->GetPixel(index) << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "Test finished." << std::endl;
+  return EXIT_SUCCESS;
+}
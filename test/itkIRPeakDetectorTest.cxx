@@ -0,0 +1,190 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IRFFTCommon.h"
+
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+// a paraboloid cap of a given radius, with periodic wraparound,
+// so the quadratic sub-pixel fit is exact:
+void
+AddPeak(itk_image_t * image, const double x0, const double y0, const double amplitude, const double radius)
+{
+  const itk_image_t::SizeType size = image->GetLargestPossibleRegion().GetSize();
+  const double                w = double(size[0]);
+  const double                h = double(size[1]);
+  float *                     data = image->GetBufferPointer();
+  for (unsigned int y = 0; y < size[1]; ++y)
+  {
+    for (unsigned int x = 0; x < size[0]; ++x)
+    {
+      double dx = std::fabs(double(x) - x0);
+      double dy = std::fabs(double(y) - y0);
+      dx = std::min(dx, w - dx);
+      dy = std::min(dy, h - dy);
+
+      const double d2 = (dx * dx + dy * dy) / (radius * radius);
+      if (d2 < 1.0)
+      {
+        data[x + y * size[0]] += float(amplitude * (1.0 - d2));
+      }
+    }
+  }
+}
+} // namespace
+
+int
+itkIRPeakDetectorTest(int, char *[])
+{
+  int status = EXIT_SUCCESS;
+
+  // known sub-pixel peaks, strongest first, the last one
+  // straddles the image border:
+  const double peaks[][3] = {
+    // x, y, amplitude
+    { 20.3, 30.7, 1.0 },
+    { 70.6, 15.2, 0.8 },
+    { 100.45, 80.55, 0.6 },
+    { 0.25, 50.4, 0.4 },
+  };
+  const unsigned int num_peaks = sizeof(peaks) / sizeof(peaks[0]);
+
+  itk_image_t::SizeType sz;
+  sz[0] = 128;
+  sz[1] = 96;
+  itk_image_t::Pointer surface = make_image<itk_image_t>(sz);
+  for (unsigned int i = 0; i < num_peaks; ++i)
+  {
+    AddPeak(surface, peaks[i][0], peaks[i][1], peaks[i][2], 3.0);
+  }
+
+  std::list<local_max_t> max_list;
+  const unsigned int     found = find_maxima_top_k(max_list, surface, nullptr, num_peaks);
+  if (found != num_peaks || max_list.size() != num_peaks)
+  {
+    std::cerr << "Expected " << num_peaks << " peaks, found " << found << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // the peaks are sorted strongest first:
+  unsigned int i = 0;
+  for (std::list<local_max_t>::const_iterator j = max_list.begin(); j != max_list.end(); ++j, ++i)
+  {
+    std::cout << "peak " << i << ": (" << j->x_ << ", " << j->y_ << "), value " << j->value_ << std::endl;
+    if (std::fabs(j->x_ - peaks[i][0]) > 1e-3 || std::fabs(j->y_ - peaks[i][1]) > 1e-3)
+    {
+      std::cerr << "Expected peak " << i << " at (" << peaks[i][0] << ", " << peaks[i][1] << ")" << std::endl;
+      status = EXIT_FAILURE;
+    }
+  }
+
+  // only the strongest peaks are kept:
+  max_list.clear();
+  if (find_maxima_top_k(max_list, surface, nullptr, 2) != 2 || std::fabs(max_list.front().x_ - peaks[0][0]) > 1e-3 ||
+      std::fabs(max_list.back().x_ - peaks[1][0]) > 1e-3)
+  {
+    std::cerr << "Expected the two strongest peaks" << std::endl;
+    status = EXIT_FAILURE;
+  }
+
+  // the detector is selectable when matching a pair of tiles,
+  // b is a shifted by (dx, dy):
+  using GeneratorType = itk::Statistics::MersenneTwisterRandomVariateGenerator;
+  GeneratorType::Pointer generator = GeneratorType::New();
+  generator->Initialize(1234);
+
+  const unsigned int w = 200;
+  const unsigned int h = 160;
+  const int          dx = 37;
+  const int          dy = -23;
+
+  itk_image_t::SizeType fi_sz;
+  fi_sz[0] = w + 2 * 64;
+  fi_sz[1] = h + 2 * 64;
+  itk_image_t::Pointer fi = make_image<itk_image_t>(fi_sz);
+  float *              fi_data = fi->GetBufferPointer();
+  for (unsigned int k = 0; k < fi_sz[0] * fi_sz[1]; ++k)
+  {
+    fi_data[k] = float(generator->GetVariateWithClosedRange(255.0));
+  }
+
+  itk_image_t::SizeType ab_sz;
+  ab_sz[0] = w;
+  ab_sz[1] = h;
+  itk_image_t::Pointer a = make_image<itk_image_t>(ab_sz);
+  itk_image_t::Pointer b = make_image<itk_image_t>(ab_sz);
+  for (unsigned int y = 0; y < h; ++y)
+  {
+    for (unsigned int x = 0; x < w; ++x)
+    {
+      itk_image_t::IndexType src;
+      src[0] = x + 64;
+      src[1] = y + 64;
+      itk_image_t::IndexType dst;
+      dst[0] = x;
+      dst[1] = y;
+      a->SetPixel(dst, fi->GetPixel(src));
+
+      src[0] += dx;
+      src[1] += dy;
+      b->SetPixel(dst, fi->GetPixel(src));
+    }
+  }
+
+  image_t::PointType offsetMin;
+  image_t::PointType offsetMax;
+  offsetMin.Fill(-double(w));
+  offsetMax.Fill(double(w));
+
+  translate_transform_t::Pointer ti;
+  const double                   metric = match_one_pair<itk_image_t, mask_t>(*null_log(),
+                                                            false,
+                                                            false,
+                                                            a.GetPointer(),
+                                                            b.GetPointer(),
+                                                            nullptr,
+                                                            nullptr,
+                                                            0.2,
+                                                            1.0,
+                                                            offsetMin,
+                                                            offsetMax,
+                                                            ti,
+                                                            nullptr,
+                                                            FFT_PADDING_NONE_E,
+                                                            PEAK_DETECTOR_TOP_K_E);
+  if (ti.IsNull() || metric == std::numeric_limits<double>::max())
+  {
+    std::cerr << "top-k: no match found" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const translate_transform_t::OutputVectorType offset = ti->GetOffset();
+  std::cout << "top-k: offset " << offset << std::endl;
+  if (std::fabs(offset[0] + dx) > 1.0 || std::fabs(offset[1] + dy) > 1.0)
+  {
+    std::cerr << "top-k: expected offset (" << -dx << ", " << -dy << ")" << std::endl;
+    status = EXIT_FAILURE;
+  }
+
+  return status;
+}
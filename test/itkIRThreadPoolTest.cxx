@@ -0,0 +1,117 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IRThreadPool.h"
+#include "IRStdThread.h"
+#include "IRStdMutex.h"
+
+#include "itkTimeProbe.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace
+{
+// Sleeps for a while, then records the thread it ran on:
+class sleepy_transaction_t : public the_transaction_t
+{
+public:
+  sleepy_transaction_t(const unsigned int          msec,
+                       the_thread_interface_t *&   ran_on,
+                       std::atomic<unsigned int> & done)
+    : msec_(msec)
+    , ran_on_(ran_on)
+    , done_(done)
+  {}
+
+  // virtual:
+  void
+  execute(the_thread_interface_t * thread)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(msec_));
+    ran_on_ = thread;
+    done_++;
+  }
+
+private:
+  const unsigned int          msec_;
+  the_thread_interface_t *&   ran_on_;
+  std::atomic<unsigned int> & done_;
+};
+} // namespace
+
+int
+itkIRThreadPoolTest(int, char *[])
+{
+  the_mutex_interface_t::set_creator(&the_std_mutex_t::create);
+  the_thread_interface_t::set_creator(&the_std_thread_t::create);
+
+  // the transactions are dealt round robin, so the first thread
+  // receives every expensive transaction:
+  const unsigned int num_threads = 4;
+  const unsigned int num_transactions = 64;
+
+  std::vector<the_thread_interface_t *> ran_on(num_transactions, nullptr);
+  std::atomic<unsigned int>             done(0);
+
+  std::list<the_transaction_t *> schedule;
+  for (unsigned int i = 0; i < num_transactions; i++)
+  {
+    const unsigned int msec = (i % num_threads == 0) ? 20 : 0;
+    schedule.push_back(new sleepy_transaction_t(msec, ran_on[i], done));
+  }
+
+  the_thread_pool_t thread_pool(num_threads);
+  thread_pool.set_work_stealing(true);
+  thread_pool.push_back(schedule);
+  thread_pool.pre_distribute_work();
+
+  itk::TimeProbe probe;
+  probe.Start();
+  thread_pool.start();
+  thread_pool.wait();
+  probe.Stop();
+
+  // the expensive transactions must have been shared:
+  std::set<the_thread_interface_t *> expensive;
+  for (unsigned int i = 0; i < num_transactions; i += num_threads)
+  {
+    expensive.insert(ran_on[i]);
+  }
+
+  std::cout << done << " of " << num_transactions << " transactions done in " << probe.GetTotal() << " s, "
+            << expensive.size() << " threads ran the expensive ones" << std::endl;
+
+  if (done != num_transactions)
+  {
+    std::cerr << "Every transaction must complete." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (expensive.size() < 2)
+  {
+    std::cerr << "The idle threads must steal pending transactions." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "IRGridCommon.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+// A smooth pattern without repeats over the neighborhood:
+double
+Pattern(const double x, const double y)
+{
+  return 100.0 + 50.0 * std::sin(0.21 * x) * std::cos(0.17 * y) + 30.0 * std::sin(0.007 * x * y + 0.3 * y);
+}
+
+// Two broad blobs under a fine texture, the texture traps
+// a single scale descent far from the optimum:
+double
+BlobsPattern(const double x, const double y)
+{
+  return 100.0 + 40.0 * std::exp(-((x - 24.0) * (x - 24.0) + (y - 20.0) * (y - 20.0)) / 200.0) -
+         30.0 * std::exp(-((x - 44.0) * (x - 44.0) + (y - 46.0) * (y - 46.0)) / 150.0) +
+         10.0 * std::sin(1.3 * x) * std::sin(1.1 * y);
+}
+
+itk_image_t::Pointer
+MakePatternImage(const unsigned int w,
+                 const unsigned int h,
+                 const double       dx,
+                 const double       dy,
+                 double (*pattern)(const double, const double) = Pattern)
+{
+  itk_image_t::SizeType sz;
+  sz[0] = w;
+  sz[1] = h;
+
+  itk_image_t::Pointer image = make_image<itk_image_t>(sz);
+  float *              data = image->GetBufferPointer();
+  for (unsigned int y = 0; y < h; ++y)
+  {
+    for (unsigned int x = 0; x < w; ++x)
+    {
+      data[x + y * w] = float(pattern(double(x) - dx, double(y) - dy));
+    }
+  }
+  return image;
+}
+} // namespace
+
+int
+itkIRTranslationNCCTest(int, char *[])
+{
+  int status = EXIT_SUCCESS;
+
+  const unsigned int w = 64;
+  const unsigned int h = 64;
+
+  // the moving neighborhood is the fixed neighborhood shifted by (dx, dy):
+  const double         shifts[][2] = { { 3.4, -2.7 }, { -5.25, 1.5 }, { 0.0, 0.0 } };
+  itk_image_t::Pointer fi = MakePatternImage(w, h, 0.0, 0.0);
+  for (const auto & s : shifts)
+  {
+    itk_image_t::Pointer mi = MakePatternImage(w, h, s[0], s[1]);
+
+    ncc_translation_t & ncc = ncc_translation_workspace();
+    ncc.set_fixed<itk_image_t>(fi, nullptr);
+    ncc.set_moving<itk_image_t>(mi, nullptr);
+
+    // the analytic derivative must agree with the finite differences:
+    vec2d_t       t = vec2d(1.3, 0.55);
+    vec2d_t       dmdt;
+    vec2d_t       unused;
+    const double  delta = 1e-5;
+    const double  metric = ncc.eval(t, dmdt);
+    for (unsigned int j = 0; j < 2; ++j)
+    {
+      vec2d_t ta = t;
+      vec2d_t tb = t;
+      ta[j] -= delta;
+      tb[j] += delta;
+
+      const double numeric = (ncc.eval(tb, unused) - ncc.eval(ta, unused)) / (2.0 * delta);
+      if (std::abs(numeric - dmdt[j]) > 1e-4 * std::max(1.0, std::abs(numeric)))
+      {
+        std::cerr << "derivative " << j << " at " << t << ": " << dmdt[j] << ", expected " << numeric << std::endl;
+        status = EXIT_FAILURE;
+      }
+    }
+
+    // the optimizer must recover the shift:
+    t = vec2d(0.0, 0.0);
+    const double best = ncc.optimize(t, 100, 1e-8, 1e+4);
+    std::cout << "shift (" << s[0] << ", " << s[1] << "): metric " << metric << " -> " << best << ", translation " << t
+              << std::endl;
+
+    if (std::abs(t[0] - s[0]) > 0.05 || std::abs(t[1] - s[1]) > 0.05)
+    {
+      std::cerr << "expected translation (" << s[0] << ", " << s[1] << ")" << std::endl;
+      status = EXIT_FAILURE;
+    }
+  }
+
+  // larger misalignments are captured coarse to fine:
+  const double large_shifts[][2] = { { 8.6, -6.3 }, { -10.2, 7.7 }, { 12.5, 9.25 } };
+  fi = MakePatternImage(w, h, 0.0, 0.0, BlobsPattern);
+  for (const auto & s : large_shifts)
+  {
+    itk_image_t::Pointer mi = MakePatternImage(w, h, s[0], s[1], BlobsPattern);
+
+    ncc_translation_t & ncc = ncc_translation_workspace();
+    ncc.set_fixed<itk_image_t>(fi, nullptr);
+    ncc.set_moving<itk_image_t>(mi, nullptr);
+
+    vec2d_t single = vec2d(0.0, 0.0);
+    ncc.optimize(single, 100, 1e-8, 1e+4);
+
+    vec2d_t      t = vec2d(0.0, 0.0);
+    const double best = ncc.optimize(t, 100, 1e-8, 1e+4, 3);
+    std::cout << "large shift (" << s[0] << ", " << s[1] << "): single scale " << single << ", 3 levels " << t
+              << ", metric " << best << std::endl;
+
+    if (std::abs(t[0] - s[0]) > 0.1 || std::abs(t[1] - s[1]) > 0.1)
+    {
+      std::cerr << "expected translation (" << s[0] << ", " << s[1] << ")" << std::endl;
+      status = EXIT_FAILURE;
+    }
+  }
+
+  return status;
+}